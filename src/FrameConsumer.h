@@ -0,0 +1,71 @@
+#pragma once
+
+//C ABI for other native modules which need decoded frames
+//without round trip through JavaScript:
+//player.nativeHandle is v8::External with handle for wcjs_add_frame_consumer,
+//functions could be resolved from WebChimera.js.node module with dlsym/GetProcAddress
+
+#include <stdint.h>
+
+#if defined(_WIN32)
+    #if defined(WCJS_BUILDING)
+        #define WCJS_API __declspec(dllexport)
+    #else
+        #define WCJS_API __declspec(dllimport)
+    #endif
+#else
+    #define WCJS_API __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define WCJS_MAX_PLANES 5
+
+typedef struct wcjs_frame wcjs_frame;
+
+typedef struct wcjs_frame_view
+{
+    char chroma[4]; //libvlc fourcc, like "I420" or "RV32", J420, J422 and J444 are full range
+    unsigned width;
+    unsigned height;
+
+    //with crop planes point to visible rect inside of larger decoded frame,
+    //so rows could be much longer than width and last row of last plane
+    //is valid only up to visible width
+    unsigned plane_count;
+    const uint8_t* planes[WCJS_MAX_PLANES];
+    unsigned pitches[WCJS_MAX_PLANES];
+    unsigned lines[WCJS_MAX_PLANES];
+
+    uint64_t sequence;  //incremented on every decoded frame
+    uint64_t wallclock; //uv_hrtime() when frame was decoded, in nanoseconds
+    int64_t pts;        //approximate media time of frame in milliseconds (latest libvlc input time), or -1
+    int bt709;          //1 if YUV uses BT.709 matrix, 0 if BT.601 (guessed from source size, like libvlc does)
+} wcjs_frame_view;
+
+//called from decode thread, frame is valid only until return,
+//unless it's retained with wcjs_frame_retain.
+//Retained frame keeps it's planes memory valid until last wcjs_frame_release:
+//- after video format change or cleanup it's buffer is not reused for new frames;
+//- after player close or destruction it's buffer is not freed, but it's leaked
+//  if frame is released only after that, so frames should be released before close.
+//Every retained frame blocks one of player frame buffers, so it should be released
+//as soon as possible. Consumer should not add or remove consumers from callback
+typedef void (*wcjs_frame_consumer_cb)(void* opaque, wcjs_frame* frame);
+
+WCJS_API const wcjs_frame_view* wcjs_frame_get_view(const wcjs_frame* frame);
+WCJS_API void wcjs_frame_retain(wcjs_frame* frame);
+//could be called from any thread
+WCJS_API void wcjs_frame_release(wcjs_frame* frame);
+
+//handle is valid while player object is alive,
+//return 0 on success
+WCJS_API int wcjs_add_frame_consumer(void* handle, wcjs_frame_consumer_cb callback, void* opaque);
+//callback will not be called after return
+WCJS_API int wcjs_remove_frame_consumer(void* handle, wcjs_frame_consumer_cb callback, void* opaque);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,706 @@
+#include "ImageEncoder.h"
+
+#include <string.h>
+#include <stdlib.h>
+
+#include <cmath>
+#include <algorithm>
+
+namespace {
+
+///////////////////////////////////////////////////////////////////////////////
+//PNG
+
+const uint32_t* crc32Table()
+{
+    struct Table
+    {
+        Table()
+        {
+            for(uint32_t n = 0; n < 256; ++n) {
+                uint32_t c = n;
+                for(unsigned k = 0; k < 8; ++k)
+                    c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+                entries[n] = c;
+            }
+        }
+
+        uint32_t entries[256];
+    };
+
+    static const Table table;
+
+    return table.entries;
+}
+
+uint32_t crc32(const uint8_t* data, size_t size)
+{
+    const uint32_t* table = crc32Table();
+
+    uint32_t crc = 0xffffffffu;
+    for(size_t i = 0; i < size; ++i)
+        crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+
+    return crc ^ 0xffffffffu;
+}
+
+uint32_t adler32(const uint8_t* data, size_t size)
+{
+    uint32_t a = 1, b = 0;
+    while(size) {
+        //biggest block which can't overflow before modulo
+        const size_t block = std::min<size_t>(size, 5552);
+        for(size_t i = 0; i < block; ++i) {
+            a += data[i];
+            b += a;
+        }
+        a %= 65521;
+        b %= 65521;
+
+        data += block;
+        size -= block;
+    }
+
+    return (b << 16) | a;
+}
+
+void appendUint32(std::vector<uint8_t>* out, uint32_t value)
+{
+    out->push_back(static_cast<uint8_t>(value >> 24));
+    out->push_back(static_cast<uint8_t>(value >> 16));
+    out->push_back(static_cast<uint8_t>(value >> 8));
+    out->push_back(static_cast<uint8_t>(value));
+}
+
+//deflate packs bits starting from least significant one
+class DeflateBitWriter
+{
+public:
+    DeflateBitWriter(std::vector<uint8_t>* out) :
+        _out(out), _bits(0), _count(0) {}
+
+    void write(uint32_t value, unsigned count)
+    {
+        _bits |= value << _count;
+        _count += count;
+        while(_count >= 8) {
+            _out->push_back(static_cast<uint8_t>(_bits));
+            _bits >>= 8;
+            _count -= 8;
+        }
+    }
+
+    //huffman codes are packed starting from most significant bit
+    void writeCode(uint32_t code, unsigned length)
+    {
+        uint32_t reversed = 0;
+        for(unsigned i = 0; i < length; ++i) {
+            reversed = (reversed << 1) | (code & 1);
+            code >>= 1;
+        }
+        write(reversed, length);
+    }
+
+    void flush()
+    {
+        if(_count)
+            _out->push_back(static_cast<uint8_t>(_bits));
+
+        _bits = 0;
+        _count = 0;
+    }
+
+private:
+    std::vector<uint8_t>* _out;
+    uint32_t _bits;
+    unsigned _count;
+};
+
+const uint16_t LengthBase[] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+const uint8_t LengthExtraBits[] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+const uint16_t DistanceBase[] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+const uint8_t DistanceExtraBits[] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+//literal/length alphabet of fixed huffman block
+void writeFixedSymbol(DeflateBitWriter* writer, unsigned symbol)
+{
+    if(symbol < 144)
+        writer->writeCode(0x30 + symbol, 8);
+    else if(symbol < 256)
+        writer->writeCode(0x190 + symbol - 144, 9);
+    else if(symbol < 280)
+        writer->writeCode(symbol - 256, 7);
+    else
+        writer->writeCode(0xc0 + symbol - 280, 8);
+}
+
+void writeMatch(DeflateBitWriter* writer, unsigned length, unsigned distance)
+{
+    unsigned l = sizeof(LengthBase) / sizeof(LengthBase[0]) - 1;
+    while(LengthBase[l] > length)
+        --l;
+    writeFixedSymbol(writer, 257 + l);
+    writer->write(length - LengthBase[l], LengthExtraBits[l]);
+
+    unsigned d = sizeof(DistanceBase) / sizeof(DistanceBase[0]) - 1;
+    while(DistanceBase[d] > distance)
+        --d;
+    writer->writeCode(d, 5);
+    writer->write(distance - DistanceBase[d], DistanceExtraBits[d]);
+}
+
+//single fixed huffman block with hash chain LZ77,
+//it's far from zlib ratio, but good enough for snapshots and has no dependencies
+void deflate(const uint8_t* data, size_t size, std::vector<uint8_t>* out)
+{
+    const unsigned WindowSize = 32768;
+    const unsigned HashBits = 15;
+    const unsigned MaxChain = 32;
+    const unsigned MinMatch = 3;
+    const unsigned MaxMatch = 258;
+
+    std::vector<int32_t> head(1 << HashBits, -1);
+    std::vector<int32_t> prev(WindowSize, -1);
+
+    auto hash = [data] (size_t pos) -> uint32_t {
+        const uint32_t bytes = (data[pos] << 16) | (data[pos + 1] << 8) | data[pos + 2];
+        return (bytes * 2654435761u) >> (32 - HashBits);
+    };
+    auto insert = [&] (size_t pos) {
+        if(pos + MinMatch > size)
+            return;
+        const uint32_t h = hash(pos);
+        prev[pos & (WindowSize - 1)] = head[h];
+        head[h] = static_cast<int32_t>(pos);
+    };
+
+    DeflateBitWriter writer(out);
+    writer.write(1, 1); //final block
+    writer.write(1, 2); //fixed huffman codes
+
+    size_t pos = 0;
+    while(pos < size) {
+        unsigned bestLength = 0;
+        unsigned bestDistance = 0;
+
+        if(pos + MinMatch <= size) {
+            const unsigned maxLength = static_cast<unsigned>(std::min<size_t>(MaxMatch, size - pos));
+
+            int32_t candidate = head[hash(pos)];
+            for(unsigned chain = 0;
+                chain < MaxChain && candidate >= 0 && pos - candidate <= WindowSize;
+                ++chain)
+            {
+                unsigned length = 0;
+                while(length < maxLength && data[candidate + length] == data[pos + length])
+                    ++length;
+
+                if(length > bestLength) {
+                    bestLength = length;
+                    bestDistance = static_cast<unsigned>(pos - candidate);
+                    if(length == maxLength)
+                        break;
+                }
+
+                const int32_t next = prev[candidate & (WindowSize - 1)];
+                if(next >= candidate)
+                    break;
+                candidate = next;
+            }
+        }
+
+        if(bestLength >= MinMatch) {
+            writeMatch(&writer, bestLength, bestDistance);
+            for(unsigned i = 0; i < bestLength; ++i)
+                insert(pos + i);
+            pos += bestLength;
+        } else {
+            writeFixedSymbol(&writer, data[pos]);
+            insert(pos);
+            ++pos;
+        }
+    }
+
+    writeFixedSymbol(&writer, 256); //end of block
+    writer.flush();
+}
+
+uint8_t paethPredictor(int a, int b, int c)
+{
+    const int p = a + b - c;
+    const int pa = abs(p - a);
+    const int pb = abs(p - b);
+    const int pc = abs(p - c);
+
+    if(pa <= pb && pa <= pc)
+        return static_cast<uint8_t>(a);
+    if(pb <= pc)
+        return static_cast<uint8_t>(b);
+    return static_cast<uint8_t>(c);
+}
+
+//applies filter type to row, returns sum of absolute values of filtered bytes,
+//which is usual heuristic to choose best filter
+unsigned filterRow(
+    unsigned type,
+    const uint8_t* row, const uint8_t* prevRow,
+    size_t rowBytes, unsigned pixelBytes,
+    uint8_t* filtered)
+{
+    unsigned sum = 0;
+    for(size_t i = 0; i < rowBytes; ++i) {
+        const int a = i >= pixelBytes ? row[i - pixelBytes] : 0;
+        const int b = prevRow ? prevRow[i] : 0;
+        const int c = prevRow && i >= pixelBytes ? prevRow[i - pixelBytes] : 0;
+
+        uint8_t predictor = 0;
+        switch(type) {
+            case 1: predictor = static_cast<uint8_t>(a); break;
+            case 2: predictor = static_cast<uint8_t>(b); break;
+            case 3: predictor = static_cast<uint8_t>((a + b) / 2); break;
+            case 4: predictor = paethPredictor(a, b, c); break;
+        }
+
+        filtered[i] = static_cast<uint8_t>(row[i] - predictor);
+        sum += filtered[i] < 128 ? filtered[i] : 256 - filtered[i];
+    }
+
+    return sum;
+}
+
+void appendPngChunk(
+    std::vector<uint8_t>* out,
+    const char* type, const uint8_t* data, size_t size)
+{
+    appendUint32(out, static_cast<uint32_t>(size));
+
+    const size_t chunkStart = out->size();
+    out->insert(out->end(), type, type + 4);
+    out->insert(out->end(), data, data + size);
+
+    appendUint32(out, crc32(out->data() + chunkStart, size + 4));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//JPEG
+
+const uint8_t ZigZag[64] = {
+    0, 1, 8, 16, 9, 2, 3, 10, 17, 24, 32, 25, 18, 11, 4, 5,
+    12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13, 6, 7, 14, 21, 28,
+    35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+    58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63 };
+
+//ITU T.81 Annex K tables, quantization ones are in natural order
+const uint8_t LuminanceQuantization[64] = {
+    16, 11, 10, 16, 24, 40, 51, 61,
+    12, 12, 14, 19, 26, 58, 60, 55,
+    14, 13, 16, 24, 40, 57, 69, 56,
+    14, 17, 22, 29, 51, 87, 80, 62,
+    18, 22, 37, 56, 68, 109, 103, 77,
+    24, 35, 55, 64, 81, 104, 113, 92,
+    49, 64, 78, 87, 103, 121, 120, 101,
+    72, 92, 95, 98, 112, 100, 103, 99 };
+const uint8_t ChrominanceQuantization[64] = {
+    17, 18, 24, 47, 99, 99, 99, 99,
+    18, 21, 26, 66, 99, 99, 99, 99,
+    24, 26, 56, 99, 99, 99, 99, 99,
+    47, 66, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99 };
+
+const uint8_t LuminanceDcCounts[16] = { 0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0 };
+const uint8_t LuminanceDcValues[12] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11 };
+const uint8_t ChrominanceDcCounts[16] = { 0, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0 };
+const uint8_t ChrominanceDcValues[12] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11 };
+
+const uint8_t LuminanceAcCounts[16] = { 0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7d };
+const uint8_t LuminanceAcValues[162] = {
+    0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07,
+    0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xa1, 0x08, 0x23, 0x42, 0xb1, 0xc1, 0x15, 0x52, 0xd1, 0xf0,
+    0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0a, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x25, 0x26, 0x27, 0x28,
+    0x29, 0x2a, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49,
+    0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69,
+    0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+    0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7,
+    0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5,
+    0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe1, 0xe2,
+    0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+    0xf9, 0xfa };
+const uint8_t ChrominanceAcCounts[16] = { 0, 2, 1, 2, 4, 4, 3, 4, 7, 5, 4, 4, 0, 1, 2, 0x77 };
+const uint8_t ChrominanceAcValues[162] = {
+    0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21, 0x31, 0x06, 0x12, 0x41, 0x51, 0x07, 0x61, 0x71,
+    0x13, 0x22, 0x32, 0x81, 0x08, 0x14, 0x42, 0x91, 0xa1, 0xb1, 0xc1, 0x09, 0x23, 0x33, 0x52, 0xf0,
+    0x15, 0x62, 0x72, 0xd1, 0x0a, 0x16, 0x24, 0x34, 0xe1, 0x25, 0xf1, 0x17, 0x18, 0x19, 0x1a, 0x26,
+    0x27, 0x28, 0x29, 0x2a, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48,
+    0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68,
+    0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87,
+    0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5,
+    0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3,
+    0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda,
+    0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+    0xf9, 0xfa };
+
+struct HuffmanTable
+{
+    HuffmanTable(const uint8_t counts[16], const uint8_t values[])
+    {
+        memset(codes, 0, sizeof(codes));
+        memset(lengths, 0, sizeof(lengths));
+
+        uint16_t code = 0;
+        unsigned v = 0;
+        for(unsigned length = 1; length <= 16; ++length) {
+            for(unsigned i = 0; i < counts[length - 1]; ++i, ++v) {
+                codes[values[v]] = code++;
+                lengths[values[v]] = static_cast<uint8_t>(length);
+            }
+            code <<= 1;
+        }
+    }
+
+    uint16_t codes[256];
+    uint8_t lengths[256];
+};
+
+//jpeg packs bits starting from most significant one,
+//and every 0xff byte in entropy coded data is followed by 0
+class JpegBitWriter
+{
+public:
+    JpegBitWriter(std::vector<uint8_t>* out) :
+        _out(out), _bits(0), _count(0) {}
+
+    void write(uint32_t value, unsigned count)
+    {
+        _bits = (_bits << count) | (value & ((1u << count) - 1));
+        _count += count;
+        while(_count >= 8) {
+            const uint8_t byte = static_cast<uint8_t>(_bits >> (_count - 8));
+            _out->push_back(byte);
+            if(0xff == byte)
+                _out->push_back(0);
+            _count -= 8;
+        }
+    }
+
+    void flush()
+    {
+        //pad with 1 bits
+        if(_count)
+            write(0x7f, 8 - _count);
+    }
+
+private:
+    std::vector<uint8_t>* _out;
+    uint32_t _bits;
+    unsigned _count;
+};
+
+void appendUint16(std::vector<uint8_t>* out, unsigned value)
+{
+    out->push_back(static_cast<uint8_t>(value >> 8));
+    out->push_back(static_cast<uint8_t>(value));
+}
+
+void appendHuffmanTable(
+    std::vector<uint8_t>* out,
+    uint8_t tableClassAndId,
+    const uint8_t counts[16], const uint8_t values[], unsigned valuesCount)
+{
+    out->push_back(tableClassAndId);
+    out->insert(out->end(), counts, counts + 16);
+    out->insert(out->end(), values, values + valuesCount);
+}
+
+class JpegEncoder
+{
+public:
+    JpegEncoder(unsigned quality, std::vector<uint8_t>* out) :
+        _luminanceDc(LuminanceDcCounts, LuminanceDcValues),
+        _luminanceAc(LuminanceAcCounts, LuminanceAcValues),
+        _chrominanceDc(ChrominanceDcCounts, ChrominanceDcValues),
+        _chrominanceAc(ChrominanceAcCounts, ChrominanceAcValues),
+        _out(out), _writer(out)
+    {
+        quality = std::max(1u, std::min(quality, 100u));
+        const unsigned scale = quality < 50 ? 5000 / quality : 200 - quality * 2;
+        for(unsigned i = 0; i < 64; ++i) {
+            _luminanceQuantization[i] = static_cast<uint8_t>(
+                std::max(1u, std::min((LuminanceQuantization[i] * scale + 50) / 100, 255u)));
+            _chrominanceQuantization[i] = static_cast<uint8_t>(
+                std::max(1u, std::min((ChrominanceQuantization[i] * scale + 50) / 100, 255u)));
+        }
+
+        for(unsigned u = 0; u < 8; ++u) {
+            const double c = u ? 1. : 1. / std::sqrt(2.);
+            for(unsigned x = 0; x < 8; ++x)
+                _dctTable[u][x] = static_cast<float>(c / 2 * std::cos((2 * x + 1) * u * std::acos(-1.) / 16));
+        }
+    }
+
+    void encode(const uint8_t* rgb, unsigned width, unsigned height)
+    {
+        writeHeaders(width, height);
+
+        int yDc = 0, cbDc = 0, crDc = 0;
+
+        float y[256], cb[256], cr[256];
+        float block[64];
+        for(unsigned mcuY = 0; mcuY < height; mcuY += 16) {
+            for(unsigned mcuX = 0; mcuX < width; mcuX += 16) {
+                //edge pixels are repeated to fill incomplete MCUs
+                for(unsigned row = 0; row < 16; ++row) {
+                    const unsigned py = std::min(mcuY + row, height - 1);
+                    for(unsigned col = 0; col < 16; ++col) {
+                        const unsigned px = std::min(mcuX + col, width - 1);
+                        const uint8_t* pixel = rgb + (static_cast<size_t>(py) * width + px) * 3;
+                        const float r = pixel[0], g = pixel[1], b = pixel[2];
+
+                        y[row * 16 + col] = 0.299f * r + 0.587f * g + 0.114f * b - 128;
+                        cb[row * 16 + col] = -0.168736f * r - 0.331264f * g + 0.5f * b;
+                        cr[row * 16 + col] = 0.5f * r - 0.418688f * g - 0.081312f * b;
+                    }
+                }
+
+                for(unsigned b = 0; b < 4; ++b) {
+                    const unsigned offset = (b / 2) * 8 * 16 + (b % 2) * 8;
+                    for(unsigned i = 0; i < 64; ++i)
+                        block[i] = y[offset + (i / 8) * 16 + i % 8];
+                    encodeBlock(block, _luminanceQuantization, _luminanceDc, _luminanceAc, &yDc);
+                }
+
+                subsample(cb, block);
+                encodeBlock(block, _chrominanceQuantization, _chrominanceDc, _chrominanceAc, &cbDc);
+                subsample(cr, block);
+                encodeBlock(block, _chrominanceQuantization, _chrominanceDc, _chrominanceAc, &crDc);
+            }
+        }
+
+        _writer.flush();
+
+        appendUint16(_out, 0xffd9); //EOI
+    }
+
+private:
+    void writeHeaders(unsigned width, unsigned height)
+    {
+        appendUint16(_out, 0xffd8); //SOI
+
+        static const uint8_t jfif[] = {
+            0xff, 0xe0, 0, 16, 'J', 'F', 'I', 'F', 0, 1, 1, 0, 0, 1, 0, 1, 0, 0 };
+        _out->insert(_out->end(), jfif, jfif + sizeof(jfif));
+
+        appendUint16(_out, 0xffdb); //DQT
+        appendUint16(_out, 2 + 2 * 65);
+        _out->push_back(0);
+        for(unsigned i = 0; i < 64; ++i)
+            _out->push_back(_luminanceQuantization[ZigZag[i]]);
+        _out->push_back(1);
+        for(unsigned i = 0; i < 64; ++i)
+            _out->push_back(_chrominanceQuantization[ZigZag[i]]);
+
+        appendUint16(_out, 0xffc0); //SOF0
+        appendUint16(_out, 17);
+        _out->push_back(8);
+        appendUint16(_out, height);
+        appendUint16(_out, width);
+        _out->push_back(3);
+        static const uint8_t components[] = {
+            1, 0x22, 0,
+            2, 0x11, 1,
+            3, 0x11, 1 };
+        _out->insert(_out->end(), components, components + sizeof(components));
+
+        appendUint16(_out, 0xffc4); //DHT
+        appendUint16(_out, 2 + 4 * 17 + 12 + 162 + 12 + 162);
+        appendHuffmanTable(_out, 0x00, LuminanceDcCounts, LuminanceDcValues, 12);
+        appendHuffmanTable(_out, 0x10, LuminanceAcCounts, LuminanceAcValues, 162);
+        appendHuffmanTable(_out, 0x01, ChrominanceDcCounts, ChrominanceDcValues, 12);
+        appendHuffmanTable(_out, 0x11, ChrominanceAcCounts, ChrominanceAcValues, 162);
+
+        static const uint8_t scan[] = {
+            0xff, 0xda, 0, 12, 3,
+            1, 0x00,
+            2, 0x11,
+            3, 0x11,
+            0, 63, 0 };
+        _out->insert(_out->end(), scan, scan + sizeof(scan));
+    }
+
+    static void subsample(const float* plane, float* block)
+    {
+        for(unsigned i = 0; i < 64; ++i) {
+            const float* p = plane + (i / 8) * 2 * 16 + (i % 8) * 2;
+            block[i] = (p[0] + p[1] + p[16] + p[17]) / 4;
+        }
+    }
+
+    static unsigned bitLength(int value)
+    {
+        unsigned length = 0;
+        for(unsigned v = static_cast<unsigned>(abs(value)); v; v >>= 1)
+            ++length;
+        return length;
+    }
+
+    void writeValue(int value, unsigned length)
+    {
+        //negative values are stored as one's complement
+        _writer.write(static_cast<uint32_t>(value < 0 ? value - 1 : value), length);
+    }
+
+    void encodeBlock(
+        const float block[64], const uint8_t quantization[64],
+        const HuffmanTable& dcTable, const HuffmanTable& acTable,
+        int* prevDc)
+    {
+        //separable forward DCT
+        float rows[64];
+        for(unsigned y = 0; y < 8; ++y) {
+            for(unsigned u = 0; u < 8; ++u) {
+                float sum = 0;
+                for(unsigned x = 0; x < 8; ++x)
+                    sum += block[y * 8 + x] * _dctTable[u][x];
+                rows[y * 8 + u] = sum;
+            }
+        }
+
+        int coefficients[64];
+        for(unsigned u = 0; u < 8; ++u) {
+            for(unsigned v = 0; v < 8; ++v) {
+                float sum = 0;
+                for(unsigned y = 0; y < 8; ++y)
+                    sum += rows[y * 8 + u] * _dctTable[v][y];
+                coefficients[v * 8 + u] =
+                    static_cast<int>(std::lround(sum / quantization[v * 8 + u]));
+            }
+        }
+
+        const int dc = coefficients[0];
+        const int dcDiff = dc - *prevDc;
+        *prevDc = dc;
+
+        const unsigned dcLength = bitLength(dcDiff);
+        _writer.write(dcTable.codes[dcLength], dcTable.lengths[dcLength]);
+        writeValue(dcDiff, dcLength);
+
+        unsigned zeroRun = 0;
+        for(unsigned i = 1; i < 64; ++i) {
+            const int ac = coefficients[ZigZag[i]];
+            if(0 == ac) {
+                ++zeroRun;
+                continue;
+            }
+
+            while(zeroRun > 15) {
+                _writer.write(acTable.codes[0xf0], acTable.lengths[0xf0]);
+                zeroRun -= 16;
+            }
+
+            const unsigned acLength = bitLength(ac);
+            const unsigned symbol = (zeroRun << 4) | acLength;
+            _writer.write(acTable.codes[symbol], acTable.lengths[symbol]);
+            writeValue(ac, acLength);
+
+            zeroRun = 0;
+        }
+
+        if(zeroRun)
+            _writer.write(acTable.codes[0x00], acTable.lengths[0x00]); //EOB
+    }
+
+private:
+    uint8_t _luminanceQuantization[64];
+    uint8_t _chrominanceQuantization[64];
+    float _dctTable[8][8];
+
+    const HuffmanTable _luminanceDc;
+    const HuffmanTable _luminanceAc;
+    const HuffmanTable _chrominanceDc;
+    const HuffmanTable _chrominanceAc;
+
+    std::vector<uint8_t>* _out;
+    JpegBitWriter _writer;
+};
+
+}
+
+///////////////////////////////////////////////////////////////////////////////
+bool EncodePng(
+    const uint8_t* rgb, unsigned width, unsigned height,
+    std::vector<uint8_t>* out)
+{
+    if(!width || !height || width > 0x7fffffff || height > 0x7fffffff)
+        return false;
+
+    const unsigned PixelBytes = 3;
+    const size_t rowBytes = static_cast<size_t>(width) * PixelBytes;
+
+    std::vector<uint8_t> filtered((rowBytes + 1) * height);
+    std::vector<uint8_t> candidate(rowBytes);
+    for(unsigned y = 0; y < height; ++y) {
+        const uint8_t* row = rgb + y * rowBytes;
+        const uint8_t* prevRow = y ? row - rowBytes : nullptr;
+        uint8_t* filteredRow = filtered.data() + y * (rowBytes + 1);
+
+        unsigned bestSum = filterRow(0, row, prevRow, rowBytes, PixelBytes, filteredRow + 1);
+        filteredRow[0] = 0;
+        for(unsigned type = 1; type <= 4; ++type) {
+            const unsigned sum =
+                filterRow(type, row, prevRow, rowBytes, PixelBytes, candidate.data());
+            if(sum < bestSum) {
+                bestSum = sum;
+                filteredRow[0] = static_cast<uint8_t>(type);
+                memcpy(filteredRow + 1, candidate.data(), rowBytes);
+            }
+        }
+    }
+
+    std::vector<uint8_t> zlib;
+    zlib.push_back(0x78); //deflate with 32K window
+    zlib.push_back(0x01); //no preset dictionary, fastest compression level
+    deflate(filtered.data(), filtered.size(), &zlib);
+    appendUint32(&zlib, adler32(filtered.data(), filtered.size()));
+
+    static const uint8_t signature[] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+    out->insert(out->end(), signature, signature + sizeof(signature));
+
+    std::vector<uint8_t> header;
+    appendUint32(&header, width);
+    appendUint32(&header, height);
+    header.push_back(8); //bit depth
+    header.push_back(2); //truecolor
+    header.push_back(0); //deflate
+    header.push_back(0); //adaptive filtering
+    header.push_back(0); //no interlace
+
+    appendPngChunk(out, "IHDR", header.data(), header.size());
+    appendPngChunk(out, "IDAT", zlib.data(), zlib.size());
+    appendPngChunk(out, "IEND", nullptr, 0);
+
+    return true;
+}
+
+bool EncodeJpeg(
+    const uint8_t* rgb, unsigned width, unsigned height,
+    unsigned quality,
+    std::vector<uint8_t>* out)
+{
+    if(!width || !height || width > 0xffff || height > 0xffff)
+        return false;
+
+    JpegEncoder encoder(quality, out);
+    encoder.encode(rgb, width, height);
+
+    return true;
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <vector>
+
+///////////////////////////////////////////////////////////////////////////////
+//dependency free still image encoders,
+//rgb is width * height * 3 bytes without row padding,
+//encoded image is appended to out
+bool EncodePng(
+    const uint8_t* rgb, unsigned width, unsigned height,
+    std::vector<uint8_t>* out);
+
+//baseline JPEG with 4:2:0 chroma subsampling,
+//quality is from 1 to 100
+bool EncodeJpeg(
+    const uint8_t* rgb, unsigned width, unsigned height,
+    unsigned quality,
+    std::vector<uint8_t>* out);
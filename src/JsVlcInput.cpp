@@ -123,7 +123,7 @@ double JsVlcInput::position()
 
 void JsVlcInput::setPosition(double position)
 {
-    _jsPlayer->player().playback().set_position(static_cast<float>(position));
+    _jsPlayer->setPosition(position);
 }
 
 double JsVlcInput::time()
@@ -133,7 +133,7 @@ double JsVlcInput::time()
 
 void JsVlcInput::setTime(double time)
 {
-    return _jsPlayer->player().playback().set_time(static_cast<libvlc_time_t>(time));
+    _jsPlayer->setTime(time);
 }
 
 double JsVlcInput::rate()
@@ -2,6 +2,8 @@
 
 #include <string.h>
 
+#include <algorithm>
+
 #include "node.h"
 #include "node_buffer.h"
 #include "NodeTools.h"
@@ -10,6 +12,7 @@
 #include "JsVlcVideo.h"
 #include "JsVlcSubtitles.h"
 #include "JsVlcPlaylist.h"
+#include "ImageEncoder.h"
 
 #if V8_MAJOR_VERSION > 4 || \
     (V8_MAJOR_VERSION == 4 && V8_MINOR_VERSION > 4) || \
@@ -19,6 +22,12 @@
 
 #endif
 
+#if V8_MAJOR_VERSION >= 8
+
+#define USE_BACKING_STORE 1
+
+#endif
+
 #undef min
 #undef max
 
@@ -27,6 +36,9 @@ const char* JsVlcPlayer::callbackNames[] =
     "FrameSetup",
     "FrameReady",
     "FrameCleanup",
+    "SceneChange",
+    "TensorReady",
+    "AdaptiveScaleChange",
 
     "MediaChanged",
     "NothingSpecial",
@@ -137,6 +149,17 @@ void JsVlcPlayer::LibvlcLogEvent::process(JsVlcPlayer* jsPlayer)
     jsPlayer->callCallback(CB_LogMessage, { jsLevel, jsMessage, jsFormat });
 }
 
+///////////////////////////////////////////////////////////////////////////////
+struct JsVlcPlayer::TensorReadyEvent : public JsVlcPlayer::AsyncData
+{
+    void process(JsVlcPlayer*);
+};
+
+void JsVlcPlayer::TensorReadyEvent::process(JsVlcPlayer* jsPlayer)
+{
+    jsPlayer->deliverTensor();
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 #define SET_CALLBACK_PROPERTY(objTemplate, name, callback)                                                      \
     objTemplate->SetAccessor(String::NewFromUtf8(Isolate::GetCurrent(), name, v8::NewStringType::kInternalized).ToLocalChecked(), \
@@ -199,6 +222,34 @@ void JsVlcPlayer::initJsApi(
         String::NewFromUtf8(isolate, "I420", NewStringType::kInternalized).ToLocalChecked(),
         Integer::New(isolate, static_cast<int>(PixelFormat::I420)),
         static_cast<PropertyAttribute>(ReadOnly | DontDelete));
+    protoTemplate->Set(
+        String::NewFromUtf8(isolate, "NV12", NewStringType::kInternalized).ToLocalChecked(),
+        Integer::New(isolate, static_cast<int>(PixelFormat::NV12)),
+        static_cast<PropertyAttribute>(ReadOnly | DontDelete));
+    protoTemplate->Set(
+        String::NewFromUtf8(isolate, "I422", NewStringType::kInternalized).ToLocalChecked(),
+        Integer::New(isolate, static_cast<int>(PixelFormat::I422)),
+        static_cast<PropertyAttribute>(ReadOnly | DontDelete));
+    protoTemplate->Set(
+        String::NewFromUtf8(isolate, "I444", NewStringType::kInternalized).ToLocalChecked(),
+        Integer::New(isolate, static_cast<int>(PixelFormat::I444)),
+        static_cast<PropertyAttribute>(ReadOnly | DontDelete));
+    protoTemplate->Set(
+        String::NewFromUtf8(isolate, "YUY2", NewStringType::kInternalized).ToLocalChecked(),
+        Integer::New(isolate, static_cast<int>(PixelFormat::YUY2)),
+        static_cast<PropertyAttribute>(ReadOnly | DontDelete));
+    protoTemplate->Set(
+        String::NewFromUtf8(isolate, "RV16", NewStringType::kInternalized).ToLocalChecked(),
+        Integer::New(isolate, static_cast<int>(PixelFormat::RV16)),
+        static_cast<PropertyAttribute>(ReadOnly | DontDelete));
+    protoTemplate->Set(
+        String::NewFromUtf8(isolate, "RGBA", NewStringType::kInternalized).ToLocalChecked(),
+        Integer::New(isolate, static_cast<int>(PixelFormat::RGBA)),
+        static_cast<PropertyAttribute>(ReadOnly | DontDelete));
+    protoTemplate->Set(
+        String::NewFromUtf8(isolate, "NATIVE", NewStringType::kInternalized).ToLocalChecked(),
+        Integer::New(isolate, static_cast<int>(PixelFormat::Native)),
+        static_cast<PropertyAttribute>(ReadOnly | DontDelete));
 
     protoTemplate->Set(
         String::NewFromUtf8(isolate, "NothingSpecial", NewStringType::kInternalized).ToLocalChecked(),
@@ -254,6 +305,9 @@ void JsVlcPlayer::initJsApi(
     SET_CALLBACK_PROPERTY(instanceTemplate, "onFrameSetup", CB_FrameSetup);
     SET_CALLBACK_PROPERTY(instanceTemplate, "onFrameReady", CB_FrameReady);
     SET_CALLBACK_PROPERTY(instanceTemplate, "onFrameCleanup", CB_FrameCleanup);
+    SET_CALLBACK_PROPERTY(instanceTemplate, "onSceneChange", CB_SceneChange);
+    SET_CALLBACK_PROPERTY(instanceTemplate, "onTensorReady", CB_TensorReady);
+    SET_CALLBACK_PROPERTY(instanceTemplate, "onAdaptiveScaleChange", CB_AdaptiveScaleChange);
 
     SET_CALLBACK_PROPERTY(instanceTemplate, "onMediaChanged", CB_MediaPlayerMediaChanged);
     SET_CALLBACK_PROPERTY(instanceTemplate, "onNothingSpecial", CB_MediaPlayerNothingSpecial);
@@ -286,9 +340,27 @@ void JsVlcPlayer::initJsApi(
     SET_RO_PROPERTY(instanceTemplate, "playlist", &JsVlcPlayer::playlist);
 
     SET_RO_PROPERTY(instanceTemplate, "videoFrame", &JsVlcPlayer::getVideoFrame);
+    SET_RO_PROPERTY(instanceTemplate, "frameBuffers", &JsVlcPlayer::getFrameBuffers);
+    SET_RO_PROPERTY(instanceTemplate, "frameSync", &JsVlcPlayer::getFrameSync);
+    SET_RO_PROPERTY(instanceTemplate, "frameInfo", &JsVlcPlayer::getFrameInfo);
+    SET_RO_PROPERTY(instanceTemplate, "frameStats", &JsVlcPlayer::getFrameStats);
+    SET_RO_PROPERTY(instanceTemplate, "nativeHandle", &JsVlcPlayer::getNativeHandle);
+    SET_RO_PROPERTY(instanceTemplate, "duplicateFramesSuppressed", &JsVlcPlayer::duplicateFramesSuppressed);
+    SET_RO_PROPERTY(instanceTemplate, "droppedFrames", &JsVlcPlayer::droppedFrames);
+    SET_RO_PROPERTY(instanceTemplate, "deliveredFps", &JsVlcPlayer::deliveredFps);
+    SET_RO_PROPERTY(instanceTemplate, "timeToFirstFrame", &JsVlcPlayer::timeToFirstFrame);
+    SET_RO_PROPERTY(instanceTemplate, "audioOnly", &JsVlcPlayer::audioOnly);
     SET_RO_PROPERTY(instanceTemplate, "events", &JsVlcPlayer::getEventEmitter);
 
     SET_RW_PROPERTY(instanceTemplate, "pixelFormat", &JsVlcPlayer::pixelFormat, &JsVlcPlayer::setPixelFormat);
+    SET_RW_PROPERTY(instanceTemplate, "processMode", &JsVlcPlayer::processMode, &JsVlcPlayer::setProcessMode);
+    SET_RW_PROPERTY(instanceTemplate, "maxFps", &JsVlcPlayer::maxFps, &JsVlcPlayer::setMaxFps);
+    SET_RW_PROPERTY(instanceTemplate, "cadenceFps", &JsVlcPlayer::cadenceFps, &JsVlcPlayer::setCadenceFps);
+    SET_RW_PROPERTY(instanceTemplate, "sceneChangeThreshold", &JsVlcPlayer::sceneChangeThreshold, &JsVlcPlayer::setSceneChangeThreshold);
+    SET_RW_PROPERTY(instanceTemplate, "frameStatsInterval", &JsVlcPlayer::frameStatsInterval, &JsVlcPlayer::setFrameStatsInterval);
+    SET_RW_PROPERTY(instanceTemplate, "suppressDuplicateFrames", &JsVlcPlayer::suppressDuplicateFrames, &JsVlcPlayer::setSuppressDuplicateFrames);
+    SET_RW_PROPERTY(instanceTemplate, "strideAlignment", &JsVlcPlayer::strideAlignment, &JsVlcPlayer::setStrideAlignment);
+    SET_RW_PROPERTY(instanceTemplate, "sharedFrameBuffers", &JsVlcPlayer::sharedFrameBuffers, &JsVlcPlayer::setSharedFrameBuffers);
     SET_RW_PROPERTY(instanceTemplate, "position", &JsVlcPlayer::position, &JsVlcPlayer::setPosition);
     SET_RW_PROPERTY(instanceTemplate, "time", &JsVlcPlayer::time, &JsVlcPlayer::setTime);
     SET_RW_PROPERTY(instanceTemplate, "volume", &JsVlcPlayer::volume, &JsVlcPlayer::setVolume);
@@ -300,6 +372,11 @@ void JsVlcPlayer::initJsApi(
     SET_METHOD(constructorTemplate, "stop",  &JsVlcPlayer::stop);
     SET_METHOD(constructorTemplate, "toggleMute", &JsVlcPlayer::toggleMute);
 
+    SET_METHOD(constructorTemplate, "preallocateFrameBuffers", &JsVlcPlayer::preallocateFrameBuffers);
+
+    SET_METHOD(constructorTemplate, "subscribeFrames", &JsVlcPlayer::subscribeFrames);
+    SET_METHOD(constructorTemplate, "unsubscribeFrames", &JsVlcPlayer::unsubscribeFrames);
+
     SET_METHOD(constructorTemplate, "close", &JsVlcPlayer::close);
 
     Local<Function> constructor = constructorTemplate->GetFunction(context).ToLocalChecked();
@@ -335,18 +412,24 @@ void JsVlcPlayer::jsCreate(const v8::FunctionCallbackInfo<v8::Value>& args)
 
     Local<Object> thisObject = args.Holder();
     if(args.IsConstructCall()) {
-        Local<Array> options;
-        if(args.Length() == 1 && args[0]->IsArray()) {
-            options = Local<Array>::Cast(args[0]);
+        //([vlcOpts], [options]) or (options)
+        Local<Array> vlcOpts;
+        Local<Value> options = Undefined(isolate);
+        if(args.Length() >= 1 && args[0]->IsArray()) {
+            vlcOpts = Local<Array>::Cast(args[0]);
+            if(args.Length() >= 2)
+                options = args[1];
+        } else if(args.Length() >= 1) {
+            options = args[0];
         }
 
         ContextData* contextData =
             static_cast<ContextData*>(args.Data().As<External>()->Value());
 
-        JsVlcPlayer* jsPlayer = new JsVlcPlayer(thisObject, options, contextData);
+        JsVlcPlayer* jsPlayer = new JsVlcPlayer(thisObject, vlcOpts, options, contextData);
         args.GetReturnValue().Set(jsPlayer->handle());
     } else {
-        Local<Value> argv[] = { args[0] };
+        Local<Value> argv[] = { args[0], args[1] };
         Local<Function> constructor =
             Local<Function>::New(isolate, _jsConstructor);
         args.GetReturnValue().Set(
@@ -356,12 +439,41 @@ void JsVlcPlayer::jsCreate(const v8::FunctionCallbackInfo<v8::Value>& args)
     }
 }
 
+///////////////////////////////////////////////////////////////////////////////
+struct JsVlcPlayer::FrameSubscriber
+{
+    unsigned id;
+    //false if subscriber gets delivered frame as is
+    bool converted;
+    FrameVariant variant;
+    v8::UniquePersistent<v8::Function> callback;
+};
+
+//converted frame shared by all subscribers of the same variant
+struct JsVlcPlayer::JsVariantFrame
+{
+    FrameVariant variant;
+    unsigned width;
+    unsigned height;
+    //FrameInfo::sequence of frame copied to data
+    uint64_t sequence;
+    uint8_t* data;
+    v8::UniquePersistent<v8::Uint8Array> jsFrame;
+};
+
+///////////////////////////////////////////////////////////////////////////////
 JsVlcPlayer::JsVlcPlayer(
     v8::Local<v8::Object>& thisObject,
     const v8::Local<v8::Array>& vlcOpts,
+    const v8::Local<v8::Value>& options,
     ContextData* contextData) :
     _contextData(contextData),
-    _libvlc(nullptr)
+    _libvlc(nullptr),
+    _sharedFrameBuffers(false), _frameSync(nullptr),
+    _frameStats(nullptr),
+    _processMode(false), _audioOnly(false),
+    _restartingVideoOutput(false), _restartItem(-1), _restartTime(-1), _restartPaused(false),
+    _lastFrameSubscriberId(0)
 {
     using namespace v8;
 
@@ -403,13 +515,27 @@ JsVlcPlayer::JsVlcPlayer(
 
     _jsEventEmitter.Reset(isolate, jsEventEmitter);
 
+    _jsFrameInfo.Reset(isolate, Object::New(isolate));
+    updateFrameInfo(FrameInfo { 0, 0, -1, 0 });
+
+    _audioOnly = FromJsValue<bool>(GetProperty(options, "audioOnly"));
+
     initLibvlc(vlcOpts);
 
     _player.set_playback_mode(vlc::mode_normal);
 
+#ifdef USE_BACKING_STORE
+    //array buffers could be created for natively allocated memory,
+    //so decode thread doesn't have to wait gui thread to set up frame buffers
+    VlcVideoOutput::setNativeFrameBuffers(true);
+#endif
+
     if(_libvlc && _player.open(_libvlc)) {
         _player.register_callback(this);
-        VlcVideoOutput::open(&_player.basic_player());
+        //without video output libvlc would open it's own window for video,
+        //but with audioOnly video tracks are not selected at all
+        if(!_audioOnly)
+            VlcVideoOutput::open(&_player.basic_player());
     } else {
         assert(false);
     }
@@ -434,12 +560,10 @@ void JsVlcPlayer::initLibvlc(const v8::Local<v8::Array>& vlcOpts)
         _libvlc = nullptr;
     }
 
-    if(vlcOpts.IsEmpty() || vlcOpts->Length() == 0) {
-        _libvlc = libvlc_new(0, nullptr);
-    } else {
-        std::deque<std::string> opts;
-        std::vector<const char*> libvlcOpts;
+    std::deque<std::string> opts;
+    std::vector<const char*> libvlcOpts;
 
+    if(!vlcOpts.IsEmpty()) {
         for(unsigned i = 0;
             i < std::min<unsigned>(vlcOpts->Length(), std::numeric_limits<short>::max());
             ++i)
@@ -450,9 +574,16 @@ void JsVlcPlayer::initLibvlc(const v8::Local<v8::Array>& vlcOpts)
                 libvlcOpts.push_back(it->c_str());
             }
         }
+    }
 
+    //video elementary streams are not selected, so neither decoded nor converted
+    if(_audioOnly)
+        libvlcOpts.push_back("--no-video");
+
+    if(libvlcOpts.empty())
+        _libvlc = libvlc_new(0, nullptr);
+    else
         _libvlc = libvlc_new(static_cast<int>(libvlcOpts.size()), libvlcOpts.data());
-    }
 
     if(_libvlc) {
         libvlc_log_set(_libvlc, JsVlcPlayer::log_event_wrapper, this);
@@ -468,9 +599,21 @@ JsVlcPlayer::~JsVlcPlayer()
 
 void JsVlcPlayer::close()
 {
+    if(_rawRecorder) {
+        VlcVideoOutput::removeFrameConsumer(RawVideoRecorder::frame_consumer_cb, _rawRecorder.get());
+        _rawRecorder.reset();
+    }
+
+    stopTensorOutput();
+
+    VlcVideoOutput::cancelFrameWait();
+
     _player.unregister_callback(this);
-    VlcVideoOutput::close();
+    if(!_audioOnly)
+        VlcVideoOutput::close();
+    VlcVideoOutput::setBufferSync(nullptr, nullptr);
 
+    _processModeMedia.clear();
     _player.close();
 
     _async.data = nullptr;
@@ -549,196 +692,819 @@ void JsVlcPlayer::handleAsync()
             i->process(this);
 
             //events queue could be very long...
-            if(VlcVideoOutput::isFrameReady()) {
-                onFrameReady();
-            }
+            VlcVideoOutput::processFrameReady();
         }
     }
 }
 
-void* JsVlcPlayer::onFrameSetup(const RV32VideoFrame& videoFrame)
+///////////////////////////////////////////////////////////////////////////////
+struct JsVlcPlayer::JsFrameBuffer : public VlcVideoOutput::FrameBuffer
+{
+    //data is aligned to VideoFrame::MaxAlignment inside of array buffer
+    JsFrameBuffer(const v8::Local<v8::ArrayBuffer>& arrayBuffer, void* data) :
+        FrameBuffer(alignedData(data), alignedCapacity(arrayBuffer->ByteLength(), data)),
+        byteOffset(alignmentOffset(data)),
+        arrayBuffer(v8::Isolate::GetCurrent(), arrayBuffer) {}
+    JsFrameBuffer(const v8::Local<v8::SharedArrayBuffer>& sharedArrayBuffer, void* data) :
+        FrameBuffer(alignedData(data), alignedCapacity(sharedArrayBuffer->ByteLength(), data)),
+        byteOffset(alignmentOffset(data)),
+        sharedArrayBuffer(v8::Isolate::GetCurrent(), sharedArrayBuffer) {}
+#ifdef USE_BACKING_STORE
+    //natively allocated storage doesn't touch js, so could be created from decode thread,
+    //array buffer for it is created by wrapStorage from gui thread
+    JsFrameBuffer(const std::shared_ptr<uint8_t>& storage, size_t byteLength) :
+        FrameBuffer(alignedData(storage.get()), alignedCapacity(byteLength, storage.get())),
+        byteOffset(alignmentOffset(storage.get())),
+        storage(storage), storageLength(byteLength) {}
+#endif
+
+    static size_t alignmentOffset(void* data)
+    {
+        const size_t alignment = VideoFrame::MaxAlignment;
+        return (alignment - reinterpret_cast<uintptr_t>(data) % alignment) % alignment;
+    }
+    static void* alignedData(void* data)
+        { return static_cast<uint8_t*>(data) + alignmentOffset(data); }
+    static size_t alignedCapacity(size_t byteLength, void* data)
+        { return byteLength - alignmentOffset(data); }
+
+    //Uint8ClampedArray if clamped is true, Uint8Array otherwise
+    v8::Local<v8::TypedArray> createView(size_t offset, size_t length, bool clamped = false) const;
+
+#ifdef USE_BACKING_STORE
+    //makes array buffer of requested kind for native storage, if there is no such one yet,
+    //storage stays alive while any array buffer created for it is alive
+    void wrapStorage(bool shared);
+    static void releaseStorage(void* data, size_t length, void* storage);
+#endif
+
+    const size_t byteOffset;
+    v8::UniquePersistent<v8::ArrayBuffer> arrayBuffer;
+    v8::UniquePersistent<v8::SharedArrayBuffer> sharedArrayBuffer;
+#ifdef USE_BACKING_STORE
+    std::shared_ptr<uint8_t> storage;
+    size_t storageLength; //valid only with storage
+#endif
+};
+
+#ifdef USE_BACKING_STORE
+void JsVlcPlayer::JsFrameBuffer::wrapStorage(bool shared)
 {
     using namespace v8;
 
-    if(0 == videoFrame.width() || 0 == videoFrame.height() || 0 == videoFrame.size()) {
-        assert(false);
-        return nullptr;
+    if(!storage)
+        return;
+
+    Isolate* isolate = Isolate::GetCurrent();
+
+    if(shared && sharedArrayBuffer.IsEmpty()) {
+        std::shared_ptr<BackingStore> backingStore =
+            SharedArrayBuffer::NewBackingStore(
+                storage.get(), storageLength,
+                releaseStorage, new std::shared_ptr<uint8_t>(storage));
+        sharedArrayBuffer.Reset(isolate, SharedArrayBuffer::New(isolate, backingStore));
+        arrayBuffer.Reset();
+    } else if(!shared && arrayBuffer.IsEmpty()) {
+        std::shared_ptr<BackingStore> backingStore =
+            ArrayBuffer::NewBackingStore(
+                storage.get(), storageLength,
+                releaseStorage, new std::shared_ptr<uint8_t>(storage));
+        arrayBuffer.Reset(isolate, ArrayBuffer::New(isolate, backingStore));
+        sharedArrayBuffer.Reset();
+    }
+}
+
+void JsVlcPlayer::JsFrameBuffer::releaseStorage(void* /*data*/, size_t /*length*/, void* storage)
+{
+    //could be called from any thread
+    delete static_cast<std::shared_ptr<uint8_t>*>(storage);
+}
+#endif
+
+v8::Local<v8::TypedArray> JsVlcPlayer::JsFrameBuffer::createView(
+    size_t offset, size_t length,
+    bool clamped) const
+{
+    using namespace v8;
+
+    Isolate* isolate = Isolate::GetCurrent();
+
+    if(!sharedArrayBuffer.IsEmpty()) {
+        Local<SharedArrayBuffer> buffer = Local<SharedArrayBuffer>::New(isolate, sharedArrayBuffer);
+        if(clamped)
+            return Uint8ClampedArray::New(buffer, byteOffset + offset, length);
+        else
+            return Uint8Array::New(buffer, byteOffset + offset, length);
+    } else {
+        Local<ArrayBuffer> buffer = Local<ArrayBuffer>::New(isolate, arrayBuffer);
+        if(clamped)
+            return Uint8ClampedArray::New(buffer, byteOffset + offset, length);
+        else
+            return Uint8Array::New(buffer, byteOffset + offset, length);
+    }
+}
+
+std::unique_ptr<VlcVideoOutput::FrameBuffer> JsVlcPlayer::onFrameBufferAlloc(size_t capacity)
+{
+    using namespace v8;
+
+    //reserve space to align data
+    const size_t byteLength = capacity + VideoFrame::MaxAlignment;
+
+#ifdef USE_BACKING_STORE
+    if(nativeFrameBuffers()) {
+        //zeroed like array buffers, so frame is black until first decoded one
+        std::shared_ptr<uint8_t> storage(static_cast<uint8_t*>(calloc(byteLength, 1)), free);
+        if(!storage)
+            return nullptr;
+
+        return std::unique_ptr<FrameBuffer>(new JsFrameBuffer(storage, byteLength));
+    }
+#endif
+
+    Isolate* isolate = Isolate::GetCurrent();
+
+    if(_sharedFrameBuffers) {
+        Local<SharedArrayBuffer> sharedArrayBuffer = SharedArrayBuffer::New(isolate, byteLength);
+#ifdef USE_BACKING_STORE
+        void* data = sharedArrayBuffer->GetBackingStore()->Data();
+#else
+        void* data = sharedArrayBuffer->GetContents().Data();
+#endif
+        return std::unique_ptr<FrameBuffer>(new JsFrameBuffer(sharedArrayBuffer, data));
     }
 
+    Local<ArrayBuffer> arrayBuffer = ArrayBuffer::New(isolate, byteLength);
+
+#ifdef USE_ARRAY_BUFFER
+    v8::Local<v8::Object> local;
+    node::Buffer::New(isolate, arrayBuffer, 0, arrayBuffer->ByteLength()).ToLocal(&local);
+    void* data = node::Buffer::Data(local);
+#else
+    void* data = arrayBuffer->GetContents().Data();
+#endif
+
+    return std::unique_ptr<FrameBuffer>(new JsFrameBuffer(arrayBuffer, data));
+}
+
+v8::Local<v8::TypedArray> JsVlcPlayer::createFrameBuffer(
+    const VideoFrame& videoFrame,
+    FrameBuffer* frameBuffer)
+{
+    using namespace v8;
+
     Isolate* isolate = Isolate::GetCurrent();
     Local<Context> context = isolate->GetCurrentContext();
 
-    Local<Object> global = isolate->GetCurrentContext()->Global();
+    JsFrameBuffer* jsFrameBuffer = static_cast<JsFrameBuffer*>(frameBuffer);
+#ifdef USE_BACKING_STORE
+    jsFrameBuffer->wrapStorage(_sharedFrameBuffers);
+#endif
 
-    Local<Value> abv =
-        global->Get(
-            context,
-            String::NewFromUtf8(
-                isolate,
-                "Uint8Array",
-                NewStringType::kInternalized).ToLocalChecked()).ToLocalChecked();
-    Local<Value> argv[] =
-        { Integer::NewFromUnsigned(isolate, videoFrame.size()) };
-    Local<Uint8Array> jsArray =
-        Handle<Uint8Array>::Cast(
-            Handle<Function>::Cast(abv)->NewInstance(context, 1, argv).ToLocalChecked());
+    //RGBA rows are not padded, so frame is exactly width * height * 4 bytes
+    //and could be passed to ImageData constructor without copy (unless it's cropped)
+    const bool clamped = PixelFormat::RGBA == videoFrame.pixelFormat();
 
-    Local<Integer> jsWidth = Integer::New(isolate, videoFrame.width());
-    Local<Integer> jsHeight = Integer::New(isolate, videoFrame.height());
-    Local<Integer> jsPixelFormat = Integer::New(isolate, static_cast<int>(PixelFormat::RV32));
+    //with crop frame starts at visible rect origin, and offsets are relative to it
+    const unsigned frameOffset = videoFrame.planeOffset(0);
+    Local<TypedArray> jsArray =
+        jsFrameBuffer->createView(frameOffset, videoFrame.size() - frameOffset, clamped);
 
     jsArray->DefineOwnProperty(
         context,
         String::NewFromUtf8(isolate, "width", NewStringType::kInternalized).ToLocalChecked(),
-        jsWidth,
+        Integer::New(isolate, videoFrame.width()),
         static_cast<PropertyAttribute>(ReadOnly | DontDelete)).FromJust();
     jsArray->DefineOwnProperty(
         context,
         String::NewFromUtf8(isolate, "height", NewStringType::kInternalized).ToLocalChecked(),
-        jsHeight,
+        Integer::New(isolate, videoFrame.height()),
         static_cast<PropertyAttribute>(ReadOnly | DontDelete)).FromJust();
     jsArray->DefineOwnProperty(
         context,
         String::NewFromUtf8(isolate, "pixelFormat", NewStringType::kInternalized).ToLocalChecked(),
-        jsPixelFormat,
+        Integer::New(isolate, static_cast<int>(videoFrame.pixelFormat())),
+        static_cast<PropertyAttribute>(ReadOnly | DontDelete)).FromJust();
+    jsArray->DefineOwnProperty(
+        context,
+        String::NewFromUtf8(isolate, "fullRange", NewStringType::kInternalized).ToLocalChecked(),
+        Boolean::New(isolate, videoFrame.fullRange()),
         static_cast<PropertyAttribute>(ReadOnly | DontDelete)).FromJust();
 
-    _jsFrameBuffer.Reset(isolate, jsArray);
+    if(2 == videoFrame.planeCount()) {
+        jsArray->DefineOwnProperty(
+            context,
+            String::NewFromUtf8(isolate, "uvOffset", NewStringType::kInternalized).ToLocalChecked(),
+            Integer::New(isolate, videoFrame.planeOffset(1) - frameOffset),
+            static_cast<PropertyAttribute>(ReadOnly | DontDelete)).FromJust();
+    } else if(3 == videoFrame.planeCount()) {
+        jsArray->DefineOwnProperty(
+            context,
+            String::NewFromUtf8(isolate, "uOffset", NewStringType::kInternalized).ToLocalChecked(),
+            Integer::New(isolate, videoFrame.planeOffset(1) - frameOffset),
+            static_cast<PropertyAttribute>(ReadOnly | DontDelete)).FromJust();
+        jsArray->DefineOwnProperty(
+            context,
+            String::NewFromUtf8(isolate, "vOffset", NewStringType::kInternalized).ToLocalChecked(),
+            Integer::New(isolate, videoFrame.planeOffset(2) - frameOffset),
+            static_cast<PropertyAttribute>(ReadOnly | DontDelete)).FromJust();
+    }
 
-    callCallback(CB_FrameSetup, { jsWidth, jsHeight, jsPixelFormat, jsArray });
+    //per plane views, so consumers don't have to slice frame on every frame
+    static const char* twoPlanesNames[] = { "y", "uv" };
+    static const char* threePlanesNames[] = { "y", "u", "v" };
+    const char** planesNames = nullptr;
+    if(2 == videoFrame.planeCount())
+        planesNames = twoPlanesNames;
+    else if(3 == videoFrame.planeCount())
+        planesNames = threePlanesNames;
+
+    Local<Array> jsPlanes = Array::New(isolate, videoFrame.planeCount());
+    Local<Array> jsPitches = Array::New(isolate, videoFrame.planeCount());
+    Local<Array> jsLines = Array::New(isolate, videoFrame.planeCount());
+    for(unsigned p = 0; p < videoFrame.planeCount(); ++p) {
+        //last row of cropped plane could end before pitch
+        Local<TypedArray> jsPlane =
+            jsFrameBuffer->createView(
+                videoFrame.planeOffset(p),
+                std::min(
+                    videoFrame.pitch(p) * videoFrame.lines(p),
+                    videoFrame.size() - videoFrame.planeOffset(p)),
+                clamped);
+
+        jsPlanes->Set(context, p, jsPlane).FromJust();
+        jsPitches->Set(context, p, Integer::NewFromUnsigned(isolate, videoFrame.pitch(p))).FromJust();
+        jsLines->Set(context, p, Integer::NewFromUnsigned(isolate, videoFrame.lines(p))).FromJust();
+
+        if(planesNames) {
+            jsArray->DefineOwnProperty(
+                context,
+                String::NewFromUtf8(isolate, planesNames[p], NewStringType::kInternalized).ToLocalChecked(),
+                jsPlane,
+                static_cast<PropertyAttribute>(ReadOnly | DontDelete)).FromJust();
+        }
+    }
 
-#ifdef USE_ARRAY_BUFFER
-    v8::Local<v8::Object> local;
-    node::Buffer::New(isolate, jsArray->Buffer(), 0, jsArray->Buffer()->ByteLength()).ToLocal(&local);
-    return node::Buffer::Data(local);
-#else
-    return jsArray->GetIndexedPropertiesExternalArrayData();
-#endif
+    jsArray->DefineOwnProperty(
+        context,
+        String::NewFromUtf8(isolate, "planes", NewStringType::kInternalized).ToLocalChecked(),
+        jsPlanes,
+        static_cast<PropertyAttribute>(ReadOnly | DontDelete)).FromJust();
+    jsArray->DefineOwnProperty(
+        context,
+        String::NewFromUtf8(isolate, "pitches", NewStringType::kInternalized).ToLocalChecked(),
+        jsPitches,
+        static_cast<PropertyAttribute>(ReadOnly | DontDelete)).FromJust();
+    jsArray->DefineOwnProperty(
+        context,
+        String::NewFromUtf8(isolate, "lines", NewStringType::kInternalized).ToLocalChecked(),
+        jsLines,
+        static_cast<PropertyAttribute>(ReadOnly | DontDelete)).FromJust();
+
+    return jsArray;
 }
 
-void* JsVlcPlayer::onFrameSetup(const I420VideoFrame& videoFrame)
+bool JsVlcPlayer::onFrameSetup(
+    const VideoFrame& videoFrame,
+    FrameBuffer* const frameBuffers[])
 {
     using namespace v8;
 
     if(0 == videoFrame.width() || 0 == videoFrame.height() ||
-        0 == videoFrame.uPlaneOffset() || 0 == videoFrame.vPlaneOffset() ||
-        0 == videoFrame.size())
+        0 == videoFrame.planeCount() || 0 == videoFrame.size())
     {
         assert(false);
-        return nullptr;
+        return false;
     }
 
     Isolate* isolate = Isolate::GetCurrent();
-    Local<Context> context = isolate->GetCurrentContext();
 
-    Local<Object> global = isolate->GetCurrentContext()->Global();
+    for(unsigned i = 0; i < VideoFrame::BuffersCount; ++i) {
+        Local<TypedArray> jsArray = createFrameBuffer(videoFrame, frameBuffers[i]);
+        _jsFrameBuffers[i].Reset(isolate, jsArray);
+    }
 
-    Local<Value> abv =
-        global->Get(
-            context,
-            String::NewFromUtf8(
-                isolate,
-                "Uint8Array",
-                NewStringType::kInternalized
-            ).ToLocalChecked()
-        ).ToLocalChecked();
-    Local<Value> argv[] =
-        { Integer::NewFromUnsigned(isolate, videoFrame.size()) };
-    Local<Uint8Array> jsArray =
-        Handle<Uint8Array>::Cast(
-            Handle<Function>::Cast(abv)->NewInstance(context, 1, argv).ToLocalChecked());
+    _jsFrameBuffer.Reset(isolate, _jsFrameBuffers[0]);
 
     Local<Integer> jsWidth = Integer::New(isolate, videoFrame.width());
     Local<Integer> jsHeight = Integer::New(isolate, videoFrame.height());
-    Local<Integer> jsPixelFormat = Integer::New(isolate, static_cast<int>(PixelFormat::I420));
+    Local<Integer> jsPixelFormat =
+        Integer::New(isolate, static_cast<int>(videoFrame.pixelFormat()));
 
-    jsArray->DefineOwnProperty(
-        context,
-        String::NewFromUtf8(isolate, "width", NewStringType::kInternalized).ToLocalChecked(),
-        jsWidth,
-        static_cast<PropertyAttribute>(ReadOnly | DontDelete)).FromJust();
-    jsArray->DefineOwnProperty(
+    callCallback(
+        CB_FrameSetup,
+        { jsWidth, jsHeight, jsPixelFormat, Local<Value>::New(isolate, _jsFrameBuffer) });
+
+    return true;
+}
+
+void JsVlcPlayer::updateFrameInfo(const FrameInfo& frameInfo)
+{
+    using namespace v8;
+
+    Isolate* isolate = Isolate::GetCurrent();
+    Local<Context> context = isolate->GetCurrentContext();
+
+    //the same object is updated in place, so it keeps it's shape
+    Local<Object> jsFrameInfo = Local<Object>::New(isolate, _jsFrameInfo);
+    jsFrameInfo->Set(
         context,
-        String::NewFromUtf8(isolate, "height", NewStringType::kInternalized).ToLocalChecked(),
-        jsHeight,
-        static_cast<PropertyAttribute>(ReadOnly | DontDelete)).FromJust();
-    jsArray->DefineOwnProperty(
+        String::NewFromUtf8(isolate, "sequence", NewStringType::kInternalized).ToLocalChecked(),
+        Number::New(isolate, static_cast<double>(frameInfo.sequence))).FromJust();
+    //in milliseconds, on the same clock as process.hrtime()
+    jsFrameInfo->Set(
         context,
-        String::NewFromUtf8(isolate, "pixelFormat", NewStringType::kInternalized).ToLocalChecked(),
-        jsPixelFormat,
-        static_cast<PropertyAttribute>(ReadOnly | DontDelete)).FromJust();
-    jsArray->DefineOwnProperty(
+        String::NewFromUtf8(isolate, "wallclock", NewStringType::kInternalized).ToLocalChecked(),
+        Number::New(isolate, frameInfo.wallclock / 1e6)).FromJust();
+    jsFrameInfo->Set(
         context,
-        String::NewFromUtf8(isolate, "uOffset", NewStringType::kInternalized).ToLocalChecked(),
-        Integer::New(isolate, videoFrame.uPlaneOffset()),
-        static_cast<PropertyAttribute>(ReadOnly | DontDelete)).FromJust();
-    jsArray->DefineOwnProperty(
+        String::NewFromUtf8(isolate, "mediaTime", NewStringType::kInternalized).ToLocalChecked(),
+        Number::New(isolate, static_cast<double>(frameInfo.mediaTime))).FromJust();
+    jsFrameInfo->Set(
         context,
-        String::NewFromUtf8(isolate, "vOffset", NewStringType::kInternalized).ToLocalChecked(),
-        Integer::New(isolate, videoFrame.vPlaneOffset()),
-        static_cast<PropertyAttribute>(ReadOnly | DontDelete)).FromJust();
+        String::NewFromUtf8(isolate, "skippedFrames", NewStringType::kInternalized).ToLocalChecked(),
+        Number::New(isolate, static_cast<double>(frameInfo.skippedFrames))).FromJust();
+}
 
-    _jsFrameBuffer.Reset(isolate, jsArray);
+void JsVlcPlayer::updateFrameStats(const FrameInfo& frameInfo, const FrameStats& frameStats)
+{
+    if(!_frameStats)
+        return;
 
-    callCallback(CB_FrameSetup, { jsWidth, jsHeight, jsPixelFormat, jsArray });
+    _frameStats[FST_Sequence] = static_cast<double>(frameInfo.sequence);
+    _frameStats[FST_LumaMin] = frameStats.lumaMin;
+    _frameStats[FST_LumaMax] = frameStats.lumaMax;
+    _frameStats[FST_LumaMean] = frameStats.lumaMean;
+    _frameStats[FST_AverageR] = frameStats.averageRgb[0];
+    _frameStats[FST_AverageG] = frameStats.averageRgb[1];
+    _frameStats[FST_AverageB] = frameStats.averageRgb[2];
+    _frameStats[FST_RgbHistograms] = frameStats.rgb ? 1 : 0;
+
+    double* histograms = _frameStats + FST_Histograms;
+    for(unsigned c = 0; c < FrameStats::Channels; ++c) {
+        for(unsigned v = 0; v < 256; ++v)
+            *histograms++ = frameStats.histograms[c][v];
+    }
+}
 
-#ifdef USE_ARRAY_BUFFER
-    v8::Local<v8::Object> local;
-    node::Buffer::New(isolate, jsArray->Buffer(), 0, jsArray->Buffer()->ByteLength()).ToLocal(&local);
-    return node::Buffer::Data(local);
-#else
-    return jsArray->GetIndexedPropertiesExternalArrayData();
-#endif
+void JsVlcPlayer::onFrameReady(unsigned bufferIndex, const FrameInfo& frameInfo)
+{
+    using namespace v8;
+
+    Isolate* isolate = Isolate::GetCurrent();
+
+    publishFrame(bufferIndex, frameInfo);
+
+    callCallback(
+        CB_FrameReady,
+        { Local<Value>::New(isolate, _jsFrameBuffer), Local<Object>::New(isolate, _jsFrameInfo) });
+
+    notifyFrameSubscribers(bufferIndex, frameInfo);
+}
+
+void JsVlcPlayer::publishFrame(unsigned bufferIndex, const FrameInfo& frameInfo)
+{
+    using namespace v8;
+
+    Isolate* isolate = Isolate::GetCurrent();
+
+    assert(bufferIndex < VideoFrame::BuffersCount);
+    assert(!_jsFrameBuffers[bufferIndex].IsEmpty()); //FIXME! maybe it worth add condition here
+
+    _jsFrameBuffer.Reset(isolate, _jsFrameBuffers[bufferIndex]);
+
+    if(_frameSync) {
+        Local<Int32Array> jsFrameSync = Local<Int32Array>::New(isolate, _jsFrameSync);
+        //FS_BufferIndex is already updated by VlcVideoOutput
+        _frameSync[FS_Sequence].fetch_add(1);
+
+        Local<Function> atomicsNotify = Local<Function>::New(isolate, _jsAtomicsNotify);
+        Local<Value> argv[] = {
+            jsFrameSync,
+            Integer::New(isolate, FS_Sequence),
+        };
+        atomicsNotify->Call(
+            isolate->GetCurrentContext(),
+            Undefined(isolate),
+            sizeof(argv) / sizeof(argv[0]), argv).ToLocalChecked();
+    }
+
+    updateFrameInfo(frameInfo);
+
+    if(const FrameStats* frameStats = VlcVideoOutput::frameStats(bufferIndex))
+        updateFrameStats(frameInfo, *frameStats);
+}
+
+bool JsVlcPlayer::pullMode()
+{
+    return VlcVideoOutput::pullDelivery();
+}
+
+void JsVlcPlayer::setPullMode(bool pullMode)
+{
+    VlcVideoOutput::setPullDelivery(pullMode);
 }
 
-void JsVlcPlayer::onFrameReady()
+v8::Local<v8::Value> JsVlcPlayer::acquireLatestFrame()
 {
     using namespace v8;
 
     Isolate* isolate = Isolate::GetCurrent();
     Local<Context> context = isolate->GetCurrentContext();
 
-    assert(!_jsFrameBuffer.IsEmpty()); //FIXME! maybe it worth add condition here
-    callCallback(CB_FrameReady, { Local<Value>::New(Isolate::GetCurrent(), _jsFrameBuffer) });
+    FrameInfo frameInfo;
+    const int bufferIndex = VlcVideoOutput::acquireLatestFrame(&frameInfo);
+    if(bufferIndex < 0)
+        return Null(isolate);
+
+    publishFrame(static_cast<unsigned>(bufferIndex), frameInfo);
+
+    Local<Object> jsLatestFrame = Object::New(isolate);
+    jsLatestFrame->Set(
+        context,
+        String::NewFromUtf8(isolate, "frame", NewStringType::kInternalized).ToLocalChecked(),
+        Local<Value>::New(isolate, _jsFrameBuffer)).FromJust();
+    jsLatestFrame->Set(
+        context,
+        String::NewFromUtf8(isolate, "sequence", NewStringType::kInternalized).ToLocalChecked(),
+        Number::New(isolate, static_cast<double>(frameInfo.sequence))).FromJust();
+
+    return jsLatestFrame;
 }
 
-void JsVlcPlayer::onFrameCleanup()
+bool JsVlcPlayer::releaseLatestFrame()
 {
-    callCallback(CB_FrameCleanup);
+    return VlcVideoOutput::releaseLatestFrame();
 }
 
-void JsVlcPlayer::handleLibvlcEvent(const libvlc_event_t& libvlcEvent)
+double JsVlcPlayer::replayBudget()
+{
+    return static_cast<double>(VlcVideoOutput::replayBudget());
+}
+
+void JsVlcPlayer::setReplayBudget(double budget)
+{
+    VlcVideoOutput::setReplayBudget(
+        budget > 0 ?
+            static_cast<size_t>(std::min(budget, static_cast<double>(SIZE_MAX))) :
+            0);
+}
+
+unsigned JsVlcPlayer::replayLength()
+{
+    return VlcVideoOutput::replayFramesCount();
+}
+
+v8::Local<v8::Value> JsVlcPlayer::replayFrameInfo(unsigned index)
 {
     using namespace v8;
 
     Isolate* isolate = Isolate::GetCurrent();
     Local<Context> context = isolate->GetCurrentContext();
 
-    Callbacks_e callback = CB_Max;
+    FrameInfo frameInfo;
+    if(!VlcVideoOutput::replayFrameInfo(index, &frameInfo))
+        return Null(isolate);
 
-    switch(libvlcEvent.type) {
-        case libvlc_MediaPlayerMediaChanged:
-            callback = CB_MediaPlayerMediaChanged;
-            break;
-        case libvlc_MediaPlayerNothingSpecial:
-            callback = CB_MediaPlayerNothingSpecial;
-            break;
-        case libvlc_MediaPlayerOpening:
-            callback = CB_MediaPlayerOpening;
-            break;
-        case libvlc_MediaPlayerBuffering: {
-            callCallback(
-                CB_MediaPlayerBuffering,
-                { Number::New(
-                    isolate,
-                    libvlcEvent.u.media_player_buffering.new_cache)
-                });
-            break;
+    Local<Object> jsFrameInfo = Object::New(isolate);
+    jsFrameInfo->Set(
+        context,
+        String::NewFromUtf8(isolate, "sequence", NewStringType::kInternalized).ToLocalChecked(),
+        Number::New(isolate, static_cast<double>(frameInfo.sequence))).FromJust();
+    jsFrameInfo->Set(
+        context,
+        String::NewFromUtf8(isolate, "mediaTime", NewStringType::kInternalized).ToLocalChecked(),
+        Number::New(isolate, static_cast<double>(frameInfo.mediaTime))).FromJust();
+
+    return jsFrameInfo;
+}
+
+bool JsVlcPlayer::showReplayFrame(unsigned index)
+{
+    return VlcVideoOutput::showReplayFrame(index);
+}
+
+int JsVlcPlayer::showReplayFrameAt(double time)
+{
+    const int index = VlcVideoOutput::replayFrameIndex(static_cast<int64_t>(time));
+    if(index < 0 || !VlcVideoOutput::showReplayFrame(static_cast<unsigned>(index)))
+        return -1;
+
+    return index;
+}
+
+int JsVlcPlayer::subscribeFrames(
+    const v8::Local<v8::Value>& callback,
+    const v8::Local<v8::Value>& options)
+{
+    using namespace v8;
+
+    Isolate* isolate = Isolate::GetCurrent();
+
+    if(!callback->IsFunction())
+        return -1;
+
+    std::unique_ptr<FrameSubscriber> subscriber(new FrameSubscriber);
+    subscriber->converted = false;
+    subscriber->variant = { 0, 0, PixelFormat::RV32 };
+
+    Local<Value> width = GetProperty(options, "width");
+    if(width->IsUint32()) {
+        subscriber->variant.width = FromJsValue<unsigned>(width);
+        subscriber->converted = true;
+    }
+
+    Local<Value> height = GetProperty(options, "height");
+    if(height->IsUint32()) {
+        subscriber->variant.height = FromJsValue<unsigned>(height);
+        subscriber->converted = true;
+    }
+
+    Local<Value> pixelFormat = GetProperty(options, "pixelFormat");
+    if(pixelFormat->IsUint32()) {
+        switch(FromJsValue<unsigned>(pixelFormat)) {
+            case static_cast<unsigned>(PixelFormat::RV32):
+                subscriber->variant.pixelFormat = PixelFormat::RV32;
+                break;
+            case static_cast<unsigned>(PixelFormat::I420):
+                subscriber->variant.pixelFormat = PixelFormat::I420;
+                break;
+            default:
+                return -1;
         }
-        case libvlc_MediaPlayerPlaying:
-            callback = CB_MediaPlayerPlaying;
-            break;
-        case libvlc_MediaPlayerPaused:
+        subscriber->converted = true;
+    }
+
+    subscriber->id = ++_lastFrameSubscriberId;
+    subscriber->callback.Reset(isolate, Local<Function>::Cast(callback));
+
+    const unsigned id = subscriber->id;
+    _frameSubscribers.push_back(std::move(subscriber));
+
+    updateFrameVariants();
+
+    return static_cast<int>(id);
+}
+
+bool JsVlcPlayer::unsubscribeFrames(unsigned id)
+{
+    auto it = std::find_if(
+        _frameSubscribers.begin(), _frameSubscribers.end(),
+        [id] (const std::unique_ptr<FrameSubscriber>& subscriber) { return subscriber->id == id; });
+    if(it == _frameSubscribers.end())
+        return false;
+
+    _frameSubscribers.erase(it);
+
+    updateFrameVariants();
+
+    return true;
+}
+
+void JsVlcPlayer::updateFrameVariants()
+{
+    std::vector<FrameVariant> frameVariants;
+    for(const auto& subscriber: _frameSubscribers) {
+        if(subscriber->converted)
+            frameVariants.push_back(subscriber->variant);
+    }
+
+    VlcVideoOutput::setFrameVariants(frameVariants);
+
+    //frames of variants nobody is subscribed to anymore
+    _jsVariantFrames.erase(
+        std::remove_if(
+            _jsVariantFrames.begin(), _jsVariantFrames.end(),
+            [&] (const std::unique_ptr<JsVariantFrame>& jsVariantFrame) {
+                return
+                    std::find(frameVariants.begin(), frameVariants.end(), jsVariantFrame->variant) ==
+                    frameVariants.end();
+            }),
+        _jsVariantFrames.end());
+}
+
+void JsVlcPlayer::notifyFrameSubscribers(unsigned bufferIndex, const FrameInfo& frameInfo)
+{
+    using namespace v8;
+
+    if(_frameSubscribers.empty())
+        return;
+
+    Isolate* isolate = Isolate::GetCurrent();
+    Local<Context> context = isolate->GetCurrentContext();
+
+    const std::vector<std::shared_ptr<const VariantFrame> >* variantFrames =
+        VlcVideoOutput::frameVariants(bufferIndex);
+
+    //callbacks could change subscriptions, so collect them first
+    std::vector<std::pair<Local<Function>, Local<Value> > > calls;
+    for(const auto& subscriber: _frameSubscribers) {
+        Local<Value> jsFrame;
+        if(!subscriber->converted) {
+            jsFrame = Local<Value>::New(isolate, _jsFrameBuffer);
+        } else if(variantFrames) {
+            for(const auto& variantFrame: *variantFrames) {
+                if(variantFrame->variant == subscriber->variant) {
+                    jsFrame = variantJsFrame(*variantFrame, frameInfo.sequence);
+                    break;
+                }
+            }
+        }
+
+        //frame could be decoded before subscription
+        if(jsFrame.IsEmpty())
+            continue;
+
+        calls.emplace_back(Local<Function>::New(isolate, subscriber->callback), jsFrame);
+    }
+
+    Local<Object> jsFrameInfo = Local<Object>::New(isolate, _jsFrameInfo);
+    for(const auto& call: calls) {
+        Local<Value> argv[] = { call.second, jsFrameInfo };
+        call.first->Call(
+            context,
+            handle(),
+            sizeof(argv) / sizeof(argv[0]), argv).ToLocalChecked();
+    }
+}
+
+v8::Local<v8::Uint8Array> JsVlcPlayer::variantJsFrame(
+    const VariantFrame& variantFrame,
+    uint64_t sequence)
+{
+    using namespace v8;
+
+    Isolate* isolate = Isolate::GetCurrent();
+    Local<Context> context = isolate->GetCurrentContext();
+
+    auto it = std::find_if(
+        _jsVariantFrames.begin(), _jsVariantFrames.end(),
+        [&] (const std::unique_ptr<JsVariantFrame>& jsVariantFrame) {
+            return jsVariantFrame->variant == variantFrame.variant;
+        });
+    if(it == _jsVariantFrames.end()) {
+        std::unique_ptr<JsVariantFrame> jsVariantFrame(new JsVariantFrame);
+        jsVariantFrame->variant = variantFrame.variant;
+        jsVariantFrame->width = 0;
+        jsVariantFrame->height = 0;
+        jsVariantFrame->sequence = 0;
+        jsVariantFrame->data = nullptr;
+        it = _jsVariantFrames.insert(_jsVariantFrames.end(), std::move(jsVariantFrame));
+    }
+
+    JsVariantFrame& jsVariantFrame = **it;
+
+    //array is reused while frame size doesn't change, like frame buffers
+    if(jsVariantFrame.jsFrame.IsEmpty() ||
+       jsVariantFrame.width != variantFrame.width ||
+       jsVariantFrame.height != variantFrame.height)
+    {
+        const unsigned width = variantFrame.width;
+        const unsigned height = variantFrame.height;
+        const size_t size = variantFrame.data.size();
+
+        Local<ArrayBuffer> arrayBuffer = ArrayBuffer::New(isolate, size);
+        Local<Uint8Array> jsFrame = Uint8Array::New(arrayBuffer, 0, size);
+
+        auto defineProperty = [&] (const char* name, Local<Value> value) {
+            jsFrame->DefineOwnProperty(
+                context,
+                String::NewFromUtf8(isolate, name, NewStringType::kInternalized).ToLocalChecked(),
+                value,
+                static_cast<PropertyAttribute>(ReadOnly | DontDelete)).FromJust();
+        };
+
+        defineProperty("width", Integer::NewFromUnsigned(isolate, width));
+        defineProperty("height", Integer::NewFromUnsigned(isolate, height));
+        defineProperty("pixelFormat", Integer::New(isolate, static_cast<int>(variantFrame.variant.pixelFormat)));
+
+        if(PixelFormat::I420 == variantFrame.variant.pixelFormat) {
+            const size_t ySize = static_cast<size_t>(width) * height;
+            const size_t uvSize = static_cast<size_t>((width + 1) / 2) * ((height + 1) / 2);
+            defineProperty("uOffset", Integer::NewFromUnsigned(isolate, static_cast<unsigned>(ySize)));
+            defineProperty("vOffset", Integer::NewFromUnsigned(isolate, static_cast<unsigned>(ySize + uvSize)));
+            defineProperty("y", Uint8Array::New(arrayBuffer, 0, ySize));
+            defineProperty("u", Uint8Array::New(arrayBuffer, ySize, uvSize));
+            defineProperty("v", Uint8Array::New(arrayBuffer, ySize + uvSize, uvSize));
+        }
+
+        jsVariantFrame.jsFrame.Reset(isolate, jsFrame);
+        jsVariantFrame.width = width;
+        jsVariantFrame.height = height;
+        jsVariantFrame.sequence = 0;
+#ifdef USE_BACKING_STORE
+        jsVariantFrame.data = static_cast<uint8_t*>(arrayBuffer->GetBackingStore()->Data());
+#else
+        jsVariantFrame.data = static_cast<uint8_t*>(arrayBuffer->GetContents().Data());
+#endif
+    }
+
+    //subscribers of the same variant share one copy
+    if(jsVariantFrame.sequence != sequence) {
+        memcpy(jsVariantFrame.data, variantFrame.data.data(), variantFrame.data.size());
+        jsVariantFrame.sequence = sequence;
+    }
+
+    return Local<Uint8Array>::New(isolate, jsVariantFrame.jsFrame);
+}
+
+void JsVlcPlayer::onFrameCleanup()
+{
+    callCallback(CB_FrameCleanup);
+}
+
+void JsVlcPlayer::onSceneChange(const SceneChange& sceneChange)
+{
+    using namespace v8;
+
+    Isolate* isolate = Isolate::GetCurrent();
+
+    callCallback(
+        CB_SceneChange,
+        {
+            Number::New(isolate, static_cast<double>(sceneChange.mediaTime)),
+            Number::New(isolate, sceneChange.score),
+        });
+}
+
+void JsVlcPlayer::onAdaptiveScaleRequest(double /*scale*/)
+{
+    restartVideoOutput();
+}
+
+void JsVlcPlayer::onAdaptiveScaleChange(double scale)
+{
+    using namespace v8;
+
+    Isolate* isolate = Isolate::GetCurrent();
+
+    callCallback(CB_AdaptiveScaleChange, { Number::New(isolate, scale) });
+}
+
+void JsVlcPlayer::handleLibvlcEvent(const libvlc_event_t& libvlcEvent)
+{
+    using namespace v8;
+
+    Isolate* isolate = Isolate::GetCurrent();
+    Local<Context> context = isolate->GetCurrentContext();
+
+    Callbacks_e callback = CB_Max;
+
+    if(_restartingVideoOutput) {
+        switch(libvlcEvent.type) {
+            case libvlc_MediaPlayerPlaying:
+                if(player().current_item() == _restartItem) {
+                    finishVideoOutputRestart();
+                    return;
+                }
+                cancelVideoOutputRestart();
+                break;
+            case libvlc_MediaPlayerEndReached:
+            case libvlc_MediaPlayerEncounteredError:
+                cancelVideoOutputRestart();
+                break;
+            case libvlc_MediaPlayerMediaChanged:
+            case libvlc_MediaPlayerNothingSpecial:
+            case libvlc_MediaPlayerOpening:
+            case libvlc_MediaPlayerBuffering:
+            case libvlc_MediaPlayerStopped:
+            case libvlc_MediaPlayerTimeChanged:
+            case libvlc_MediaPlayerPositionChanged:
+                //stop and start of the same item is not visible to application,
+                //time is reported again after it's restored
+                return;
+            default:
+                break;
+        }
+    }
+
+    switch(libvlcEvent.type) {
+        case libvlc_MediaPlayerMediaChanged:
+            applyItemProcessMode(player().current_item());
+            callback = CB_MediaPlayerMediaChanged;
+            break;
+        case libvlc_MediaPlayerNothingSpecial:
+            callback = CB_MediaPlayerNothingSpecial;
+            break;
+        case libvlc_MediaPlayerOpening:
+            callback = CB_MediaPlayerOpening;
+            break;
+        case libvlc_MediaPlayerBuffering: {
+            callCallback(
+                CB_MediaPlayerBuffering,
+                { Number::New(
+                    isolate,
+                    libvlcEvent.u.media_player_buffering.new_cache)
+                });
+            break;
+        }
+        case libvlc_MediaPlayerPlaying:
+            //input frame rate is known only after media is opened
+            if(_rawRecorder)
+                _rawRecorder->setFrameRate(player().playback().get_fps());
+            callback = CB_MediaPlayerPlaying;
+            break;
+        case libvlc_MediaPlayerPaused:
             callback = CB_MediaPlayerPaused;
             break;
         case libvlc_MediaPlayerStopped:
@@ -818,7 +1584,84 @@ void JsVlcPlayer::handleLibvlcEvent(const libvlc_event_t& libvlcEvent)
 void JsVlcPlayer::currentItemEndReached()
 {
     if(vlc::mode_single != player().get_playback_mode())
-        player().next();
+        next();
+}
+
+bool JsVlcPlayer::isProcessModeItem(int idx)
+{
+    if(idx < 0)
+        return false;
+
+    vlc::player& p = player();
+    for(const vlc::media& media: _processModeMedia) {
+        if(p.find_media_index(media) == idx)
+            return true;
+    }
+
+    return false;
+}
+
+void JsVlcPlayer::applyItemProcessMode(int idx)
+{
+    const bool processModeItem = isProcessModeItem(idx);
+    if(processModeItem != VlcVideoOutput::frameBackpressure())
+        VlcVideoOutput::setFrameBackpressure(processModeItem);
+}
+
+void JsVlcPlayer::restartVideoOutput()
+{
+    vlc::player& p = player();
+
+    if(!p.video().has_vout())
+        return;
+
+    const int item = p.current_item();
+    if(item < 0)
+        return;
+
+    //libvlc 3 recycles video output on track reselection
+    //and skips it's reinit for similar source format,
+    //so video_format_cb is guaranteed to be called only for new input
+    if(!_restartingVideoOutput) {
+        _restartTime = p.playback().get_time();
+        _restartPaused = libvlc_Paused == p.get_state();
+    }
+    _restartingVideoOutput = true;
+    _restartItem = item;
+
+    //stop waits for decode thread
+    VlcVideoOutput::cancelFrameWait();
+    p.stop();
+    const bool started = p.play(item);
+    VlcVideoOutput::resumeFrameWait();
+
+    if(!started)
+        cancelVideoOutputRestart();
+}
+
+void JsVlcPlayer::finishVideoOutputRestart()
+{
+    vlc::player& p = player();
+
+    const int64_t restartTime = _restartTime;
+    const bool restartPaused = _restartPaused;
+
+    cancelVideoOutputRestart();
+
+    //non seekable media (like live streams) just continues from current point
+    if(restartTime > 0 && libvlc_media_player_is_seekable(p.get_mp()))
+        p.playback().set_time(restartTime);
+
+    if(restartPaused)
+        p.pause();
+}
+
+void JsVlcPlayer::cancelVideoOutputRestart()
+{
+    _restartingVideoOutput = false;
+    _restartItem = -1;
+    _restartTime = -1;
+    _restartPaused = false;
 }
 
 void JsVlcPlayer::callCallback(
@@ -946,6 +1789,49 @@ v8::Local<v8::Value> JsVlcPlayer::getVideoFrame()
     return v8::Local<v8::Value>::New(v8::Isolate::GetCurrent(), _jsFrameBuffer);
 }
 
+v8::Local<v8::Value> JsVlcPlayer::getFrameBuffers()
+{
+    using namespace v8;
+
+    Isolate* isolate = Isolate::GetCurrent();
+    Local<Context> context = isolate->GetCurrentContext();
+
+    if(_jsFrameBuffers[0].IsEmpty())
+        return Undefined(isolate);
+
+    Local<Array> jsFrameBuffers = Array::New(isolate, VideoFrame::BuffersCount);
+    for(unsigned i = 0; i < VideoFrame::BuffersCount; ++i) {
+        jsFrameBuffers->Set(
+            context, i,
+            Local<Value>::New(isolate, _jsFrameBuffers[i])).FromJust();
+    }
+
+    return jsFrameBuffers;
+}
+
+v8::Local<v8::Object> JsVlcPlayer::getFrameInfo()
+{
+    return v8::Local<v8::Object>::New(v8::Isolate::GetCurrent(), _jsFrameInfo);
+}
+
+v8::Local<v8::Value> JsVlcPlayer::getFrameSync()
+{
+    using namespace v8;
+
+    Isolate* isolate = Isolate::GetCurrent();
+
+    if(_jsFrameSync.IsEmpty())
+        return Undefined(isolate);
+
+    return Local<Int32Array>::New(isolate, _jsFrameSync);
+}
+
+v8::Local<v8::Value> JsVlcPlayer::getNativeHandle()
+{
+    //handle for wcjs_add_frame_consumer
+    return v8::External::New(v8::Isolate::GetCurrent(), static_cast<VlcVideoOutput*>(this));
+}
+
 v8::Local<v8::Object> JsVlcPlayer::getEventEmitter()
 {
     return v8::Local<v8::Object>::New(v8::Isolate::GetCurrent(), _jsEventEmitter);
@@ -960,82 +1846,1013 @@ void JsVlcPlayer::setPixelFormat(unsigned format)
 {
     switch(format) {
         case static_cast<unsigned>(PixelFormat::RV32):
-            VlcVideoOutput::setPixelFormat(PixelFormat::RV32);
-            break;
         case static_cast<unsigned>(PixelFormat::I420):
-            VlcVideoOutput::setPixelFormat(PixelFormat::I420);
+        case static_cast<unsigned>(PixelFormat::NV12):
+        case static_cast<unsigned>(PixelFormat::I422):
+        case static_cast<unsigned>(PixelFormat::I444):
+        case static_cast<unsigned>(PixelFormat::YUY2):
+        case static_cast<unsigned>(PixelFormat::RV16):
+        case static_cast<unsigned>(PixelFormat::RGBA):
+        case static_cast<unsigned>(PixelFormat::Native):
+            VlcVideoOutput::setPixelFormat(static_cast<PixelFormat>(format));
             break;
     }
 }
 
-double JsVlcPlayer::position()
+bool JsVlcPlayer::processMode()
 {
-    return player().playback().get_position();
+    return _processMode;
 }
 
-void JsVlcPlayer::setPosition(double position)
+void JsVlcPlayer::setProcessMode(bool processMode)
 {
-    player().playback().set_position(static_cast<float>(position));
+    _processMode = processMode;
 }
 
-double JsVlcPlayer::time()
+bool JsVlcPlayer::audioOnly()
 {
-    return static_cast<double>(player().playback().get_time());
+    return _audioOnly;
 }
 
-void JsVlcPlayer::setTime(double time)
+double JsVlcPlayer::maxFps()
 {
-    player().playback().set_time(static_cast<libvlc_time_t>(time));
+    return VlcVideoOutput::maxFps();
 }
 
-unsigned JsVlcPlayer::volume()
+void JsVlcPlayer::setMaxFps(double maxFps)
 {
-    return player().audio().get_volume();
+    VlcVideoOutput::setMaxFps(maxFps);
 }
 
-void JsVlcPlayer::setVolume(unsigned volume)
+double JsVlcPlayer::cadenceFps()
 {
-    player().audio().set_volume(volume);
+    return VlcVideoOutput::cadenceFps();
 }
 
-bool JsVlcPlayer::muted()
+void JsVlcPlayer::setCadenceFps(double cadenceFps)
 {
-    return player().audio().is_muted();
+    VlcVideoOutput::setCadenceFps(cadenceFps);
 }
 
-void JsVlcPlayer::setMuted(bool mute)
+double JsVlcPlayer::deliveredFps()
 {
-    player().audio().set_mute(mute);
+    return VlcVideoOutput::deliveredFps();
 }
 
-void JsVlcPlayer::play()
+double JsVlcPlayer::timeToFirstFrame()
 {
-    player().play();
+    return VlcVideoOutput::timeToFirstFrame();
 }
 
-void JsVlcPlayer::play(const std::string& mrl)
+bool JsVlcPlayer::adaptiveScaling()
 {
-    vlc::player& p = player();
+    return VlcVideoOutput::adaptiveScaling();
+}
 
-    p.clear_items();
-    const int idx = p.add_media(mrl.c_str());
-    if(idx >= 0)
-        p.play(idx);
+void JsVlcPlayer::setAdaptiveScaling(bool adaptiveScaling)
+{
+    VlcVideoOutput::setAdaptiveScaling(adaptiveScaling);
 }
 
-void JsVlcPlayer::pause()
+double JsVlcPlayer::adaptiveScale()
 {
-    player().pause();
+    return VlcVideoOutput::adaptiveScale();
 }
 
-void JsVlcPlayer::togglePause()
+double JsVlcPlayer::sceneChangeThreshold()
 {
-    player().togglePause();
+    return VlcVideoOutput::sceneChangeThreshold();
 }
 
-void JsVlcPlayer::stop()
+void JsVlcPlayer::setSceneChangeThreshold(double threshold)
 {
-    player().stop();
+    VlcVideoOutput::setSceneChangeThreshold(std::max(0., std::min(threshold, 1.)));
+}
+
+unsigned JsVlcPlayer::frameStatsInterval()
+{
+    return VlcVideoOutput::frameStatsInterval();
+}
+
+void JsVlcPlayer::setFrameStatsInterval(unsigned interval)
+{
+    using namespace v8;
+
+    //array is kept once allocated, so JS side could hold reference to it
+    if(interval && _jsFrameStats.IsEmpty()) {
+        Isolate* isolate = Isolate::GetCurrent();
+
+        Local<ArrayBuffer> statsBuffer =
+            ArrayBuffer::New(isolate, FST_Max * sizeof(double));
+        Local<Float64Array> jsFrameStats = Float64Array::New(statsBuffer, 0, FST_Max);
+        _jsFrameStats.Reset(isolate, jsFrameStats);
+
+#ifdef USE_BACKING_STORE
+        _frameStats = static_cast<double*>(statsBuffer->GetBackingStore()->Data());
+#else
+        _frameStats = static_cast<double*>(statsBuffer->GetContents().Data());
+#endif
+    }
+
+    VlcVideoOutput::setFrameStatsInterval(interval);
+}
+
+v8::Local<v8::Value> JsVlcPlayer::getFrameStats()
+{
+    using namespace v8;
+
+    Isolate* isolate = Isolate::GetCurrent();
+
+    if(_jsFrameStats.IsEmpty())
+        return Undefined(isolate);
+
+    return Local<Float64Array>::New(isolate, _jsFrameStats);
+}
+
+bool JsVlcPlayer::suppressDuplicateFrames()
+{
+    return VlcVideoOutput::suppressDuplicateFrames();
+}
+
+void JsVlcPlayer::setSuppressDuplicateFrames(bool suppress)
+{
+    VlcVideoOutput::setSuppressDuplicateFrames(suppress);
+}
+
+double JsVlcPlayer::duplicateFramesSuppressed()
+{
+    return static_cast<double>(VlcVideoOutput::duplicateFramesSuppressed());
+}
+
+double JsVlcPlayer::droppedFrames()
+{
+    return static_cast<double>(VlcVideoOutput::droppedFrames());
+}
+
+unsigned JsVlcPlayer::strideAlignment()
+{
+    return VlcVideoOutput::strideAlignment();
+}
+
+void JsVlcPlayer::setStrideAlignment(unsigned alignment)
+{
+    VlcVideoOutput::setStrideAlignment(alignment);
+}
+
+bool JsVlcPlayer::sharedFrameBuffers()
+{
+    return _sharedFrameBuffers;
+}
+
+void JsVlcPlayer::setSharedFrameBuffers(bool shared)
+{
+    using namespace v8;
+
+    if(shared == _sharedFrameBuffers)
+        return;
+
+    Isolate* isolate = Isolate::GetCurrent();
+    Local<Context> context = isolate->GetCurrentContext();
+
+    _sharedFrameBuffers = shared;
+
+    //pooled buffers have wrong type now,
+    //new ones will be allocated on next video format setup
+    VlcVideoOutput::clearFrameBuffersPool();
+
+    if(!shared) {
+        VlcVideoOutput::setBufferSync(nullptr, nullptr);
+        _frameSync = nullptr;
+        _jsFrameSync.Reset();
+        _jsAtomicsNotify.Reset();
+        return;
+    }
+
+    Local<Object> atomics =
+        Local<Object>::Cast(
+            context->Global()->Get(
+                context,
+                String::NewFromUtf8(isolate, "Atomics", NewStringType::kInternalized).ToLocalChecked()
+            ).ToLocalChecked());
+    Local<Function> atomicsNotify =
+        Local<Function>::Cast(
+            atomics->Get(
+                context,
+                String::NewFromUtf8(isolate, "notify", NewStringType::kInternalized).ToLocalChecked()
+            ).ToLocalChecked());
+    _jsAtomicsNotify.Reset(isolate, atomicsNotify);
+
+    Local<SharedArrayBuffer> syncBuffer =
+        SharedArrayBuffer::New(isolate, FS_Max * sizeof(int32_t));
+    Local<Int32Array> jsFrameSync = Int32Array::New(syncBuffer, 0, FS_Max);
+    _jsFrameSync.Reset(isolate, jsFrameSync);
+
+#ifdef USE_BACKING_STORE
+    void* syncData = syncBuffer->GetBackingStore()->Data();
+#else
+    void* syncData = syncBuffer->GetContents().Data();
+#endif
+    //JS side accesses it with Atomics too
+    static_assert(sizeof(std::atomic<int32_t>) == sizeof(int32_t), "");
+    _frameSync = static_cast<std::atomic<int32_t>*>(syncData);
+    _frameSync[FS_Sequence].store(0);
+    _frameSync[FS_BufferIndex].store(-1);
+    _frameSync[FS_ReaderBufferIndex].store(-1);
+
+    VlcVideoOutput::setBufferSync(
+        &_frameSync[FS_BufferIndex],
+        &_frameSync[FS_ReaderBufferIndex]);
+}
+
+void JsVlcPlayer::preallocateFrameBuffers(unsigned width, unsigned height)
+{
+    VlcVideoOutput::preallocateFrameBuffers(width, height);
+}
+
+v8::Local<v8::Value> JsVlcPlayer::videoOutputSize()
+{
+    using namespace v8;
+
+    Isolate* isolate = Isolate::GetCurrent();
+    Local<Context> context = isolate->GetCurrentContext();
+
+    const OutputSize outputSize = VlcVideoOutput::outputSize();
+    if(0 == outputSize.width && 0 == outputSize.height)
+        return Null(isolate);
+
+    const char* mode;
+    switch(outputSize.mode) {
+        case ScaleMode::Fill:
+            mode = "fill";
+            break;
+        case ScaleMode::Exact:
+            mode = "exact";
+            break;
+        case ScaleMode::Fit:
+        default:
+            mode = "fit";
+            break;
+    }
+
+    Local<Object> jsOutputSize = Object::New(isolate);
+    jsOutputSize->Set(
+        context,
+        String::NewFromUtf8(isolate, "width", NewStringType::kInternalized).ToLocalChecked(),
+        Integer::NewFromUnsigned(isolate, outputSize.width)).FromJust();
+    jsOutputSize->Set(
+        context,
+        String::NewFromUtf8(isolate, "height", NewStringType::kInternalized).ToLocalChecked(),
+        Integer::NewFromUnsigned(isolate, outputSize.height)).FromJust();
+    jsOutputSize->Set(
+        context,
+        String::NewFromUtf8(isolate, "mode", NewStringType::kInternalized).ToLocalChecked(),
+        String::NewFromUtf8(isolate, mode, NewStringType::kInternalized).ToLocalChecked()).FromJust();
+
+    return jsOutputSize;
+}
+
+void JsVlcPlayer::setVideoOutputSize(const v8::Local<v8::Value>& value)
+{
+    using namespace v8;
+
+    OutputSize outputSize = { 0, 0, ScaleMode::Fit };
+
+    Local<Value> width = GetProperty(value, "width");
+    if(width->IsUint32())
+        outputSize.width = FromJsValue<unsigned>(width);
+
+    Local<Value> height = GetProperty(value, "height");
+    if(height->IsUint32())
+        outputSize.height = FromJsValue<unsigned>(height);
+
+    Local<Value> mode = GetProperty(value, "mode");
+    if(mode->IsString()) {
+        const std::string modeName = FromJsValue<std::string>(mode);
+        if("fill" == modeName)
+            outputSize.mode = ScaleMode::Fill;
+        else if("exact" == modeName)
+            outputSize.mode = ScaleMode::Exact;
+    }
+
+    const OutputSize currentOutputSize = VlcVideoOutput::outputSize();
+    if(outputSize.width == currentOutputSize.width &&
+       outputSize.height == currentOutputSize.height &&
+       outputSize.mode == currentOutputSize.mode)
+    {
+        return;
+    }
+
+    VlcVideoOutput::setOutputSize(outputSize);
+
+    restartVideoOutput();
+}
+
+v8::Local<v8::Value> JsVlcPlayer::videoCrop()
+{
+    using namespace v8;
+
+    Isolate* isolate = Isolate::GetCurrent();
+    Local<Context> context = isolate->GetCurrentContext();
+
+    const CropRect cropRect = VlcVideoOutput::cropRect();
+    if(0 == cropRect.width || 0 == cropRect.height)
+        return Null(isolate);
+
+    auto setProperty = [&] (Local<Object> object, const char* name, unsigned value) {
+        object->Set(
+            context,
+            String::NewFromUtf8(isolate, name, NewStringType::kInternalized).ToLocalChecked(),
+            Integer::NewFromUnsigned(isolate, value)).FromJust();
+    };
+
+    Local<Object> jsCrop = Object::New(isolate);
+    setProperty(jsCrop, "x", cropRect.x);
+    setProperty(jsCrop, "y", cropRect.y);
+    setProperty(jsCrop, "width", cropRect.width);
+    setProperty(jsCrop, "height", cropRect.height);
+
+    return jsCrop;
+}
+
+void JsVlcPlayer::setVideoCrop(const v8::Local<v8::Value>& value)
+{
+    using namespace v8;
+
+    CropRect cropRect = { 0, 0, 0, 0 };
+
+    Local<Value> x = GetProperty(value, "x");
+    if(x->IsUint32())
+        cropRect.x = FromJsValue<unsigned>(x);
+
+    Local<Value> y = GetProperty(value, "y");
+    if(y->IsUint32())
+        cropRect.y = FromJsValue<unsigned>(y);
+
+    Local<Value> width = GetProperty(value, "width");
+    if(width->IsUint32())
+        cropRect.width = FromJsValue<unsigned>(width);
+
+    Local<Value> height = GetProperty(value, "height");
+    if(height->IsUint32())
+        cropRect.height = FromJsValue<unsigned>(height);
+
+    if(0 == cropRect.width || 0 == cropRect.height)
+        cropRect = { 0, 0, 0, 0 };
+
+    const CropRect currentCropRect = VlcVideoOutput::cropRect();
+    if(cropRect.x == currentCropRect.x &&
+       cropRect.y == currentCropRect.y &&
+       cropRect.width == currentCropRect.width &&
+       cropRect.height == currentCropRect.height)
+    {
+        return;
+    }
+
+    VlcVideoOutput::setCropRect(cropRect);
+
+    //vmem doesn't apply libvlc crop geometry, so crop is done by video output
+    //on next format setup, which requires video output recreation
+    restartVideoOutput();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+struct JsVlcPlayer::SnapshotJob
+{
+    SnapshotJob() :
+        jpeg(false), quality(DefaultQuality), width(0), height(0),
+        succeeded(false) {}
+
+    static const unsigned DefaultQuality = 90;
+
+    uv_work_t work;
+
+    std::shared_ptr<const VideoFrame> videoFrame;
+    std::vector<uint8_t> frameData;
+    bool jpeg;
+    unsigned quality;
+    unsigned width;
+    unsigned height;
+
+    v8::UniquePersistent<v8::Promise::Resolver> resolver;
+
+    //should be accessed only from worker thread until job is completed
+    bool succeeded;
+    std::vector<uint8_t> image;
+};
+
+v8::Local<v8::Value> JsVlcPlayer::snapshot(const v8::Local<v8::Value>& options)
+{
+    using namespace v8;
+
+    Isolate* isolate = Isolate::GetCurrent();
+    Local<Context> context = isolate->GetCurrentContext();
+
+    Local<Promise::Resolver> resolver = Promise::Resolver::New(context).ToLocalChecked();
+
+    auto reject = [&] (const char* message) -> Local<Value> {
+        resolver->Reject(
+            context,
+            Exception::Error(
+                String::NewFromUtf8(isolate, message).ToLocalChecked())).FromJust();
+        return resolver->GetPromise();
+    };
+
+    std::unique_ptr<SnapshotJob> job(new SnapshotJob);
+
+    Local<Value> format = GetProperty(options, "format");
+    if(format->IsString()) {
+        const std::string formatName = FromJsValue<std::string>(format);
+        if("jpeg" == formatName || "jpg" == formatName)
+            job->jpeg = true;
+        else if("png" != formatName)
+            return reject("format should be \"png\" or \"jpeg\"");
+    }
+
+    Local<Value> quality = GetProperty(options, "quality");
+    if(quality->IsNumber())
+        job->quality = static_cast<unsigned>(std::max(1., std::min(FromJsValue<double>(quality), 100.)));
+
+    //only copy of frame is made here, all heavy work is done in thread pool
+    job->videoFrame = copyDisplayedFrame(&job->frameData);
+    if(!job->videoFrame)
+        return reject("there is no video frame");
+
+    const VideoFrame& videoFrame = *job->videoFrame;
+
+    //frames are only downscaled, keeping aspect ratio
+    job->width = videoFrame.width();
+    Local<Value> width = GetProperty(options, "width");
+    if(width->IsUint32() && FromJsValue<unsigned>(width) > 0)
+        job->width = std::min(FromJsValue<unsigned>(width), videoFrame.width());
+    job->height =
+        std::max(1u, static_cast<unsigned>(
+            static_cast<uint64_t>(videoFrame.height()) * job->width / videoFrame.width()));
+
+    job->resolver.Reset(isolate, resolver);
+
+    job->work.data = job.get();
+    uv_queue_work(
+        uv_default_loop(),
+        &job->work,
+        [] (uv_work_t* work) {
+            SnapshotJob* job = static_cast<SnapshotJob*>(work->data);
+
+            std::vector<uint8_t> rgb(static_cast<size_t>(job->width) * job->height * 3);
+            job->videoFrame->convertToRgb(job->frameData.data(), job->width, job->height, rgb.data());
+
+            //frame copy is not needed anymore
+            std::vector<uint8_t>().swap(job->frameData);
+
+            job->succeeded =
+                job->jpeg ?
+                    EncodeJpeg(rgb.data(), job->width, job->height, job->quality, &job->image) :
+                    EncodePng(rgb.data(), job->width, job->height, &job->image);
+        },
+        [] (uv_work_t* work, int /*status*/) {
+            completeSnapshot(static_cast<SnapshotJob*>(work->data));
+        });
+    job.release();
+
+    return resolver->GetPromise();
+}
+
+void JsVlcPlayer::completeSnapshot(SnapshotJob* finishedJob)
+{
+    using namespace v8;
+
+    std::unique_ptr<SnapshotJob> job(finishedJob);
+
+    Isolate* isolate = Isolate::GetCurrent();
+    HandleScope scope(isolate);
+    Local<Context> context = isolate->GetCurrentContext();
+
+    //lets promise reactions run right after resolve
+    node::CallbackScope callbackScope(isolate, Object::New(isolate), { 0, 0 });
+
+    Local<Promise::Resolver> resolver = Local<Promise::Resolver>::New(isolate, job->resolver);
+
+    if(!job->succeeded) {
+        resolver->Reject(
+            context,
+            Exception::Error(
+                String::NewFromUtf8(isolate, "failed to encode video frame").ToLocalChecked())).FromJust();
+        return;
+    }
+
+    resolver->Resolve(
+        context,
+        node::Buffer::Copy(
+            isolate,
+            reinterpret_cast<const char*>(job->image.data()),
+            job->image.size()).ToLocalChecked()).FromJust();
+}
+
+v8::Local<v8::Value> JsVlcPlayer::tensorOutput()
+{
+    using namespace v8;
+
+    Isolate* isolate = Isolate::GetCurrent();
+    Local<Context> context = isolate->GetCurrentContext();
+
+    if(!_tensorConverter)
+        return Null(isolate);
+
+    const TensorConverter::Options& options = _tensorConverter->options();
+
+    auto setProperty = [&] (Local<Object> object, const char* name, Local<Value> value) {
+        object->Set(
+            context,
+            String::NewFromUtf8(isolate, name, NewStringType::kInternalized).ToLocalChecked(),
+            value).FromJust();
+    };
+    auto newArray = [&] (const float values[3]) {
+        Local<Array> array = Array::New(isolate, 3);
+        for(unsigned c = 0; c < 3; ++c)
+            array->Set(context, c, Number::New(isolate, values[c])).FromJust();
+        return array;
+    };
+
+    Local<Object> jsOptions = Object::New(isolate);
+    setProperty(jsOptions, "width", Integer::NewFromUnsigned(isolate, options.width));
+    setProperty(jsOptions, "height", Integer::NewFromUnsigned(isolate, options.height));
+    setProperty(
+        jsOptions, "layout",
+        String::NewFromUtf8(
+            isolate,
+            TensorConverter::Layout::NHWC == options.layout ? "nhwc" : "nchw",
+            NewStringType::kInternalized).ToLocalChecked());
+    setProperty(
+        jsOptions, "type",
+        String::NewFromUtf8(
+            isolate,
+            TensorConverter::ElementType::Uint8 == options.type ? "uint8" : "float32",
+            NewStringType::kInternalized).ToLocalChecked());
+    setProperty(jsOptions, "mean", newArray(options.mean));
+    setProperty(jsOptions, "std", newArray(options.std));
+    setProperty(jsOptions, "fps", Number::New(isolate, options.fps));
+
+    const std::string error = _tensorConverter->error();
+    setProperty(
+        jsOptions, "error",
+        error.empty() ?
+            Local<Value>(Null(isolate)) :
+            Local<Value>(String::NewFromUtf8(isolate, error.c_str()).ToLocalChecked()));
+
+    return jsOptions;
+}
+
+void JsVlcPlayer::setTensorOutput(const v8::Local<v8::Value>& value)
+{
+    using namespace v8;
+
+    Isolate* isolate = Isolate::GetCurrent();
+    Local<Context> context = isolate->GetCurrentContext();
+
+    stopTensorOutput();
+
+    if(!value->IsObject())
+        return;
+
+    TensorConverter::Options options = {
+        0, 0,
+        TensorConverter::Layout::NCHW,
+        TensorConverter::ElementType::Float32,
+        { 0.f, 0.f, 0.f },
+        { 1.f, 1.f, 1.f },
+        0 };
+
+    Local<Value> width = GetProperty(value, "width");
+    if(width->IsUint32())
+        options.width = FromJsValue<unsigned>(width);
+
+    Local<Value> height = GetProperty(value, "height");
+    if(height->IsUint32())
+        options.height = FromJsValue<unsigned>(height);
+
+    Local<Value> layout = GetProperty(value, "layout");
+    if(layout->IsString() && "nhwc" == FromJsValue<std::string>(layout))
+        options.layout = TensorConverter::Layout::NHWC;
+
+    Local<Value> type = GetProperty(value, "type");
+    if(type->IsString() && "uint8" == FromJsValue<std::string>(type))
+        options.type = TensorConverter::ElementType::Uint8;
+
+    //single number is used for all channels
+    auto getChannels = [&] (const char* name, float values[3]) {
+        Local<Value> jsValues = GetProperty(value, name);
+        if(jsValues->IsNumber()) {
+            values[0] = values[1] = values[2] = static_cast<float>(FromJsValue<double>(jsValues));
+        } else if(jsValues->IsArray()) {
+            Local<Array> jsArray = Local<Array>::Cast(jsValues);
+            for(unsigned c = 0; c < std::min(jsArray->Length(), 3u); ++c) {
+                Local<Value> jsChannel = jsArray->Get(context, c).ToLocalChecked();
+                if(jsChannel->IsNumber())
+                    values[c] = static_cast<float>(FromJsValue<double>(jsChannel));
+            }
+        }
+    };
+    getChannels("mean", options.mean);
+    getChannels("std", options.std);
+
+    Local<Value> fps = GetProperty(value, "fps");
+    if(fps->IsNumber())
+        options.fps = std::max(FromJsValue<double>(fps), 0.);
+
+    std::unique_ptr<TensorConverter> tensorConverter(new TensorConverter);
+    const bool started =
+        tensorConverter->start(
+            options,
+            [this] () {
+                _asyncDataGuard.lock();
+                _asyncData.emplace_back(new TensorReadyEvent);
+                _asyncDataGuard.unlock();
+                uv_async_send(&_async);
+            });
+    if(!started)
+        return;
+
+    VlcVideoOutput::addFrameConsumer(TensorConverter::frame_consumer_cb, tensorConverter.get());
+    _tensorConverter = std::move(tensorConverter);
+}
+
+void JsVlcPlayer::stopTensorOutput()
+{
+    if(!_tensorConverter)
+        return;
+
+    //converter is not called after that, so it could be stopped safely
+    VlcVideoOutput::removeFrameConsumer(TensorConverter::frame_consumer_cb, _tensorConverter.get());
+    _tensorConverter->stop();
+    _tensorConverter.reset();
+}
+
+void JsVlcPlayer::deliverTensor()
+{
+    using namespace v8;
+
+    //tensor output could be disabled or restarted meanwhile,
+    //in last case tensor is just taken a bit earlier
+    if(!_tensorConverter || !_tensorConverter->takeTensor(&_tensor))
+        return;
+
+    Isolate* isolate = Isolate::GetCurrent();
+    HandleScope scope(isolate);
+    Local<Context> context = isolate->GetCurrentContext();
+
+    //every tensor gets own array buffer, so consumer could keep it while inference is running
+    Local<ArrayBuffer> arrayBuffer = ArrayBuffer::New(isolate, _tensor.data.size());
+#ifdef USE_BACKING_STORE
+    memcpy(arrayBuffer->GetBackingStore()->Data(), _tensor.data.data(), _tensor.data.size());
+#else
+    memcpy(arrayBuffer->GetContents().Data(), _tensor.data.data(), _tensor.data.size());
+#endif
+
+    Local<Value> jsTensor;
+    if(TensorConverter::ElementType::Uint8 == _tensorConverter->options().type)
+        jsTensor = Uint8Array::New(arrayBuffer, 0, _tensor.data.size());
+    else
+        jsTensor = Float32Array::New(arrayBuffer, 0, _tensor.data.size() / sizeof(float));
+
+    Local<Object> jsTensorInfo = Object::New(isolate);
+    jsTensorInfo->Set(
+        context,
+        String::NewFromUtf8(isolate, "sequence", NewStringType::kInternalized).ToLocalChecked(),
+        Number::New(isolate, static_cast<double>(_tensor.sequence))).FromJust();
+    jsTensorInfo->Set(
+        context,
+        String::NewFromUtf8(isolate, "mediaTime", NewStringType::kInternalized).ToLocalChecked(),
+        Number::New(isolate, static_cast<double>(_tensor.pts))).FromJust();
+
+    callCallback(CB_TensorReady, { jsTensor, jsTensorInfo });
+}
+
+bool JsVlcPlayer::startRawRecording(const std::string& path)
+{
+    if(_rawRecorder)
+        return false;
+
+    std::unique_ptr<RawVideoRecorder> rawRecorder(new RawVideoRecorder);
+    if(!rawRecorder->start(path))
+        return false;
+
+    rawRecorder->setFrameRate(player().playback().get_fps());
+
+    VlcVideoOutput::addFrameConsumer(RawVideoRecorder::frame_consumer_cb, rawRecorder.get());
+    _rawRecorder = std::move(rawRecorder);
+
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+struct JsVlcPlayer::RawRecordingStopJob
+{
+    uv_work_t work;
+
+    //should be accessed only from worker thread until job is completed
+    std::unique_ptr<RawVideoRecorder> rawRecorder;
+
+    v8::UniquePersistent<v8::Promise::Resolver> resolver;
+};
+
+v8::Local<v8::Value> JsVlcPlayer::stopRawRecording()
+{
+    using namespace v8;
+
+    Isolate* isolate = Isolate::GetCurrent();
+    Local<Context> context = isolate->GetCurrentContext();
+
+    Local<Promise::Resolver> resolver = Promise::Resolver::New(context).ToLocalChecked();
+
+    if(!_rawRecorder) {
+        resolver->Resolve(context, Null(isolate)).FromJust();
+        return resolver->GetPromise();
+    }
+
+    //recorder is not called after that, so all frames it got will be written by stop
+    VlcVideoOutput::removeFrameConsumer(RawVideoRecorder::frame_consumer_cb, _rawRecorder.get());
+
+    std::unique_ptr<RawRecordingStopJob> job(new RawRecordingStopJob);
+    job->rawRecorder = std::move(_rawRecorder);
+    job->resolver.Reset(isolate, resolver);
+
+    //flushing queue could take a while, so it's done in thread pool
+    job->work.data = job.get();
+    uv_queue_work(
+        uv_default_loop(),
+        &job->work,
+        [] (uv_work_t* work) {
+            static_cast<RawRecordingStopJob*>(work->data)->rawRecorder->stop();
+        },
+        [] (uv_work_t* work, int /*status*/) {
+            completeRawRecordingStop(static_cast<RawRecordingStopJob*>(work->data));
+        });
+    job.release();
+
+    return resolver->GetPromise();
+}
+
+void JsVlcPlayer::completeRawRecordingStop(RawRecordingStopJob* finishedJob)
+{
+    using namespace v8;
+
+    std::unique_ptr<RawRecordingStopJob> job(finishedJob);
+    RawVideoRecorder& rawRecorder = *job->rawRecorder;
+
+    Isolate* isolate = Isolate::GetCurrent();
+    HandleScope scope(isolate);
+    Local<Context> context = isolate->GetCurrentContext();
+
+    //lets promise reactions run right after resolve
+    node::CallbackScope callbackScope(isolate, Object::New(isolate), { 0, 0 });
+
+    auto setProperty = [&] (Local<Object> object, const char* name, Local<Value> value) {
+        object->Set(
+            context,
+            String::NewFromUtf8(isolate, name, NewStringType::kInternalized).ToLocalChecked(),
+            value).FromJust();
+    };
+
+    Local<Object> jsResult = Object::New(isolate);
+    setProperty(jsResult, "writtenFrames", Number::New(isolate, static_cast<double>(rawRecorder.writtenFrames())));
+    setProperty(jsResult, "droppedFrames", Number::New(isolate, static_cast<double>(rawRecorder.droppedFrames())));
+    setProperty(jsResult, "writtenBytes", Number::New(isolate, static_cast<double>(rawRecorder.writtenBytes())));
+    const std::string error = rawRecorder.error();
+    setProperty(
+        jsResult, "error",
+        error.empty() ?
+            Local<Value>(Null(isolate)) :
+            Local<Value>(String::NewFromUtf8(isolate, error.c_str()).ToLocalChecked()));
+
+    Local<Promise::Resolver> resolver = Local<Promise::Resolver>::New(isolate, job->resolver);
+    resolver->Resolve(context, jsResult).FromJust();
+}
+
+double JsVlcPlayer::position()
+{
+    return player().playback().get_position();
+}
+
+void JsVlcPlayer::setPosition(double position)
+{
+    //seek flushes decoder
+    VlcVideoOutput::cancelFrameWait();
+    player().playback().set_position(static_cast<float>(position));
+    VlcVideoOutput::resumeFrameWait();
+}
+
+double JsVlcPlayer::time()
+{
+    return static_cast<double>(player().playback().get_time());
+}
+
+void JsVlcPlayer::setTime(double time)
+{
+    //restarted item is not seekable until it's playing again
+    if(_restartingVideoOutput) {
+        _restartTime = static_cast<int64_t>(time);
+        return;
+    }
+
+    //seek flushes decoder
+    VlcVideoOutput::cancelFrameWait();
+    player().playback().set_time(static_cast<libvlc_time_t>(time));
+    VlcVideoOutput::resumeFrameWait();
+}
+
+unsigned JsVlcPlayer::volume()
+{
+    return player().audio().get_volume();
+}
+
+void JsVlcPlayer::setVolume(unsigned volume)
+{
+    player().audio().set_volume(volume);
+}
+
+bool JsVlcPlayer::muted()
+{
+    return player().audio().is_muted();
+}
+
+void JsVlcPlayer::setMuted(bool mute)
+{
+    player().audio().set_mute(mute);
+}
+
+void JsVlcPlayer::play()
+{
+    //restarted item is playing already, it just should not be paused again
+    if(_restartingVideoOutput) {
+        _restartPaused = false;
+        return;
+    }
+
+    VlcVideoOutput::startFirstFrameTimer();
+    player().play();
+}
+
+void JsVlcPlayer::play(const std::string& mrl)
+{
+    vlc::player& p = player();
+
+    //previous media stop waits for decode thread
+    VlcVideoOutput::cancelFrameWait();
+
+    cancelVideoOutputRestart();
+    p.clear_items();
+
+    const int idx = addMedia(mrl, std::vector<std::string>());
+    if(idx >= 0) {
+        applyItemProcessMode(idx);
+        VlcVideoOutput::startFirstFrameTimer();
+        p.play(idx);
+    }
+
+    VlcVideoOutput::resumeFrameWait();
+}
+
+void JsVlcPlayer::pause()
+{
+    //restarted item is paused once it's playing again
+    if(_restartingVideoOutput) {
+        _restartPaused = true;
+        return;
+    }
+
+    player().pause();
+}
+
+void JsVlcPlayer::togglePause()
+{
+    if(_restartingVideoOutput) {
+        _restartPaused = !_restartPaused;
+        return;
+    }
+
+    player().togglePause();
+}
+
+void JsVlcPlayer::stop()
+{
+    cancelVideoOutputRestart();
+
+    VlcVideoOutput::cancelFrameWait();
+    player().stop();
+    VlcVideoOutput::resumeFrameWait();
+}
+
+int JsVlcPlayer::addMedia(
+    const std::string& mrl,
+    const std::vector<std::string>& trustedOptions)
+{
+    //decode as fast as possible and never drop late frames
+    static const char* processOptions[] = {
+        ":no-audio",
+        ":no-drop-late-frames",
+        ":no-skip-frames",
+        ":no-avcodec-hurry-up",
+        ":rate=32",
+    };
+
+    std::vector<const char*> trusted_opts;
+    trusted_opts.reserve(trustedOptions.size());
+
+    for(const std::string& opt: trustedOptions) {
+        trusted_opts.push_back(opt.c_str());
+    }
+
+    vlc::player& p = player();
+
+    const int idx =
+        p.add_media(
+            mrl.c_str(),
+            _processMode ? sizeof(processOptions) / sizeof(processOptions[0]) : 0,
+            _processMode ? processOptions : nullptr,
+            static_cast<unsigned>(trusted_opts.size()),
+            trusted_opts.data());
+
+    _processModeMedia.erase(
+        std::remove_if(
+            _processModeMedia.begin(), _processModeMedia.end(),
+            [&p] (const vlc::media& media) {
+                return p.find_media_index(media) < 0;
+            }),
+        _processModeMedia.end());
+
+    if(idx >= 0 && _processMode)
+        _processModeMedia.push_back(p.get_media(idx));
+
+    return idx;
+}
+
+bool JsVlcPlayer::playItem(unsigned idx)
+{
+    cancelVideoOutputRestart();
+
+    //previous media stop waits for decode thread
+    VlcVideoOutput::cancelFrameWait();
+    applyItemProcessMode(idx);
+    VlcVideoOutput::startFirstFrameTimer();
+    const bool started = player().play(idx);
+    VlcVideoOutput::resumeFrameWait();
+
+    return started;
+}
+
+void JsVlcPlayer::next()
+{
+    cancelVideoOutputRestart();
+
+    VlcVideoOutput::cancelFrameWait();
+    VlcVideoOutput::startFirstFrameTimer();
+    player().next();
+    VlcVideoOutput::resumeFrameWait();
+}
+
+void JsVlcPlayer::prev()
+{
+    cancelVideoOutputRestart();
+
+    VlcVideoOutput::cancelFrameWait();
+    VlcVideoOutput::startFirstFrameTimer();
+    player().prev();
+    VlcVideoOutput::resumeFrameWait();
+}
+
+void JsVlcPlayer::clearItems()
+{
+    cancelVideoOutputRestart();
+
+    //removing current item stops it
+    VlcVideoOutput::cancelFrameWait();
+    player().clear_items();
+    VlcVideoOutput::resumeFrameWait();
+}
+
+bool JsVlcPlayer::removeItem(unsigned idx)
+{
+    cancelVideoOutputRestart();
+
+    VlcVideoOutput::cancelFrameWait();
+    const bool removed = player().delete_item(idx);
+    VlcVideoOutput::resumeFrameWait();
+
+    return removed;
+}
+
+void JsVlcPlayer::setCurrentItem(unsigned idx)
+{
+    cancelVideoOutputRestart();
+
+    player().set_current(idx);
+}
+
+void JsVlcPlayer::advanceItem(unsigned idx, int count)
+{
+    //item indexes are changed
+    cancelVideoOutputRestart();
+
+    player().advance_item(idx, count);
 }
 
 void JsVlcPlayer::toggleMute()
@@ -12,6 +12,8 @@
 #include <libvlc_wrapper/vlc_vmem.h>
 
 #include "VlcVideoOutput.h"
+#include "RawVideoRecorder.h"
+#include "TensorConverter.h"
 
 class JsVlcPlayer :
     public node::ObjectWrap,
@@ -22,6 +24,9 @@ class JsVlcPlayer :
         CB_FrameSetup = 0,
         CB_FrameReady,
         CB_FrameCleanup,
+        CB_SceneChange,
+        CB_TensorReady,
+        CB_AdaptiveScaleChange,
 
         CB_MediaPlayerMediaChanged,
         CB_MediaPlayerNothingSpecial,
@@ -48,6 +53,33 @@ class JsVlcPlayer :
 
     static const char* callbackNames[CB_Max];
 
+    //layout of frameSync Int32Array,
+    //consumer should store FS_BufferIndex value to FS_ReaderBufferIndex
+    //and then check FS_BufferIndex didn't change, before reading frame
+    enum FrameSync_e {
+        FS_Sequence = 0,      //incremented on every delivered frame
+        FS_BufferIndex,       //index in frameBuffers of latest delivered frame
+        FS_ReaderBufferIndex, //set by consumer to index of buffer it reads, or -1
+
+        FS_Max,
+    };
+
+    //layout of frameStats Float64Array,
+    //it's updated before onFrameReady if statistics were computed for delivered frame
+    enum FrameStats_e {
+        FST_Sequence = 0, //frameInfo.sequence of frame statistics belong to
+        FST_LumaMin,
+        FST_LumaMax,
+        FST_LumaMean,
+        FST_AverageR,
+        FST_AverageG,
+        FST_AverageB,
+        FST_RgbHistograms, //1 if histograms are R, G, B, and 0 if they are Y, U, V
+        FST_Histograms,    //3 histograms of 256 values each
+
+        FST_Max = FST_Histograms + FrameStats::Channels * 256,
+    };
+
 public:
     static void initJsApi(
         const v8::Local<v8::Object>& exports,
@@ -71,11 +103,107 @@ public:
     unsigned state();
 
     v8::Local<v8::Value> getVideoFrame();
+    v8::Local<v8::Value> getFrameBuffers();
+    v8::Local<v8::Value> getFrameSync();
+    v8::Local<v8::Object> getFrameInfo();
+    v8::Local<v8::Value> getNativeHandle();
     v8::Local<v8::Object> getEventEmitter();
 
     unsigned pixelFormat();
     void setPixelFormat(unsigned);
 
+    //every frame is delivered, and decoding is not paced by playback clock,
+    //applies to media added to playlist while it's enabled,
+    //every item keeps mode it was added with, and backpressure follows item being played
+    bool processMode();
+    void setProcessMode(bool);
+    //set with {audioOnly: true} player option,
+    //video tracks are never selected and there is no video output at all
+    bool audioOnly();
+    double deliveredFps();
+    //milliseconds from latest play() to first delivered frame, negative until it's delivered
+    double timeToFirstFrame();
+
+    bool adaptiveScaling();
+    void setAdaptiveScaling(bool);
+    double adaptiveScale();
+
+    double sceneChangeThreshold();
+    void setSceneChangeThreshold(double);
+
+    unsigned frameStatsInterval();
+    void setFrameStatsInterval(unsigned);
+    v8::Local<v8::Value> getFrameStats();
+
+    double maxFps();
+    void setMaxFps(double);
+    double cadenceFps();
+    void setCadenceFps(double);
+
+    bool suppressDuplicateFrames();
+    void setSuppressDuplicateFrames(bool);
+    double duplicateFramesSuppressed();
+    double droppedFrames();
+
+    unsigned strideAlignment();
+    void setStrideAlignment(unsigned);
+
+    bool sharedFrameBuffers();
+    void setSharedFrameBuffers(bool);
+
+    void preallocateFrameBuffers(unsigned width, unsigned height);
+
+    //in pull mode onFrameReady is not called and decoder doesn't wake up main loop,
+    //renderer takes frames with acquireLatestFrame() at its own rate
+    bool pullMode();
+    void setPullMode(bool);
+    //returns { frame, sequence } with the same frame buffer onFrameReady would get
+    //(frameInfo and frameStats are updated too), or null if there is no new frame,
+    //frame is not overwritten by decoder until next acquireLatestFrame() or releaseLatestFrame()
+    v8::Local<v8::Value> acquireLatestFrame();
+    bool releaseLatestFrame();
+
+    //see JsVlcReplay
+    double replayBudget();
+    void setReplayBudget(double);
+    unsigned replayLength();
+    v8::Local<v8::Value> replayFrameInfo(unsigned index);
+    bool showReplayFrame(unsigned index);
+    int showReplayFrameAt(double time);
+
+    //callback(frame, frameInfo) is called for every delivered frame,
+    //without options it gets the same frame as onFrameReady, otherwise
+    //frame converted by decode thread with { width, height, pixelFormat } (RV32 or I420),
+    //subscribers with the same options share one converted frame,
+    //returns subscription id or -1 if arguments are invalid
+    int subscribeFrames(const v8::Local<v8::Value>& callback, const v8::Local<v8::Value>& options);
+    bool unsubscribeFrames(unsigned id);
+
+    v8::Local<v8::Value> videoOutputSize();
+    void setVideoOutputSize(const v8::Local<v8::Value>&);
+
+    //{ x, y, width, height } in source pixels, or null
+    v8::Local<v8::Value> videoCrop();
+    void setVideoCrop(const v8::Local<v8::Value>&);
+
+    //{ width, height, layout: "nchw" | "nhwc", type: "float32" | "uint8", mean, std, fps },
+    //plus conversion error, or null if tensor output is disabled, see TensorConverter;
+    //tensors are delivered with onTensorReady(tensor, { sequence, mediaTime })
+    v8::Local<v8::Value> tensorOutput();
+    void setTensorOutput(const v8::Local<v8::Value>&);
+
+    //returns Promise resolved with PNG or JPEG encoded latest delivered frame,
+    //encoding is done in libuv thread pool
+    v8::Local<v8::Value> snapshot(const v8::Local<v8::Value>& options);
+
+    //every frame written by decoder is recorded to file, see RawVideoRecorder,
+    //returns false if recording is active already or file can't be created
+    bool startRawRecording(const std::string& path);
+    //returns promise of { writtenFrames, droppedFrames, writtenBytes, error }
+    //resolved when queued frames are written (or of null if recording is not active),
+    //new recording could be started right away
+    v8::Local<v8::Value> stopRawRecording();
+
     double position();
     void setPosition(double);
 
@@ -95,6 +223,19 @@ public:
     void stop();
     void toggleMute();
 
+    //everything adding media or switching, stopping and seeking it should go through these
+    //(playlist and input objects too), so media gets process mode options,
+    //decoder waiting for renderer doesn't block player waiting for decode thread,
+    //and video output restart in progress is not applied to other item
+    int addMedia(const std::string& mrl, const std::vector<std::string>& trustedOptions);
+    bool playItem(unsigned idx);
+    void next();
+    void prev();
+    void clearItems();
+    bool removeItem(unsigned idx);
+    void setCurrentItem(unsigned idx);
+    void advanceItem(unsigned idx, int count);
+
     v8::Local<v8::Object> input();
     v8::Local<v8::Object> audio();
     v8::Local<v8::Object> video();
@@ -113,6 +254,7 @@ private:
     JsVlcPlayer(
         v8::Local<v8::Object>& thisObject,
         const v8::Local<v8::Array>& vlcOpts,
+        const v8::Local<v8::Value>& options,
         ContextData*);
     ~JsVlcPlayer();
 
@@ -120,6 +262,7 @@ private:
     struct CallbackData;
     struct LibvlcEvent;
     struct LibvlcLogEvent;
+    struct TensorReadyEvent;
 
     void initLibvlc(const v8::Local<v8::Array>& vlcOpts);
 
@@ -136,15 +279,56 @@ private:
 
     void currentItemEndReached();
 
+    bool isProcessModeItem(int idx);
+    //enables frame backpressure only for items added in process mode
+    void applyItemProcessMode(int idx);
+
+    //forces libvlc to setup video format again by restarting current item,
+    //playback is resumed from the same time and state once it's playing again
+    void restartVideoOutput();
+    void finishVideoOutputRestart();
+    //forgets restart in progress, so it doesn't touch item application switched to
+    void cancelVideoOutputRestart();
+
     void callCallback(
         Callbacks_e callback,
         std::initializer_list<v8::Local<v8::Value> > list = std::initializer_list<v8::Local<v8::Value> >());
 
+    struct JsFrameBuffer;
+
+    v8::Local<v8::TypedArray> createFrameBuffer(
+        const VideoFrame&,
+        FrameBuffer*);
+
+    //makes frame in buffer current one for frame, frameInfo, frameSync and frameStats
+    void publishFrame(unsigned bufferIndex, const FrameInfo&);
+    void updateFrameInfo(const FrameInfo&);
+    void updateFrameStats(const FrameInfo&, const FrameStats&);
+
+    struct FrameSubscriber;
+    struct JsVariantFrame;
+
+    void updateFrameVariants();
+    void notifyFrameSubscribers(unsigned bufferIndex, const FrameInfo&);
+    v8::Local<v8::Uint8Array> variantJsFrame(const VariantFrame&, uint64_t sequence);
+
+    void stopTensorOutput();
+    void deliverTensor();
+
+    struct SnapshotJob;
+    static void completeSnapshot(SnapshotJob*);
+
+    struct RawRecordingStopJob;
+    static void completeRawRecordingStop(RawRecordingStopJob*);
+
 protected:
-    void* onFrameSetup(const RV32VideoFrame&) override;
-    void* onFrameSetup(const I420VideoFrame&) override;
-    void onFrameReady() override;
+    std::unique_ptr<FrameBuffer> onFrameBufferAlloc(size_t capacity) override;
+    bool onFrameSetup(const VideoFrame&, FrameBuffer* const frameBuffers[]) override;
+    void onFrameReady(unsigned bufferIndex, const FrameInfo&) override;
     void onFrameCleanup() override;
+    void onSceneChange(const SceneChange&) override;
+    void onAdaptiveScaleRequest(double scale) override;
+    void onAdaptiveScaleChange(double scale) override;
 
 private:
     static v8::Persistent<v8::Function> _jsConstructor;
@@ -158,7 +342,37 @@ private:
     std::mutex _asyncDataGuard;
     std::deque<std::unique_ptr<AsyncData> > _asyncData;
 
+    v8::UniquePersistent<v8::Value> _jsFrameBuffers[VideoFrame::BuffersCount];
     v8::UniquePersistent<v8::Value> _jsFrameBuffer;
+    v8::UniquePersistent<v8::Object> _jsFrameInfo;
+
+    bool _sharedFrameBuffers;
+    std::atomic<int32_t>* _frameSync;
+    v8::UniquePersistent<v8::Int32Array> _jsFrameSync;
+    v8::UniquePersistent<v8::Function> _jsAtomicsNotify;
+
+    double* _frameStats;
+    v8::UniquePersistent<v8::Float64Array> _jsFrameStats;
+
+    bool _processMode;
+    //items added in process mode, removed ones are forgotten on next add
+    std::vector<vlc::media> _processModeMedia;
+    bool _audioOnly;
+
+    //player state changes caused by restartVideoOutput are not reported
+    bool _restartingVideoOutput;
+    int _restartItem; //-1 if there is no restart in progress
+    int64_t _restartTime; //-1 if unknown
+    bool _restartPaused;
+
+    std::unique_ptr<RawVideoRecorder> _rawRecorder;
+
+    std::unique_ptr<TensorConverter> _tensorConverter;
+    TensorConverter::Tensor _tensor;
+
+    unsigned _lastFrameSubscriberId;
+    std::vector<std::unique_ptr<FrameSubscriber> > _frameSubscribers;
+    std::vector<std::unique_ptr<JsVariantFrame> > _jsVariantFrames;
 
     v8::UniquePersistent<v8::Function> _jsCallbacks[CB_Max];
     v8::UniquePersistent<v8::Object> _jsEventEmitter;
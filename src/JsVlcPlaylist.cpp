@@ -155,81 +155,69 @@ int JsVlcPlaylist::currentItem()
 
 void JsVlcPlaylist::setCurrentItem(unsigned idx)
 {
-    _jsPlayer->player().set_current(idx);
+    _jsPlayer->setCurrentItem(idx);
 }
 
 int JsVlcPlaylist::add(const std::string& mrl)
 {
-    return _jsPlayer->player().add_media(mrl.c_str());
+    return _jsPlayer->addMedia(mrl, std::vector<std::string>());
 }
 
 int JsVlcPlaylist::addWithOptions(
     const std::string& mrl,
     const std::vector<std::string>& options)
 {
-    std::vector<const char*> trusted_opts;
-    trusted_opts.reserve(options.size());
-
-    for(const std::string& opt: options) {
-        trusted_opts.push_back(opt.c_str());
-    }
-
-    return
-        _jsPlayer->player().add_media(
-            mrl.c_str(),
-            0, nullptr,
-            static_cast<unsigned>(trusted_opts.size()),
-            trusted_opts.data());
+    return _jsPlayer->addMedia(mrl, options);
 }
 
 void JsVlcPlaylist::play()
 {
-    _jsPlayer->player().play();
+    _jsPlayer->play();
 }
 
 bool JsVlcPlaylist::playItem(unsigned idx)
 {
-    return _jsPlayer->player().play(idx);
+    return _jsPlayer->playItem(idx);
 }
 
 void JsVlcPlaylist::pause()
 {
-    _jsPlayer->player().pause();
+    _jsPlayer->pause();
 }
 
 void JsVlcPlaylist::togglePause()
 {
-    _jsPlayer->player().togglePause();
+    _jsPlayer->togglePause();
 }
 
 void JsVlcPlaylist::stop()
 {
-    _jsPlayer->player().stop();
+    _jsPlayer->stop();
 }
 
 void JsVlcPlaylist::next()
 {
-    _jsPlayer->player().next();
+    _jsPlayer->next();
 }
 
 void JsVlcPlaylist::prev()
 {
-    _jsPlayer->player().prev();
+    _jsPlayer->prev();
 }
 
 void JsVlcPlaylist::clear()
 {
-    _jsPlayer->player().clear_items();
+    _jsPlayer->clearItems();
 }
 
 bool JsVlcPlaylist::removeItem(unsigned idx)
 {
-    return _jsPlayer->player().delete_item(idx);
+    return _jsPlayer->removeItem(idx);
 }
 
 void JsVlcPlaylist::advanceItem(unsigned idx, int count)
 {
-    _jsPlayer->player().advance_item(idx, count);
+    _jsPlayer->advanceItem(idx, count);
 }
 
 v8::Local<v8::Object> JsVlcPlaylist::items()
@@ -99,10 +99,10 @@ unsigned JsVlcPlaylistItems::count()
 
 void JsVlcPlaylistItems::clear()
 {
-    return _jsPlayer->player().clear_items();
+    return _jsPlayer->clearItems();
 }
 
 bool JsVlcPlaylistItems::remove(unsigned int idx)
 {
-   return _jsPlayer->player().delete_item(idx);
+   return _jsPlayer->removeItem(idx);
 }
@@ -0,0 +1,115 @@
+#include "JsVlcReplay.h"
+
+#include "NodeTools.h"
+#include "JsVlcPlayer.h"
+
+v8::Persistent<v8::Function> JsVlcReplay::_jsConstructor;
+
+void JsVlcReplay::initJsApi()
+{
+    using namespace v8;
+
+    Isolate* isolate = Isolate::GetCurrent();
+    Local<Context> context = isolate->GetCurrentContext();
+    HandleScope scope(isolate);
+
+    Local<FunctionTemplate> constructorTemplate = FunctionTemplate::New(isolate, jsCreate);
+    constructorTemplate->SetClassName(
+        String::NewFromUtf8(isolate, "VlcReplay", NewStringType::kInternalized).ToLocalChecked());
+
+    Local<ObjectTemplate> protoTemplate = constructorTemplate->PrototypeTemplate();
+    Local<ObjectTemplate> instanceTemplate = constructorTemplate->InstanceTemplate();
+    instanceTemplate->SetInternalFieldCount(1);
+
+    SET_RO_PROPERTY(instanceTemplate, "length", &JsVlcReplay::length);
+
+    SET_RW_PROPERTY(instanceTemplate, "budget", &JsVlcReplay::budget, &JsVlcReplay::setBudget);
+
+    SET_METHOD(constructorTemplate, "frameInfo", &JsVlcReplay::frameInfo);
+    SET_METHOD(constructorTemplate, "show", &JsVlcReplay::show);
+    SET_METHOD(constructorTemplate, "showAt", &JsVlcReplay::showAt);
+
+    Local<Function> constructor = constructorTemplate->GetFunction(context).ToLocalChecked();
+    _jsConstructor.Reset(isolate, constructor);
+}
+
+v8::UniquePersistent<v8::Object> JsVlcReplay::create(JsVlcPlayer& player)
+{
+    using namespace v8;
+
+    Isolate* isolate = Isolate::GetCurrent();
+    Local<Context> context = isolate->GetCurrentContext();
+    HandleScope scope(isolate);
+
+    Local<Function> constructor =
+        Local<Function>::New(isolate, _jsConstructor);
+
+    Local<Value> argv[] = { player.handle() };
+
+    return {
+        isolate,
+        constructor->NewInstance(
+            context,
+            sizeof(argv) / sizeof(argv[0]), argv).ToLocalChecked()
+    };
+}
+
+void JsVlcReplay::jsCreate(const v8::FunctionCallbackInfo<v8::Value>& args)
+{
+    using namespace v8;
+
+    Isolate* isolate = Isolate::GetCurrent();
+    Local<Context> context = isolate->GetCurrentContext();
+
+    Local<Object> thisObject = args.Holder();
+    if(args.IsConstructCall() && thisObject->InternalFieldCount() > 0) {
+        JsVlcPlayer* jsPlayer =
+            ObjectWrap::Unwrap<JsVlcPlayer>(Handle<Object>::Cast(args[0]));
+        if(jsPlayer) {
+            new JsVlcReplay(thisObject, jsPlayer);
+            args.GetReturnValue().Set(thisObject);
+        }
+    } else {
+        Local<Function> constructor =
+            Local<Function>::New(isolate, _jsConstructor);
+        Local<Value> argv[] = { args[0] };
+        args.GetReturnValue().Set(
+            constructor->NewInstance(context, sizeof(argv) / sizeof(argv[0]), argv).ToLocalChecked());
+    }
+}
+
+JsVlcReplay::JsVlcReplay(v8::Local<v8::Object>& thisObject, JsVlcPlayer* jsPlayer) :
+    _jsPlayer(jsPlayer)
+{
+    Wrap(thisObject);
+}
+
+double JsVlcReplay::budget()
+{
+    return _jsPlayer->replayBudget();
+}
+
+void JsVlcReplay::setBudget(double budget)
+{
+    _jsPlayer->setReplayBudget(budget);
+}
+
+unsigned JsVlcReplay::length()
+{
+    return _jsPlayer->replayLength();
+}
+
+v8::Local<v8::Value> JsVlcReplay::frameInfo(unsigned index)
+{
+    return _jsPlayer->replayFrameInfo(index);
+}
+
+bool JsVlcReplay::show(unsigned index)
+{
+    return _jsPlayer->showReplayFrame(index);
+}
+
+int JsVlcReplay::showAt(double time)
+{
+    return _jsPlayer->showReplayFrameAt(time);
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <node.h>
+#include <node_object_wrap.h>
+
+class JsVlcPlayer; //#include "JsVlcPlayer.h"
+
+//delivered frames retained by player for instant replay,
+//index 0 is the oldest one
+class JsVlcReplay :
+    public node::ObjectWrap
+{
+public:
+    static void initJsApi();
+    static v8::UniquePersistent<v8::Object> create(JsVlcPlayer& player);
+
+    //in bytes, 0 disables retaining
+    double budget();
+    void setBudget(double);
+
+    unsigned length();
+
+    //returns { sequence, mediaTime } or null
+    v8::Local<v8::Value> frameInfo(unsigned index);
+    //delivers retained frame with onFrameReady, using current frame buffer
+    bool show(unsigned index);
+    //shows latest retained frame with media time not after given one,
+    //returns its index or -1
+    int showAt(double time);
+
+private:
+    static void jsCreate(const v8::FunctionCallbackInfo<v8::Value>& args);
+    JsVlcReplay(v8::Local<v8::Object>& thisObject, JsVlcPlayer*);
+
+private:
+    static v8::Persistent<v8::Function> _jsConstructor;
+
+    JsVlcPlayer* _jsPlayer;
+};
@@ -0,0 +1,300 @@
+#include "JsVlcSceneScanner.h"
+
+#include <string>
+#include <deque>
+#include <set>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include <uv.h>
+
+#include "NodeTools.h"
+#include "VlcSceneScanner.h"
+
+///////////////////////////////////////////////////////////////////////////////
+struct JsVlcSceneScanner::ContextData
+{
+    ContextData() :
+        libvlc(nullptr), async(nullptr), closed(false) {}
+    ~ContextData();
+
+    libvlc_instance_t* libvlc;
+    std::deque<std::unique_ptr<Job> > pendingJobs;
+    //wakes up main loop when job is finished, it's closed on environment cleanup
+    uv_async_t* async;
+
+    std::mutex guard;
+    std::set<Job*> runningJobs; //guarded by guard
+    std::deque<Job*> finishedJobs; //guarded by guard
+    //environment is gone, but some jobs are still running,
+    //so last one deletes context, guarded by guard
+    bool closed;
+};
+
+JsVlcSceneScanner::ContextData::~ContextData()
+{
+    pendingJobs.clear();
+
+    if(libvlc)
+        libvlc_release(libvlc);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+struct JsVlcSceneScanner::Job
+{
+    //low enough to catch cuts between similar shots,
+    //high enough to ignore camera motion
+    static constexpr double DefaultThreshold = 0.12;
+
+    Job(ContextData* contextData) :
+        contextData(contextData),
+        threshold(DefaultThreshold),
+        scanner(contextData->libvlc),
+        succeeded(false) {}
+
+    ContextData *const contextData;
+
+    std::string mrl;
+    double threshold;
+
+    v8::UniquePersistent<v8::Promise::Resolver> resolver;
+
+    //should be accessed only from job thread until job is completed
+    VlcSceneScanner scanner;
+    bool succeeded;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+void JsVlcSceneScanner::initJsApi(
+    const v8::Local<v8::Object>& exports,
+    const v8::Local<v8::Context>& context)
+{
+    using namespace v8;
+
+    Isolate* isolate = context->GetIsolate();
+
+    ContextData* contextData = new ContextData;
+
+    contextData->async = new uv_async_t;
+    contextData->async->data = contextData;
+    uv_async_init(
+        uv_default_loop(), contextData->async,
+        [] (uv_async_t* handle) {
+            completeJobs(static_cast<ContextData*>(handle->data));
+        });
+    //loop is kept alive only while there are running jobs
+    uv_unref(reinterpret_cast<uv_handle_t*>(contextData->async));
+
+    node::AddEnvironmentCleanupHook(
+        isolate,
+        [] (void* data) {
+            ContextData* contextData = static_cast<ContextData*>(data);
+            contextData->pendingJobs.clear();
+
+            std::unique_lock<std::mutex> lock(contextData->guard);
+
+            for(Job* job: contextData->finishedJobs) {
+                contextData->runningJobs.erase(job);
+                delete job;
+            }
+            contextData->finishedJobs.clear();
+
+            //running jobs still use libvlc instance, so last one will delete it,
+            //but promises are gone with environment
+            for(Job* job: contextData->runningJobs)
+                job->resolver.Reset();
+
+            contextData->closed = true;
+            const bool running = !contextData->runningJobs.empty();
+
+            lock.unlock();
+
+            //job threads don't touch async after context is closed
+            uv_close(
+                reinterpret_cast<uv_handle_t*>(contextData->async),
+                [] (uv_handle_t* handle) {
+                    delete reinterpret_cast<uv_async_t*>(handle);
+                });
+
+            if(!running)
+                delete contextData;
+        }, contextData);
+
+    Local<FunctionTemplate> functionTemplate =
+        FunctionTemplate::New(
+            isolate,
+            jsScanScenes,
+            External::New(isolate, contextData));
+
+    exports->Set(
+        context,
+        String::NewFromUtf8(isolate, "scanScenes", NewStringType::kInternalized).ToLocalChecked(),
+        functionTemplate->GetFunction(context).ToLocalChecked()).FromJust();
+}
+
+void JsVlcSceneScanner::jsScanScenes(const v8::FunctionCallbackInfo<v8::Value>& args)
+{
+    using namespace v8;
+
+    Isolate* isolate = Isolate::GetCurrent();
+    Local<Context> context = isolate->GetCurrentContext();
+
+    ContextData* contextData =
+        static_cast<ContextData*>(args.Data().As<External>()->Value());
+
+    Local<Promise::Resolver> resolver = Promise::Resolver::New(context).ToLocalChecked();
+    args.GetReturnValue().Set(resolver->GetPromise());
+
+    auto reject = [&] (const char* message) {
+        resolver->Reject(
+            context,
+            Exception::TypeError(
+                String::NewFromUtf8(isolate, message).ToLocalChecked())).FromJust();
+    };
+
+    if(args.Length() < 1 || !args[0]->IsString())
+        return reject("mrl should be string");
+
+    if(!contextData->libvlc) {
+        static const char* libvlcOpts[] = {
+            "--no-audio",
+            "--no-osd",
+            "--no-spu",
+            "--no-video-title-show",
+            "--no-snapshot-preview",
+            "--no-stats",
+        };
+        contextData->libvlc =
+            libvlc_new(sizeof(libvlcOpts) / sizeof(libvlcOpts[0]), libvlcOpts);
+        if(!contextData->libvlc)
+            return reject("failed to create libvlc instance");
+    }
+
+    std::unique_ptr<Job> job(new Job(contextData));
+    job->mrl = FromJsValue<std::string>(args[0]);
+
+    Local<Value> options = args[1];
+
+    Local<Value> threshold = GetProperty(options, "threshold");
+    if(threshold->IsNumber()) {
+        const double value = FromJsValue<double>(threshold);
+        if(!(value > 0 && value <= 1))
+            return reject("threshold should be in (0, 1] range");
+        job->threshold = value;
+    }
+
+    job->resolver.Reset(isolate, resolver);
+
+    contextData->pendingJobs.push_back(std::move(job));
+
+    startJobs(contextData);
+}
+
+void JsVlcSceneScanner::startJobs(ContextData* contextData)
+{
+    std::unique_lock<std::mutex> lock(contextData->guard);
+
+    while(contextData->runningJobs.size() < MaxParallelJobs && !contextData->pendingJobs.empty()) {
+        Job* job = contextData->pendingJobs.front().release();
+        contextData->pendingJobs.pop_front();
+
+        contextData->runningJobs.insert(job);
+
+        std::thread(runJob, job).detach();
+    }
+
+    if(contextData->runningJobs.empty())
+        uv_unref(reinterpret_cast<uv_handle_t*>(contextData->async));
+    else
+        uv_ref(reinterpret_cast<uv_handle_t*>(contextData->async));
+}
+
+void JsVlcSceneScanner::runJob(Job* job)
+{
+    job->succeeded = job->scanner.scan(job->mrl, job->threshold);
+
+    ContextData* contextData = job->contextData;
+
+    std::unique_lock<std::mutex> lock(contextData->guard);
+
+    //promise could be resolved only from main loop
+    if(!contextData->closed) {
+        contextData->finishedJobs.push_back(job);
+        uv_async_send(contextData->async);
+        return;
+    }
+
+    contextData->runningJobs.erase(job);
+    const bool lastJob = contextData->runningJobs.empty();
+
+    lock.unlock();
+
+    delete job;
+    if(lastJob)
+        delete contextData;
+}
+
+void JsVlcSceneScanner::completeJobs(ContextData* contextData)
+{
+    std::deque<Job*> finishedJobs;
+
+    contextData->guard.lock();
+    finishedJobs.swap(contextData->finishedJobs);
+    for(Job* job: finishedJobs)
+        contextData->runningJobs.erase(job);
+    contextData->guard.unlock();
+
+    for(Job* job: finishedJobs)
+        completeJob(job);
+
+    startJobs(contextData);
+}
+
+void JsVlcSceneScanner::completeJob(Job* finishedJob)
+{
+    using namespace v8;
+
+    std::unique_ptr<Job> job(finishedJob);
+
+    Isolate* isolate = Isolate::GetCurrent();
+    HandleScope scope(isolate);
+    Local<Context> context = isolate->GetCurrentContext();
+
+    //lets promise reactions run right after resolve
+    node::CallbackScope callbackScope(isolate, Object::New(isolate), { 0, 0 });
+
+    Local<Promise::Resolver> resolver = Local<Promise::Resolver>::New(isolate, job->resolver);
+
+    const VlcSceneScanner& scanner = job->scanner;
+
+    if(!job->succeeded) {
+        resolver->Reject(
+            context,
+            Exception::Error(
+                String::NewFromUtf8(isolate, scanner.error().c_str()).ToLocalChecked())).FromJust();
+    } else {
+        auto setProperty = [&] (Local<Object> object, const char* name, Local<Value> value) {
+            object->Set(
+                context,
+                String::NewFromUtf8(isolate, name, NewStringType::kInternalized).ToLocalChecked(),
+                value).FromJust();
+        };
+
+        const auto& scenes = scanner.scenes();
+        Local<Array> jsScenes = Array::New(isolate, static_cast<int>(scenes.size()));
+        for(unsigned i = 0; i < scenes.size(); ++i) {
+            Local<Object> jsScene = Object::New(isolate);
+            setProperty(jsScene, "time", Number::New(isolate, static_cast<double>(scenes[i].time)));
+            setProperty(jsScene, "score", Number::New(isolate, scenes[i].score));
+
+            jsScenes->Set(context, i, jsScene).FromJust();
+        }
+
+        Local<Object> jsIndex = Object::New(isolate);
+        setProperty(jsIndex, "length", Number::New(isolate, static_cast<double>(scanner.length())));
+        setProperty(jsIndex, "scenes", jsScenes);
+
+        resolver->Resolve(context, jsIndex).FromJust();
+    }
+}
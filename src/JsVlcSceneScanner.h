@@ -0,0 +1,33 @@
+#pragma once
+
+#include <node.h>
+
+///////////////////////////////////////////////////////////////////////////////
+//scanScenes(mrl, { threshold })
+//returns Promise resolved with { length, scenes } where scenes is array of { time, score },
+//first scene always starts at 0
+class JsVlcSceneScanner
+{
+public:
+    static void initJsApi(
+        const v8::Local<v8::Object>& exports,
+        const v8::Local<v8::Context>& context);
+
+private:
+    struct ContextData;
+    struct Job;
+
+    //every scan decodes whole media as fast as possible,
+    //so it already loads all cores by itself,
+    //and it's run on its own thread to not block libuv thread pool shared with fs and dns
+    static const unsigned MaxParallelJobs = 1;
+
+    static void jsScanScenes(const v8::FunctionCallbackInfo<v8::Value>& args);
+
+    static void startJobs(ContextData*);
+    //called from job thread
+    static void runJob(Job*);
+    //called from main loop for jobs finished meanwhile
+    static void completeJobs(ContextData*);
+    static void completeJob(Job*);
+};
@@ -0,0 +1,367 @@
+#include "JsVlcThumbnailer.h"
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <set>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include <node_buffer.h>
+#include <uv.h>
+
+#include "NodeTools.h"
+#include "VlcThumbnailer.h"
+
+///////////////////////////////////////////////////////////////////////////////
+struct JsVlcThumbnailer::ContextData
+{
+    ContextData() :
+        libvlc(nullptr), async(nullptr), closed(false) {}
+    ~ContextData();
+
+    libvlc_instance_t* libvlc;
+    std::deque<std::unique_ptr<Job> > pendingJobs;
+    //wakes up main loop when job is finished, it's closed on environment cleanup
+    uv_async_t* async;
+
+    std::mutex guard;
+    std::set<Job*> runningJobs; //guarded by guard
+    std::deque<Job*> finishedJobs; //guarded by guard
+    //environment is gone, but some jobs are still running,
+    //so last one deletes context, guarded by guard
+    bool closed;
+};
+
+JsVlcThumbnailer::ContextData::~ContextData()
+{
+    pendingJobs.clear();
+
+    if(libvlc)
+        libvlc_release(libvlc);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+struct JsVlcThumbnailer::Job
+{
+    Job(ContextData* contextData) :
+        contextData(contextData),
+        interval(0), width(0), height(0),
+        sprite(false), columns(0),
+        thumbnailer(contextData->libvlc),
+        succeeded(false), rows(0) {}
+
+    ContextData *const contextData;
+
+    std::string mrl;
+    std::vector<int64_t> times;
+    int64_t interval;
+    unsigned width;
+    unsigned height;
+    bool sprite;
+    unsigned columns;
+
+    v8::UniquePersistent<v8::Promise::Resolver> resolver;
+
+    //should be accessed only from job thread until job is completed
+    VlcThumbnailer thumbnailer;
+    bool succeeded;
+    std::vector<uint8_t> spriteSheet;
+    unsigned rows;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+void JsVlcThumbnailer::initJsApi(
+    const v8::Local<v8::Object>& exports,
+    const v8::Local<v8::Context>& context)
+{
+    using namespace v8;
+
+    Isolate* isolate = context->GetIsolate();
+
+    ContextData* contextData = new ContextData;
+
+    contextData->async = new uv_async_t;
+    contextData->async->data = contextData;
+    uv_async_init(
+        uv_default_loop(), contextData->async,
+        [] (uv_async_t* handle) {
+            completeJobs(static_cast<ContextData*>(handle->data));
+        });
+    //loop is kept alive only while there are running jobs
+    uv_unref(reinterpret_cast<uv_handle_t*>(contextData->async));
+
+    node::AddEnvironmentCleanupHook(
+        isolate,
+        [] (void* data) {
+            ContextData* contextData = static_cast<ContextData*>(data);
+            contextData->pendingJobs.clear();
+
+            std::unique_lock<std::mutex> lock(contextData->guard);
+
+            for(Job* job: contextData->finishedJobs) {
+                contextData->runningJobs.erase(job);
+                delete job;
+            }
+            contextData->finishedJobs.clear();
+
+            //running jobs still use libvlc instance, so last one will delete it,
+            //but promises are gone with environment
+            for(Job* job: contextData->runningJobs)
+                job->resolver.Reset();
+
+            contextData->closed = true;
+            const bool running = !contextData->runningJobs.empty();
+
+            lock.unlock();
+
+            //job threads don't touch async after context is closed
+            uv_close(
+                reinterpret_cast<uv_handle_t*>(contextData->async),
+                [] (uv_handle_t* handle) {
+                    delete reinterpret_cast<uv_async_t*>(handle);
+                });
+
+            if(!running)
+                delete contextData;
+        }, contextData);
+
+    Local<FunctionTemplate> functionTemplate =
+        FunctionTemplate::New(
+            isolate,
+            jsExtractThumbnails,
+            External::New(isolate, contextData));
+
+    exports->Set(
+        context,
+        String::NewFromUtf8(isolate, "extractThumbnails", NewStringType::kInternalized).ToLocalChecked(),
+        functionTemplate->GetFunction(context).ToLocalChecked()).FromJust();
+}
+
+void JsVlcThumbnailer::jsExtractThumbnails(const v8::FunctionCallbackInfo<v8::Value>& args)
+{
+    using namespace v8;
+
+    Isolate* isolate = Isolate::GetCurrent();
+    Local<Context> context = isolate->GetCurrentContext();
+
+    ContextData* contextData =
+        static_cast<ContextData*>(args.Data().As<External>()->Value());
+
+    Local<Promise::Resolver> resolver = Promise::Resolver::New(context).ToLocalChecked();
+    args.GetReturnValue().Set(resolver->GetPromise());
+
+    auto reject = [&] (const char* message) {
+        resolver->Reject(
+            context,
+            Exception::TypeError(
+                String::NewFromUtf8(isolate, message).ToLocalChecked())).FromJust();
+    };
+
+    if(args.Length() < 1 || !args[0]->IsString())
+        return reject("mrl should be string");
+
+    if(!contextData->libvlc) {
+        static const char* libvlcOpts[] = {
+            "--no-audio",
+            "--no-osd",
+            "--no-spu",
+            "--no-video-title-show",
+            "--no-snapshot-preview",
+            "--no-stats",
+        };
+        contextData->libvlc =
+            libvlc_new(sizeof(libvlcOpts) / sizeof(libvlcOpts[0]), libvlcOpts);
+        if(!contextData->libvlc)
+            return reject("failed to create libvlc instance");
+    }
+
+    std::unique_ptr<Job> job(new Job(contextData));
+    job->mrl = FromJsValue<std::string>(args[0]);
+
+    Local<Value> options = args[1];
+
+    Local<Value> times = GetProperty(options, "times");
+    if(times->IsArray()) {
+        Local<Array> timesArray = Local<Array>::Cast(times);
+        for(unsigned i = 0; i < timesArray->Length(); ++i) {
+            Local<Value> time = timesArray->Get(context, i).ToLocalChecked();
+            if(time->IsNumber() && FromJsValue<double>(time) >= 0)
+                job->times.push_back(static_cast<int64_t>(FromJsValue<double>(time)));
+        }
+    }
+
+    Local<Value> interval = GetProperty(options, "interval");
+    if(interval->IsNumber() && FromJsValue<double>(interval) > 0)
+        job->interval = static_cast<int64_t>(FromJsValue<double>(interval));
+
+    if(job->times.empty() && 0 == job->interval)
+        return reject("times or interval should be specified");
+
+    Local<Value> width = GetProperty(options, "width");
+    if(width->IsUint32())
+        job->width = FromJsValue<unsigned>(width);
+
+    Local<Value> height = GetProperty(options, "height");
+    if(height->IsUint32())
+        job->height = FromJsValue<unsigned>(height);
+
+    Local<Value> format = GetProperty(options, "format");
+    if(format->IsString())
+        job->sprite = "sprite" == FromJsValue<std::string>(format);
+
+    Local<Value> columns = GetProperty(options, "columns");
+    if(columns->IsUint32())
+        job->columns = FromJsValue<unsigned>(columns);
+
+    job->resolver.Reset(isolate, resolver);
+
+    contextData->pendingJobs.push_back(std::move(job));
+
+    startJobs(contextData);
+}
+
+void JsVlcThumbnailer::startJobs(ContextData* contextData)
+{
+    std::unique_lock<std::mutex> lock(contextData->guard);
+
+    while(contextData->runningJobs.size() < MaxParallelJobs && !contextData->pendingJobs.empty()) {
+        Job* job = contextData->pendingJobs.front().release();
+        contextData->pendingJobs.pop_front();
+
+        contextData->runningJobs.insert(job);
+
+        std::thread(runJob, job).detach();
+    }
+
+    if(contextData->runningJobs.empty())
+        uv_unref(reinterpret_cast<uv_handle_t*>(contextData->async));
+    else
+        uv_ref(reinterpret_cast<uv_handle_t*>(contextData->async));
+}
+
+void JsVlcThumbnailer::runJob(Job* job)
+{
+    job->succeeded =
+        job->thumbnailer.extract(
+            job->mrl,
+            job->times, job->interval,
+            job->width, job->height);
+
+    if(job->succeeded && job->sprite)
+        job->spriteSheet = job->thumbnailer.spriteSheet(&job->columns, &job->rows);
+
+    ContextData* contextData = job->contextData;
+
+    std::unique_lock<std::mutex> lock(contextData->guard);
+
+    //promise could be resolved only from main loop
+    if(!contextData->closed) {
+        contextData->finishedJobs.push_back(job);
+        uv_async_send(contextData->async);
+        return;
+    }
+
+    contextData->runningJobs.erase(job);
+    const bool lastJob = contextData->runningJobs.empty();
+
+    lock.unlock();
+
+    delete job;
+    if(lastJob)
+        delete contextData;
+}
+
+void JsVlcThumbnailer::completeJobs(ContextData* contextData)
+{
+    std::deque<Job*> finishedJobs;
+
+    contextData->guard.lock();
+    finishedJobs.swap(contextData->finishedJobs);
+    for(Job* job: finishedJobs)
+        contextData->runningJobs.erase(job);
+    contextData->guard.unlock();
+
+    for(Job* job: finishedJobs)
+        completeJob(job);
+
+    startJobs(contextData);
+}
+
+void JsVlcThumbnailer::completeJob(Job* finishedJob)
+{
+    using namespace v8;
+
+    std::unique_ptr<Job> job(finishedJob);
+
+    Isolate* isolate = Isolate::GetCurrent();
+    HandleScope scope(isolate);
+    Local<Context> context = isolate->GetCurrentContext();
+
+    //lets promise reactions run right after resolve
+    node::CallbackScope callbackScope(isolate, Object::New(isolate), { 0, 0 });
+
+    Local<Promise::Resolver> resolver = Local<Promise::Resolver>::New(isolate, job->resolver);
+
+    const VlcThumbnailer& thumbnailer = job->thumbnailer;
+
+    if(!job->succeeded) {
+        resolver->Reject(
+            context,
+            Exception::Error(
+                String::NewFromUtf8(isolate, thumbnailer.error().c_str()).ToLocalChecked())).FromJust();
+    } else {
+        auto setProperty = [&] (Local<Object> object, const char* name, Local<Value> value) {
+            object->Set(
+                context,
+                String::NewFromUtf8(isolate, name, NewStringType::kInternalized).ToLocalChecked(),
+                value).FromJust();
+        };
+
+        const auto& thumbnails = thumbnailer.thumbnails();
+        Local<Integer> jsWidth = Integer::NewFromUnsigned(isolate, thumbnailer.width());
+        Local<Integer> jsHeight = Integer::NewFromUnsigned(isolate, thumbnailer.height());
+
+        if(job->sprite) {
+            Local<Array> jsTimes = Array::New(isolate, static_cast<int>(thumbnails.size()));
+            for(unsigned i = 0; i < thumbnails.size(); ++i)
+                jsTimes->Set(context, i, Number::New(isolate, static_cast<double>(thumbnails[i].time))).FromJust();
+
+            Local<Object> jsSprite = Object::New(isolate);
+            setProperty(jsSprite, "width", Integer::NewFromUnsigned(isolate, thumbnailer.width() * job->columns));
+            setProperty(jsSprite, "height", Integer::NewFromUnsigned(isolate, thumbnailer.height() * job->rows));
+            setProperty(jsSprite, "tileWidth", jsWidth);
+            setProperty(jsSprite, "tileHeight", jsHeight);
+            setProperty(jsSprite, "columns", Integer::NewFromUnsigned(isolate, job->columns));
+            setProperty(jsSprite, "rows", Integer::NewFromUnsigned(isolate, job->rows));
+            setProperty(jsSprite, "times", jsTimes);
+            setProperty(
+                jsSprite, "data",
+                node::Buffer::Copy(
+                    isolate,
+                    reinterpret_cast<const char*>(job->spriteSheet.data()),
+                    job->spriteSheet.size()).ToLocalChecked());
+
+            resolver->Resolve(context, jsSprite).FromJust();
+        } else {
+            Local<Array> jsThumbnails = Array::New(isolate, static_cast<int>(thumbnails.size()));
+            for(unsigned i = 0; i < thumbnails.size(); ++i) {
+                Local<Object> jsThumbnail = Object::New(isolate);
+                setProperty(jsThumbnail, "time", Number::New(isolate, static_cast<double>(thumbnails[i].time)));
+                setProperty(jsThumbnail, "width", jsWidth);
+                setProperty(jsThumbnail, "height", jsHeight);
+                setProperty(
+                    jsThumbnail, "data",
+                    node::Buffer::Copy(
+                        isolate,
+                        reinterpret_cast<const char*>(thumbnails[i].data.data()),
+                        thumbnails[i].data.size()).ToLocalChecked());
+
+                jsThumbnails->Set(context, i, jsThumbnail).FromJust();
+            }
+
+            resolver->Resolve(context, jsThumbnails).FromJust();
+        }
+    }
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <node.h>
+
+///////////////////////////////////////////////////////////////////////////////
+//extractThumbnails(mrl, { times | interval, width, height, format, columns })
+//returns Promise resolved with array of { time, width, height, data } RV32 frames,
+//or with { width, height, tileWidth, tileHeight, columns, rows, times, data } if format is "sprite"
+class JsVlcThumbnailer
+{
+public:
+    static void initJsApi(
+        const v8::Local<v8::Object>& exports,
+        const v8::Local<v8::Context>& context);
+
+private:
+    struct ContextData;
+    struct Job;
+
+    //every job blocks its own thread for up to VlcThumbnailer::FrameTimeout per frame,
+    //so jobs are not run in libuv thread pool shared with fs and dns,
+    //and only few decoders run at once
+    static const unsigned MaxParallelJobs = 2;
+
+    static void jsExtractThumbnails(const v8::FunctionCallbackInfo<v8::Value>& args);
+
+    static void startJobs(ContextData*);
+    //called from job thread
+    static void runJob(Job*);
+    //called from main loop for jobs finished meanwhile
+    static void completeJobs(ContextData*);
+    static void completeJob(Job*);
+};
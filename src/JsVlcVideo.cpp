@@ -3,12 +3,14 @@
 #include "NodeTools.h"
 #include "JsVlcPlayer.h"
 #include "JsVlcDeinterlace.h"
+#include "JsVlcReplay.h"
 
 v8::Persistent<v8::Function> JsVlcVideo::_jsConstructor;
 
 void JsVlcVideo::initJsApi()
 {
     JsVlcDeinterlace::initJsApi();
+    JsVlcReplay::initJsApi();
 
     using namespace v8;
 
@@ -25,8 +27,10 @@ void JsVlcVideo::initJsApi()
     instanceTemplate->SetInternalFieldCount(1);
 
     SET_RO_PROPERTY(instanceTemplate, "count", &JsVlcVideo::count);
+    SET_RO_PROPERTY(instanceTemplate, "adaptiveScale", &JsVlcVideo::adaptiveScale);
 
     SET_RO_PROPERTY(instanceTemplate, "deinterlace", &JsVlcVideo::deinterlace);
+    SET_RO_PROPERTY(instanceTemplate, "replay", &JsVlcVideo::replay);
 
     SET_RW_PROPERTY(instanceTemplate, "track", &JsVlcVideo::track, &JsVlcVideo::setTrack);
 
@@ -36,6 +40,18 @@ void JsVlcVideo::initJsApi()
     SET_RW_PROPERTY(instanceTemplate, "saturation", &JsVlcVideo::saturation, &JsVlcVideo::setSaturation);
     SET_RW_PROPERTY(instanceTemplate, "gamma", &JsVlcVideo::gamma, &JsVlcVideo::setGamma);
 
+    SET_RW_PROPERTY(instanceTemplate, "outputSize", &JsVlcVideo::outputSize, &JsVlcVideo::setOutputSize);
+    SET_RW_PROPERTY(instanceTemplate, "crop", &JsVlcVideo::crop, &JsVlcVideo::setCrop);
+    SET_RW_PROPERTY(instanceTemplate, "tensorOutput", &JsVlcVideo::tensorOutput, &JsVlcVideo::setTensorOutput);
+    SET_RW_PROPERTY(instanceTemplate, "pullMode", &JsVlcVideo::pullMode, &JsVlcVideo::setPullMode);
+    SET_RW_PROPERTY(instanceTemplate, "adaptiveScaling", &JsVlcVideo::adaptiveScaling, &JsVlcVideo::setAdaptiveScaling);
+
+    SET_METHOD(constructorTemplate, "snapshot", &JsVlcVideo::snapshot);
+    SET_METHOD(constructorTemplate, "startRawRecording", &JsVlcVideo::startRawRecording);
+    SET_METHOD(constructorTemplate, "stopRawRecording", &JsVlcVideo::stopRawRecording);
+    SET_METHOD(constructorTemplate, "acquireLatestFrame", &JsVlcVideo::acquireLatestFrame);
+    SET_METHOD(constructorTemplate, "release", &JsVlcVideo::release);
+
     Local<Function> constructor = constructorTemplate->GetFunction(context).ToLocalChecked();
     _jsConstructor.Reset(isolate, constructor);
 }
@@ -88,6 +104,7 @@ JsVlcVideo::JsVlcVideo(v8::Local<v8::Object>& thisObject, JsVlcPlayer* jsPlayer)
     Wrap(thisObject);
 
     _jsDeinterlace = JsVlcDeinterlace::create(*jsPlayer);
+    _jsReplay = JsVlcReplay::create(*jsPlayer);
 }
 
 unsigned JsVlcVideo::count()
@@ -159,3 +176,88 @@ v8::Local<v8::Object> JsVlcVideo::deinterlace()
 {
     return v8::Local<v8::Object>::New(v8::Isolate::GetCurrent(), _jsDeinterlace);
 }
+
+v8::Local<v8::Object> JsVlcVideo::replay()
+{
+    return v8::Local<v8::Object>::New(v8::Isolate::GetCurrent(), _jsReplay);
+}
+
+v8::Local<v8::Value> JsVlcVideo::outputSize()
+{
+    return _jsPlayer->videoOutputSize();
+}
+
+void JsVlcVideo::setOutputSize(v8::Local<v8::Value> outputSize)
+{
+    _jsPlayer->setVideoOutputSize(outputSize);
+}
+
+v8::Local<v8::Value> JsVlcVideo::crop()
+{
+    return _jsPlayer->videoCrop();
+}
+
+void JsVlcVideo::setCrop(v8::Local<v8::Value> crop)
+{
+    _jsPlayer->setVideoCrop(crop);
+}
+
+bool JsVlcVideo::adaptiveScaling()
+{
+    return _jsPlayer->adaptiveScaling();
+}
+
+void JsVlcVideo::setAdaptiveScaling(bool adaptiveScaling)
+{
+    _jsPlayer->setAdaptiveScaling(adaptiveScaling);
+}
+
+double JsVlcVideo::adaptiveScale()
+{
+    return _jsPlayer->adaptiveScale();
+}
+
+bool JsVlcVideo::pullMode()
+{
+    return _jsPlayer->pullMode();
+}
+
+void JsVlcVideo::setPullMode(bool pullMode)
+{
+    _jsPlayer->setPullMode(pullMode);
+}
+
+v8::Local<v8::Value> JsVlcVideo::acquireLatestFrame()
+{
+    return _jsPlayer->acquireLatestFrame();
+}
+
+bool JsVlcVideo::release()
+{
+    return _jsPlayer->releaseLatestFrame();
+}
+
+v8::Local<v8::Value> JsVlcVideo::tensorOutput()
+{
+    return _jsPlayer->tensorOutput();
+}
+
+void JsVlcVideo::setTensorOutput(v8::Local<v8::Value> tensorOutput)
+{
+    _jsPlayer->setTensorOutput(tensorOutput);
+}
+
+v8::Local<v8::Value> JsVlcVideo::snapshot(v8::Local<v8::Value> options)
+{
+    return _jsPlayer->snapshot(options);
+}
+
+bool JsVlcVideo::startRawRecording(const std::string& path)
+{
+    return _jsPlayer->startRawRecording(path);
+}
+
+v8::Local<v8::Value> JsVlcVideo::stopRawRecording()
+{
+    return _jsPlayer->stopRawRecording();
+}
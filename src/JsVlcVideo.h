@@ -35,6 +35,30 @@ public:
     void setGamma(double);
 
     v8::Local<v8::Object> deinterlace();
+    v8::Local<v8::Object> replay();
+
+    v8::Local<v8::Value> outputSize();
+    void setOutputSize(v8::Local<v8::Value>);
+
+    v8::Local<v8::Value> crop();
+    void setCrop(v8::Local<v8::Value>);
+
+    bool adaptiveScaling();
+    void setAdaptiveScaling(bool);
+    double adaptiveScale();
+
+    bool pullMode();
+    void setPullMode(bool);
+    v8::Local<v8::Value> acquireLatestFrame();
+    bool release();
+
+    v8::Local<v8::Value> tensorOutput();
+    void setTensorOutput(v8::Local<v8::Value>);
+
+    v8::Local<v8::Value> snapshot(v8::Local<v8::Value> options);
+
+    bool startRawRecording(const std::string& path);
+    v8::Local<v8::Value> stopRawRecording();
 
 private:
     static void jsCreate(const v8::FunctionCallbackInfo<v8::Value>& args);
@@ -46,4 +70,5 @@ private:
     JsVlcPlayer* _jsPlayer;
 
     v8::UniquePersistent<v8::Object> _jsDeinterlace;
+    v8::UniquePersistent<v8::Object> _jsReplay;
 };
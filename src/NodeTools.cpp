@@ -56,3 +56,27 @@ v8::Local<v8::Object> Require(
 
     return Local<Object>::Cast(RequireFunc(thisModule)->Call(context, global, 1, argv).ToLocalChecked());
 }
+
+v8::Local<v8::Value> GetProperty(
+    const v8::Local<v8::Value>& object,
+    const char* name)
+{
+    using namespace v8;
+
+    Isolate* isolate = Isolate::GetCurrent();
+    Local<Context> context = isolate->GetCurrentContext();
+
+    if(object.IsEmpty() || !object->IsObject())
+        return Undefined(isolate);
+
+    Local<Value> value;
+    if(!Local<Object>::Cast(object)->Get(
+            context,
+            String::NewFromUtf8(isolate, name, NewStringType::kInternalized).ToLocalChecked()
+        ).ToLocal(&value))
+    {
+        return Undefined(isolate);
+    }
+
+    return value;
+}
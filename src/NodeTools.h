@@ -222,6 +222,11 @@ v8::Local<v8::Object> Require(
     const v8::Local<v8::Object>& thisModule,
     const char* module);
 
+//returns undefined if value is not object or doesn't have such property
+v8::Local<v8::Value> GetProperty(
+    const v8::Local<v8::Value>& object,
+    const char* name);
+
 #define SET_RO_INDEXED_PROPERTY(objTemplate, member)         \
     objTemplate->SetIndexedPropertyHandler(                  \
         [] (uint32_t index,                                  \
@@ -0,0 +1,323 @@
+#include "RawVideoRecorder.h"
+
+#include <string.h>
+#include <math.h>
+
+///////////////////////////////////////////////////////////////////////////////
+struct RawVideoRecorder::Format
+{
+    static const unsigned MaxPlanes = 3;
+
+    const char* chroma;
+    //Y4M colorspace (with color range if it's not limited one),
+    //or nullptr if format can't be stored in Y4M
+    const char* y4mColorspace;
+    unsigned planeCount;
+    struct {
+        unsigned pixelBytes;
+        unsigned widthDivider;
+        unsigned heightDivider;
+    } planes[MaxPlanes];
+
+    unsigned rowBytes(unsigned plane, unsigned width) const
+    {
+        return (width + planes[plane].widthDivider - 1) / planes[plane].widthDivider *
+            planes[plane].pixelBytes;
+    }
+    unsigned rows(unsigned plane, unsigned height) const
+    {
+        return (height + planes[plane].heightDivider - 1) / planes[plane].heightDivider;
+    }
+};
+
+///////////////////////////////////////////////////////////////////////////////
+RawVideoRecorder::RawVideoRecorder() :
+    _file(nullptr), _indexFile(nullptr),
+    _running(false), _failed(false), _queueSize(0),
+    _writtenFrames(0), _droppedFrames(0), _writtenBytes(0), _frameRate(0),
+    _format(nullptr), _width(0), _height(0)
+{
+}
+
+RawVideoRecorder::~RawVideoRecorder()
+{
+    stop();
+}
+
+bool RawVideoRecorder::start(const std::string& path)
+{
+    if(_writerThread.joinable())
+        return false;
+
+    _file = fopen(path.c_str(), "wb");
+    if(!_file)
+        return false;
+
+    _indexFile = fopen((path + ".idx").c_str(), "w");
+    if(!_indexFile) {
+        fclose(_file);
+        _file = nullptr;
+        return false;
+    }
+
+    setvbuf(_file, nullptr, _IOFBF, WriteBufferSize);
+
+    _running = true;
+    _failed = false;
+    _writtenFrames = _droppedFrames = _writtenBytes = 0;
+    _error.clear();
+    _format = nullptr;
+    _width = _height = 0;
+
+    _writerThread = std::thread(&RawVideoRecorder::writerThread, this);
+
+    return true;
+}
+
+void RawVideoRecorder::stop()
+{
+    if(!_writerThread.joinable())
+        return;
+
+    _guard.lock();
+    _running = false;
+    _guard.unlock();
+    _queueChanged.notify_all();
+
+    _writerThread.join();
+
+    //both files should be closed even if first one fails
+    const bool fileClosed = fclose(_file) == 0;
+    const bool indexClosed = fclose(_indexFile) == 0;
+    if(!fileClosed || !indexClosed) {
+        std::unique_lock<std::mutex> lock(_guard);
+        fail(fileClosed ? "failed to close index file" : "failed to close file");
+    }
+    _file = nullptr;
+    _indexFile = nullptr;
+
+    _freeChunks.clear();
+}
+
+void RawVideoRecorder::setFrameRate(double frameRate)
+{
+    std::unique_lock<std::mutex> lock(_guard);
+    _frameRate = frameRate;
+}
+
+std::string RawVideoRecorder::y4mFrameRate(double frameRate)
+{
+    if(!(frameRate > 0) || frameRate > 1000)
+        return "0:0";
+
+    const double roundedRate = floor(frameRate + .5);
+    if(fabs(frameRate - roundedRate) < .001)
+        return std::to_string(static_cast<unsigned>(roundedRate)) + ":1";
+
+    //NTSC rates, like 29.97, are stored exactly
+    const double ntscRate = floor(frameRate * 1.001 + .5);
+    if(fabs(frameRate * 1.001 - ntscRate) < .005)
+        return std::to_string(static_cast<unsigned>(ntscRate) * 1000) + ":1001";
+
+    return std::to_string(static_cast<unsigned>(floor(frameRate * 1000 + .5))) + ":1000";
+}
+
+uint64_t RawVideoRecorder::writtenFrames()
+{
+    std::unique_lock<std::mutex> lock(_guard);
+    return _writtenFrames;
+}
+
+uint64_t RawVideoRecorder::droppedFrames()
+{
+    std::unique_lock<std::mutex> lock(_guard);
+    return _droppedFrames;
+}
+
+uint64_t RawVideoRecorder::writtenBytes()
+{
+    std::unique_lock<std::mutex> lock(_guard);
+    return _writtenBytes;
+}
+
+std::string RawVideoRecorder::error()
+{
+    std::unique_lock<std::mutex> lock(_guard);
+    return _error;
+}
+
+void RawVideoRecorder::fail(const std::string& error)
+{
+    if(_error.empty())
+        _error = error;
+    _failed = true;
+}
+
+void RawVideoRecorder::frame_consumer_cb(void* opaque, wcjs_frame* frame)
+{
+    static_cast<RawVideoRecorder*>(opaque)->addFrame(*wcjs_frame_get_view(frame));
+}
+
+void RawVideoRecorder::addFrame(const wcjs_frame_view& view)
+{
+    std::unique_lock<std::mutex> lock(_guard);
+
+    if(!_running || _failed) {
+        ++_droppedFrames;
+        return;
+    }
+
+    const bool firstFrame = !_format;
+    if(firstFrame) {
+        _format = findFormat(view.chroma);
+        if(!_format) {
+            ++_droppedFrames;
+            fail("unsupported chroma");
+            return;
+        }
+        _width = view.width;
+        _height = view.height;
+    } else if(memcmp(view.chroma, _format->chroma, sizeof(view.chroma)) != 0 ||
+              view.width != _width || view.height != _height) {
+        //neither Y4M nor index could describe geometry change
+        ++_droppedFrames;
+        return;
+    }
+
+    const Format& format = *_format;
+
+    std::string header;
+    if(format.y4mColorspace) {
+        if(firstFrame) {
+            header =
+                "YUV4MPEG2 W" + std::to_string(_width) + " H" + std::to_string(_height) +
+                " F" + y4mFrameRate(_frameRate) + " Ip A0:0 C" + format.y4mColorspace + "\n";
+        }
+        header += "FRAME\n";
+    }
+
+    size_t frameSize = 0;
+    for(unsigned p = 0; p < format.planeCount; ++p)
+        frameSize += static_cast<size_t>(format.rowBytes(p, _width)) * format.rows(p, _height);
+
+    const size_t chunkSize = header.size() + frameSize;
+    if(_queueSize + chunkSize > MaxQueueSize) {
+        ++_droppedFrames;
+        return;
+    }
+    _queueSize += chunkSize;
+
+    Chunk chunk;
+    if(!_freeChunks.empty()) {
+        chunk.data.swap(_freeChunks.back());
+        _freeChunks.pop_back();
+    }
+    chunk.headerSize = header.size();
+    chunk.sequence = view.sequence;
+    chunk.pts = view.pts;
+
+    //writer thread should not wait for copy
+    lock.unlock();
+
+    chunk.data.resize(chunkSize);
+    uint8_t* out = chunk.data.data();
+    memcpy(out, header.data(), header.size());
+    out += header.size();
+    for(unsigned p = 0; p < format.planeCount; ++p) {
+        const unsigned rowBytes = format.rowBytes(p, _width);
+        const unsigned rows = format.rows(p, _height);
+        const uint8_t* in = view.planes[p];
+        for(unsigned y = 0; y < rows; ++y) {
+            memcpy(out, in, rowBytes);
+            out += rowBytes;
+            in += view.pitches[p];
+        }
+    }
+
+    lock.lock();
+    _queue.push_back(std::move(chunk));
+    lock.unlock();
+
+    _queueChanged.notify_one();
+}
+
+void RawVideoRecorder::writerThread()
+{
+    std::unique_lock<std::mutex> lock(_guard);
+
+    bool indexHeaderWritten = false;
+    uint64_t offset = 0;
+
+    for(;;) {
+        _queueChanged.wait(lock, [this] () { return !_running || !_queue.empty(); });
+
+        if(_queue.empty())
+            break;
+
+        Chunk chunk = std::move(_queue.front());
+        _queue.pop_front();
+
+        const bool failed = _failed;
+        const Format& format = *_format;
+        const unsigned width = _width;
+        const unsigned height = _height;
+
+        lock.unlock();
+
+        bool written = false;
+        if(!failed) {
+            if(!indexHeaderWritten) {
+                fprintf(_indexFile, "# %.4s %ux%u\n", format.chroma, width, height);
+                indexHeaderWritten = true;
+            }
+
+            written = fwrite(chunk.data.data(), 1, chunk.data.size(), _file) == chunk.data.size();
+            if(written) {
+                fprintf(
+                    _indexFile, "%llu %lld %llu\n",
+                    static_cast<unsigned long long>(chunk.sequence),
+                    static_cast<long long>(chunk.pts),
+                    static_cast<unsigned long long>(offset + chunk.headerSize));
+                offset += chunk.data.size();
+            }
+        }
+
+        lock.lock();
+
+        _queueSize -= chunk.data.size();
+        if(written) {
+            ++_writtenFrames;
+            _writtenBytes += chunk.data.size();
+        } else {
+            ++_droppedFrames;
+            if(!failed)
+                fail("failed to write file");
+        }
+
+        _freeChunks.push_back(std::move(chunk.data));
+    }
+}
+
+const RawVideoRecorder::Format* RawVideoRecorder::findFormat(const char chroma[4])
+{
+    static const Format formats[] = {
+        { "I420", "420", 3, { { 1, 1, 1 }, { 1, 2, 2 }, { 1, 2, 2 } } },
+        { "I422", "422", 3, { { 1, 1, 1 }, { 1, 2, 1 }, { 1, 2, 1 } } },
+        { "I444", "444", 3, { { 1, 1, 1 }, { 1, 1, 1 }, { 1, 1, 1 } } },
+        { "J420", "420 XCOLORRANGE=FULL", 3, { { 1, 1, 1 }, { 1, 2, 2 }, { 1, 2, 2 } } },
+        { "J422", "422 XCOLORRANGE=FULL", 3, { { 1, 1, 1 }, { 1, 2, 1 }, { 1, 2, 1 } } },
+        { "J444", "444 XCOLORRANGE=FULL", 3, { { 1, 1, 1 }, { 1, 1, 1 }, { 1, 1, 1 } } },
+        { "NV12", nullptr, 2, { { 1, 1, 1 }, { 2, 2, 2 } } },
+        { "YUY2", nullptr, 1, { { 4, 2, 1 } } },
+        { "RV32", nullptr, 1, { { 4, 1, 1 } } },
+        { "RGBA", nullptr, 1, { { 4, 1, 1 } } },
+        { "RV16", nullptr, 1, { { 2, 1, 1 } } },
+    };
+
+    for(const Format& format: formats) {
+        if(0 == memcmp(format.chroma, chroma, 4))
+            return &format;
+    }
+
+    return nullptr;
+}
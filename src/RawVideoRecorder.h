@@ -0,0 +1,95 @@
+#pragma once
+
+#include <stdio.h>
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
+#include "FrameConsumer.h"
+
+///////////////////////////////////////////////////////////////////////////////
+//writes frames bit-exact to file from dedicated writer thread,
+//I4xx and J4xx frames are written as Y4M, other formats as raw frames without padding,
+//in both cases path + ".idx" gets "sequence pts offset" line for every written frame.
+//Decode thread only copies frame to queue, and drops it if queue is full,
+//so it never waits for disk
+class RawVideoRecorder
+{
+public:
+    //max size of frames waiting for writer thread
+    static const size_t MaxQueueSize = 128 * 1024 * 1024;
+
+    RawVideoRecorder();
+    ~RawVideoRecorder();
+
+    bool start(const std::string& path);
+    //writes all queued frames and closes files,
+    //could take long with full queue, so it shouldn't be called from gui thread
+    void stop();
+
+    //frames per second for Y4M header, which is written with first frame,
+    //0 means unknown
+    void setFrameRate(double);
+
+    //could be passed to VlcVideoOutput::addFrameConsumer with recorder as opaque
+    static void frame_consumer_cb(void* opaque, wcjs_frame*);
+
+    //should be called only from decode thread
+    void addFrame(const wcjs_frame_view&);
+
+    uint64_t writtenFrames();
+    uint64_t droppedFrames();
+    uint64_t writtenBytes();
+    //empty if there were no errors
+    std::string error();
+
+private:
+    struct Format;
+    struct Chunk
+    {
+        std::vector<uint8_t> data;
+        //size of Y4M frame header at beginning of data
+        size_t headerSize;
+        uint64_t sequence;
+        int64_t pts;
+    };
+
+    //large writes keep disk access sequential
+    static const size_t WriteBufferSize = 4 * 1024 * 1024;
+
+    static const Format* findFormat(const char chroma[4]);
+    //Y4M frame rate ratio, like "30000:1001"
+    static std::string y4mFrameRate(double);
+
+    void writerThread();
+    //should be called with _guard locked
+    void fail(const std::string& error);
+
+private:
+    FILE* _file;
+    FILE* _indexFile;
+    std::thread _writerThread;
+
+    std::mutex _guard;
+    std::condition_variable _queueChanged;
+    bool _running; //guarded by _guard
+    bool _failed; //guarded by _guard
+    std::deque<Chunk> _queue; //guarded by _guard
+    size_t _queueSize; //guarded by _guard
+    std::vector<std::vector<uint8_t> > _freeChunks; //guarded by _guard
+    uint64_t _writtenFrames; //guarded by _guard
+    uint64_t _droppedFrames; //guarded by _guard
+    uint64_t _writtenBytes; //guarded by _guard
+    std::string _error; //guarded by _guard
+    double _frameRate; //guarded by _guard
+
+    //geometry of first frame, frames with other one are dropped,
+    //guarded by _guard
+    const Format* _format;
+    unsigned _width;
+    unsigned _height;
+};
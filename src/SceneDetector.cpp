@@ -0,0 +1,55 @@
+#include "SceneDetector.h"
+
+#include <string.h>
+#include <stdlib.h>
+
+///////////////////////////////////////////////////////////////////////////////
+SceneDetector::SceneDetector()
+{
+    reset();
+}
+
+void SceneDetector::reset()
+{
+    memset(_prevGrid, 0, sizeof(_prevGrid));
+    _prevGridValid = false;
+    _sceneFrames = MinSceneFrames;
+}
+
+double SceneDetector::update(const uint8_t grid[GridSize], double threshold)
+{
+    double score = -1;
+
+    if(_prevGridValid && threshold > 0) {
+        //simple loop over bytes is vectorized by compiler (psadbw like code)
+        unsigned sad = 0;
+        for(unsigned i = 0; i < GridSize; ++i)
+            sad += abs(static_cast<int>(grid[i]) - static_cast<int>(_prevGrid[i]));
+
+        const double difference = sad / (255. * GridSize);
+        if(difference >= threshold && _sceneFrames >= MinSceneFrames) {
+            score = difference;
+            _sceneFrames = 0;
+        }
+    }
+
+    ++_sceneFrames;
+
+    memcpy(_prevGrid, grid, GridSize);
+    _prevGridValid = true;
+
+    return score;
+}
+
+void SceneDetector::downsampleLuma(
+    const uint8_t* luma, unsigned pitch, unsigned pixelStep,
+    unsigned width, unsigned height,
+    uint8_t grid[GridSize])
+{
+    downsample(
+        width, height,
+        [=] (unsigned x, unsigned y) -> unsigned {
+            return luma[y * pitch + x * pixelStep];
+        },
+        grid);
+}
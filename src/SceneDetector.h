@@ -0,0 +1,72 @@
+#pragma once
+
+#include <stdint.h>
+
+///////////////////////////////////////////////////////////////////////////////
+//detects scene cuts by sum of absolute differences
+//of downsampled luma of consecutive frames
+class SceneDetector
+{
+public:
+    static const unsigned GridWidth = 64;
+    static const unsigned GridHeight = 36;
+    static const unsigned GridSize = GridWidth * GridHeight;
+
+    //cuts closer than that to previous one are ignored,
+    //so flashes and glitches don't produce bursts of cuts
+    static const unsigned MinSceneFrames = 5;
+
+    SceneDetector();
+
+    //should be called before first frame of new media
+    void reset();
+
+    //threshold is from 0 to 1, 0 disables detection,
+    //returns difference score (from 0 to 1) if frame starts new scene, or negative value otherwise
+    double update(const uint8_t grid[GridSize], double threshold);
+
+    //averages luma(x, y) samples to grid,
+    //every cell is averaged from Samples x Samples points, so cost doesn't depend on frame size
+    template<typename Luma>
+    static void downsample(
+        unsigned width, unsigned height,
+        const Luma& luma,
+        uint8_t grid[GridSize]);
+
+    //pixelStep is distance between luma samples in row, in bytes
+    static void downsampleLuma(
+        const uint8_t* luma, unsigned pitch, unsigned pixelStep,
+        unsigned width, unsigned height,
+        uint8_t grid[GridSize]);
+
+private:
+    uint8_t _prevGrid[GridSize];
+    bool _prevGridValid;
+    unsigned _sceneFrames;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+template<typename Luma>
+void SceneDetector::downsample(
+    unsigned width, unsigned height,
+    const Luma& luma,
+    uint8_t grid[GridSize])
+{
+    const unsigned Samples = 4;
+
+    for(unsigned gy = 0; gy < GridHeight; ++gy) {
+        for(unsigned gx = 0; gx < GridWidth; ++gx) {
+            unsigned sum = 0;
+            for(unsigned sy = 0; sy < Samples; ++sy) {
+                const unsigned y = ((gy * Samples + sy) * 2 + 1) * height / (GridHeight * Samples * 2);
+                for(unsigned sx = 0; sx < Samples; ++sx) {
+                    const unsigned x = ((gx * Samples + sx) * 2 + 1) * width / (GridWidth * Samples * 2);
+                    sum += luma(x, y);
+                }
+            }
+
+            grid[gy * GridWidth + gx] =
+                static_cast<uint8_t>((sum + Samples * Samples / 2) / (Samples * Samples));
+        }
+    }
+}
@@ -0,0 +1,327 @@
+#include "TensorConverter.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+#include "YuvMatrix.h"
+
+///////////////////////////////////////////////////////////////////////////////
+//single color component of source frame,
+//samples are step bytes apart in row
+struct TensorConverter::Channel
+{
+    const uint8_t* data;
+    unsigned pitch;
+    unsigned step;
+    unsigned width;
+    unsigned height;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+TensorConverter::TensorConverter() :
+    _options(),
+    _running(false), _frame(nullptr), _tensorAvailable(false),
+    _nextSampleTime(0)
+{
+}
+
+TensorConverter::~TensorConverter()
+{
+    stop();
+}
+
+bool TensorConverter::start(const Options& options, const std::function<void()>& tensorReady)
+{
+    if(_workerThread.joinable())
+        return false;
+
+    if(0 == options.width || 0 == options.height)
+        return false;
+
+    _options = options;
+    _tensorReady = tensorReady;
+
+    _running = true;
+    _tensorAvailable = false;
+    _error.clear();
+    _nextSampleTime = 0;
+
+    _workerThread = std::thread(&TensorConverter::workerThread, this);
+
+    return true;
+}
+
+void TensorConverter::stop()
+{
+    if(!_workerThread.joinable())
+        return;
+
+    _guard.lock();
+    _running = false;
+    _guard.unlock();
+    _frameChanged.notify_all();
+
+    _workerThread.join();
+
+    if(_frame) {
+        wcjs_frame_release(_frame);
+        _frame = nullptr;
+    }
+}
+
+std::string TensorConverter::error()
+{
+    std::unique_lock<std::mutex> lock(_guard);
+    return _error;
+}
+
+void TensorConverter::frame_consumer_cb(void* opaque, wcjs_frame* frame)
+{
+    static_cast<TensorConverter*>(opaque)->addFrame(frame);
+}
+
+void TensorConverter::addFrame(wcjs_frame* frame)
+{
+    const wcjs_frame_view& view = *wcjs_frame_get_view(frame);
+
+    std::unique_lock<std::mutex> lock(_guard);
+
+    //worker is still busy with previous one
+    if(!_running || _frame)
+        return;
+
+    if(_options.fps > 0) {
+        const uint64_t interval = static_cast<uint64_t>(1e9 / _options.fps);
+        if(view.wallclock < _nextSampleTime)
+            return;
+
+        //don't try to catch up after pause or stall
+        _nextSampleTime =
+            view.wallclock - _nextSampleTime > interval ?
+                view.wallclock + interval :
+                _nextSampleTime + interval;
+    }
+
+    wcjs_frame_retain(frame);
+    _frame = frame;
+
+    lock.unlock();
+
+    _frameChanged.notify_one();
+}
+
+bool TensorConverter::takeTensor(Tensor* tensor)
+{
+    std::unique_lock<std::mutex> lock(_guard);
+
+    if(!_tensorAvailable)
+        return false;
+
+    std::swap(*tensor, _readyTensor);
+    _tensorAvailable = false;
+
+    return true;
+}
+
+void TensorConverter::workerThread()
+{
+    std::unique_lock<std::mutex> lock(_guard);
+
+    for(;;) {
+        _frameChanged.wait(lock, [this] () { return !_running || _frame; });
+
+        if(!_running)
+            break;
+
+        wcjs_frame* frame = _frame;
+
+        lock.unlock();
+
+        const wcjs_frame_view& view = *wcjs_frame_get_view(frame);
+        _tensor.sequence = view.sequence;
+        _tensor.pts = view.pts;
+        const bool converted = convert(view, &_tensor);
+
+        lock.lock();
+
+        //frame is released only here, so decode thread can't retain next one meanwhile
+        wcjs_frame_release(frame);
+        _frame = nullptr;
+
+        if(!converted) {
+            if(_error.empty())
+                _error = std::string("unsupported chroma ") + std::string(view.chroma, sizeof(view.chroma));
+            continue;
+        }
+
+        //not taken tensor is just replaced with newer one
+        std::swap(_tensor, _readyTensor);
+        _tensorAvailable = true;
+
+        lock.unlock();
+        _tensorReady();
+        lock.lock();
+    }
+}
+
+bool TensorConverter::convert(const wcjs_frame_view& view, Tensor* tensor)
+{
+    const unsigned width = view.width;
+    const unsigned height = view.height;
+
+    Channel channels[3];
+    bool yuv = true;
+
+    auto channel = [&] (unsigned plane, unsigned offset, unsigned step, unsigned widthDivider, unsigned heightDivider) {
+        return Channel {
+            view.planes[plane] + offset, view.pitches[plane], step,
+            (width + widthDivider - 1) / widthDivider,
+            (height + heightDivider - 1) / heightDivider };
+    };
+
+    //layout of full range J4xx is the same as of I4xx
+    if(0 == memcmp(view.chroma, "I420", 4) || 0 == memcmp(view.chroma, "J420", 4)) {
+        channels[0] = channel(0, 0, 1, 1, 1);
+        channels[1] = channel(1, 0, 1, 2, 2);
+        channels[2] = channel(2, 0, 1, 2, 2);
+    } else if(0 == memcmp(view.chroma, "I422", 4) || 0 == memcmp(view.chroma, "J422", 4)) {
+        channels[0] = channel(0, 0, 1, 1, 1);
+        channels[1] = channel(1, 0, 1, 2, 1);
+        channels[2] = channel(2, 0, 1, 2, 1);
+    } else if(0 == memcmp(view.chroma, "I444", 4) || 0 == memcmp(view.chroma, "J444", 4)) {
+        channels[0] = channel(0, 0, 1, 1, 1);
+        channels[1] = channel(1, 0, 1, 1, 1);
+        channels[2] = channel(2, 0, 1, 1, 1);
+    } else if(0 == memcmp(view.chroma, "NV12", 4)) {
+        channels[0] = channel(0, 0, 1, 1, 1);
+        channels[1] = channel(1, 0, 2, 2, 2);
+        channels[2] = channel(1, 1, 2, 2, 2);
+    } else if(0 == memcmp(view.chroma, "YUY2", 4)) {
+        channels[0] = channel(0, 0, 2, 1, 1);
+        channels[1] = channel(0, 1, 4, 2, 1);
+        channels[2] = channel(0, 3, 4, 2, 1);
+    } else if(0 == memcmp(view.chroma, "RV32", 4)) {
+        //B G R X in memory
+        channels[0] = channel(0, 2, 4, 1, 1);
+        channels[1] = channel(0, 1, 4, 1, 1);
+        channels[2] = channel(0, 0, 4, 1, 1);
+        yuv = false;
+    } else if(0 == memcmp(view.chroma, "RGBA", 4)) {
+        channels[0] = channel(0, 0, 4, 1, 1);
+        channels[1] = channel(0, 1, 4, 1, 1);
+        channels[2] = channel(0, 2, 4, 1, 1);
+        yuv = false;
+    } else {
+        return false;
+    }
+
+    const size_t size = static_cast<size_t>(_options.width) * _options.height;
+
+    float* planes[3];
+    for(unsigned c = 0; c < 3; ++c) {
+        _planes[c].resize(size);
+        planes[c] = _planes[c].data();
+        resize(channels[c], planes[c]);
+    }
+
+    //planes are converted in place to R, G, B,
+    //all loops below are simple enough to be vectorized by compiler
+    if(yuv) {
+        const YuvMatrix& m = yuvMatrix(0 != view.bt709, 'J' == view.chroma[0]);
+        const float yScale = m.yScale, yOffset = m.yOffset;
+        const float vr = m.vr, ug = m.ug, vg = m.vg, ub = m.ub;
+
+        float* r = planes[0];
+        float* g = planes[1];
+        float* b = planes[2];
+        for(size_t i = 0; i < size; ++i) {
+            const float y = yScale * (r[i] - yOffset);
+            const float u = g[i] - 128.f;
+            const float v = b[i] - 128.f;
+            r[i] = std::min(std::max(y + vr * v, 0.f), 255.f);
+            g[i] = std::min(std::max(y - ug * u - vg * v, 0.f), 255.f);
+            b[i] = std::min(std::max(y + ub * u, 0.f), 255.f);
+        }
+    }
+
+    const bool planar = Layout::NCHW == _options.layout;
+    const size_t channelStride = planar ? size : 1;
+    const size_t pixelStride = planar ? 1 : 3;
+
+    if(ElementType::Float32 == _options.type) {
+        tensor->data.resize(size * 3 * sizeof(float));
+        float* out = reinterpret_cast<float*>(tensor->data.data());
+
+        for(unsigned c = 0; c < 3; ++c) {
+            const float deviation = _options.std[c] != 0 ? _options.std[c] : 1.f;
+            const float scale = 1.f / (255.f * deviation);
+            const float bias = -_options.mean[c] / deviation;
+
+            const float* in = planes[c];
+            float* channelOut = out + c * channelStride;
+            for(size_t i = 0; i < size; ++i)
+                channelOut[i * pixelStride] = in[i] * scale + bias;
+        }
+    } else {
+        tensor->data.resize(size * 3);
+        uint8_t* out = tensor->data.data();
+
+        for(unsigned c = 0; c < 3; ++c) {
+            const float* in = planes[c];
+            uint8_t* channelOut = out + c * channelStride;
+            for(size_t i = 0; i < size; ++i)
+                channelOut[i * pixelStride] = static_cast<uint8_t>(in[i] + 0.5f);
+        }
+    }
+
+    return true;
+}
+
+//pixel centers are aligned, like in most of inference frameworks
+void TensorConverter::resize(const Channel& channel, float* out)
+{
+    const unsigned width = _options.width;
+    const unsigned height = _options.height;
+
+    auto sourceCoordinate = [] (unsigned d, unsigned srcSize, unsigned dstSize, unsigned* s0, unsigned* s1, float* weight) {
+        const float s =
+            std::max((d + 0.5f) * srcSize / dstSize - 0.5f, 0.f);
+        *s0 = std::min(static_cast<unsigned>(s), srcSize - 1);
+        *s1 = std::min(*s0 + 1, srcSize - 1);
+        *weight = *s1 != *s0 ? s - *s0 : 0.f;
+    };
+
+    //column offsets and weights don't depend on row
+    _columns[0].resize(width);
+    _columns[1].resize(width);
+    _columnWeights.resize(width);
+    for(unsigned dx = 0; dx < width; ++dx) {
+        unsigned x0, x1;
+        sourceCoordinate(dx, channel.width, width, &x0, &x1, &_columnWeights[dx]);
+        _columns[0][dx] = x0 * channel.step;
+        _columns[1][dx] = x1 * channel.step;
+    }
+
+    const unsigned* columns0 = _columns[0].data();
+    const unsigned* columns1 = _columns[1].data();
+    const float* columnWeights = _columnWeights.data();
+
+    for(unsigned dy = 0; dy < height; ++dy) {
+        unsigned y0, y1;
+        float rowWeight;
+        sourceCoordinate(dy, channel.height, height, &y0, &y1, &rowWeight);
+
+        const uint8_t* row0 = channel.data + static_cast<size_t>(y0) * channel.pitch;
+        const uint8_t* row1 = channel.data + static_cast<size_t>(y1) * channel.pitch;
+        float* rowOut = out + static_cast<size_t>(dy) * width;
+
+        for(unsigned dx = 0; dx < width; ++dx) {
+            const float top =
+                row0[columns0[dx]] + (row0[columns1[dx]] - row0[columns0[dx]]) * columnWeights[dx];
+            const float bottom =
+                row1[columns0[dx]] + (row1[columns1[dx]] - row1[columns0[dx]]) * columnWeights[dx];
+            rowOut[dx] = top + (bottom - top) * rowWeight;
+        }
+    }
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <functional>
+
+#include "FrameConsumer.h"
+
+///////////////////////////////////////////////////////////////////////////////
+//converts sampled frames to fixed size RGB tensor (batch of 1) for inference,
+//with bilinear resize and per channel normalization, on dedicated worker thread.
+//Decode thread only retains frame if worker is idle, so it never waits for conversion,
+//and at most one player frame buffer is blocked by converter
+class TensorConverter
+{
+public:
+    enum class Layout
+    {
+        NCHW = 0,
+        NHWC,
+    };
+
+    enum class ElementType
+    {
+        Float32 = 0, //(value / 255 - mean) / std
+        Uint8,       //0..255, mean and std are ignored
+    };
+
+    struct Options
+    {
+        unsigned width;
+        unsigned height;
+        Layout layout;
+        ElementType type;
+        float mean[3]; //R, G, B
+        float std[3];  //R, G, B
+        double fps;    //sampling rate, 0 - every frame worker could keep up with
+    };
+
+    struct Tensor
+    {
+        uint64_t sequence;
+        int64_t pts;
+        //width * height * 3 elements of Options::type
+        std::vector<uint8_t> data;
+    };
+
+    TensorConverter();
+    ~TensorConverter();
+
+    //tensorReady is called from worker thread when new tensor could be taken
+    bool start(const Options&, const std::function<void()>& tensorReady);
+    void stop();
+
+    const Options& options() const
+        { return _options; }
+
+    //could be passed to VlcVideoOutput::addFrameConsumer with converter as opaque
+    static void frame_consumer_cb(void* opaque, wcjs_frame*);
+
+    //should be called only from decode thread
+    void addFrame(wcjs_frame*);
+
+    //swaps latest tensor with given one, so its data is reused,
+    //returns false if there is no new tensor
+    bool takeTensor(Tensor*);
+
+    //empty if there were no errors
+    std::string error();
+
+private:
+    struct Channel;
+
+    void workerThread();
+    //returns false if frame chroma is not supported
+    bool convert(const wcjs_frame_view&, Tensor*);
+    void resize(const Channel&, float* out);
+
+private:
+    Options _options;
+    std::function<void()> _tensorReady;
+    std::thread _workerThread;
+
+    std::mutex _guard;
+    std::condition_variable _frameChanged;
+    bool _running; //guarded by _guard
+    wcjs_frame* _frame; //guarded by _guard
+    bool _tensorAvailable; //guarded by _guard
+    Tensor _readyTensor; //guarded by _guard
+    std::string _error; //guarded by _guard
+
+    //should be accessed only from decode thread
+    uint64_t _nextSampleTime;
+
+    //should be accessed only from worker thread
+    Tensor _tensor;
+    std::vector<float> _planes[3];
+    std::vector<unsigned> _columns[2];
+    std::vector<float> _columnWeights;
+};
@@ -0,0 +1,228 @@
+#include "VlcSceneScanner.h"
+
+#include <string.h>
+
+#include <chrono>
+#include <algorithm>
+
+///////////////////////////////////////////////////////////////////////////////
+VlcSceneScanner::VlcSceneScanner(libvlc_instance_t* libvlc) :
+    _libvlc(libvlc),
+    _threshold(0),
+    _scanState(ScanState::Idle), _decodedFrames(0),
+    _length(0)
+{
+}
+
+VlcSceneScanner::~VlcSceneScanner()
+{
+    if(_player.is_open()) {
+        libvlc_event_manager_t* eventManager =
+            libvlc_media_player_event_manager(_player.get_mp());
+        libvlc_event_detach(
+            eventManager, libvlc_MediaPlayerEndReached, player_event_wrapper, this);
+        libvlc_event_detach(
+            eventManager, libvlc_MediaPlayerEncounteredError, player_event_wrapper, this);
+
+        vlc::basic_vmem_wrapper::close();
+        _player.close();
+    }
+}
+
+bool VlcSceneScanner::scan(const std::string& mrl, double threshold)
+{
+    _scenes.clear();
+    _sceneFrames.clear();
+    _length = 0;
+    _error.clear();
+
+    if(!_player.is_open()) {
+        if(!_libvlc || !_player.open(_libvlc)) {
+            _error = "failed to create player";
+            return false;
+        }
+
+        libvlc_event_manager_t* eventManager =
+            libvlc_media_player_event_manager(_player.get_mp());
+        libvlc_event_attach(
+            eventManager, libvlc_MediaPlayerEndReached, player_event_wrapper, this);
+        libvlc_event_attach(
+            eventManager, libvlc_MediaPlayerEncounteredError, player_event_wrapper, this);
+
+        vlc::basic_vmem_wrapper::open(&_player);
+    }
+
+    libvlc_media_t* media =
+        mrl.find("://") != std::string::npos ?
+            libvlc_media_new_location(_libvlc, mrl.c_str()) :
+            libvlc_media_new_path(_libvlc, mrl.c_str());
+    if(!media) {
+        _error = "failed to open media";
+        return false;
+    }
+
+    //every frame should be decoded and displayed, but as fast as possible
+    libvlc_media_add_option(media, ":no-audio");
+    libvlc_media_add_option(media, ":no-spu");
+    libvlc_media_add_option(media, ":no-sub-autodetect-file");
+    libvlc_media_add_option(media, ":no-drop-late-frames");
+    libvlc_media_add_option(media, ":no-skip-frames");
+    libvlc_media_add_option(media, ":rate=32");
+
+    libvlc_media_player_set_media(_player.get_mp(), media);
+
+    _threshold = threshold;
+
+    _guard.lock();
+    _scanState = ScanState::Scanning;
+    _decodedFrames = 0;
+    _guard.unlock();
+
+    libvlc_media_player_play(_player.get_mp());
+
+    std::unique_lock<std::mutex> lock(_guard);
+    while(ScanState::Scanning == _scanState) {
+        const uint64_t decodedFrames = _decodedFrames;
+        _scanStateChanged.wait_for(
+            lock,
+            std::chrono::milliseconds(static_cast<int64_t>(StallTimeout)),
+            [&] () {
+                return ScanState::Scanning != _scanState || decodedFrames != _decodedFrames;
+            });
+
+        if(ScanState::Scanning == _scanState && decodedFrames == _decodedFrames) {
+            _scanState = ScanState::Failed;
+            _error = "decoding stalled";
+        }
+    }
+
+    const bool finished = ScanState::Finished == _scanState;
+    if(!finished && _error.empty())
+        _error = "failed to decode media";
+    _scanState = ScanState::Idle;
+    lock.unlock();
+
+    if(finished) {
+        _length = std::max<int64_t>(libvlc_media_player_get_length(_player.get_mp()), 0);
+
+        //media is decoded far ahead of playback clock,
+        //so scenes time is computed from index of displayed frame
+        const double duration = frameDuration(media, _decodedFrames);
+        for(size_t i = 0; i < _scenes.size(); ++i)
+            _scenes[i].time = static_cast<int64_t>(_sceneFrames[i] * duration + .5);
+    }
+
+    //should not be called with _guard locked since it waits for decode thread
+    libvlc_media_player_stop(_player.get_mp());
+
+    libvlc_media_release(media);
+
+    return finished;
+}
+
+double VlcSceneScanner::frameDuration(libvlc_media_t* media, uint64_t decodedFrames) const
+{
+    double duration = 0;
+
+    libvlc_media_track_t** tracks = nullptr;
+    const unsigned tracksCount = libvlc_media_tracks_get(media, &tracks);
+    for(unsigned i = 0; i < tracksCount; ++i) {
+        const libvlc_media_track_t* track = tracks[i];
+        if(libvlc_track_video == track->i_type &&
+           track->video->i_frame_rate_num && track->video->i_frame_rate_den)
+        {
+            duration = 1000. * track->video->i_frame_rate_den / track->video->i_frame_rate_num;
+            break;
+        }
+    }
+    if(tracks)
+        libvlc_media_tracks_release(tracks, tracksCount);
+
+    //frame rate is unknown, so assume it's constant over whole media
+    if(0 == duration && decodedFrames)
+        duration = static_cast<double>(_length) / decodedFrames;
+
+    return duration;
+}
+
+void VlcSceneScanner::player_event_wrapper(const libvlc_event_t* event, void* scanner)
+{
+    static_cast<VlcSceneScanner*>(scanner)->player_event(event);
+}
+
+void VlcSceneScanner::player_event(const libvlc_event_t* event)
+{
+    std::unique_lock<std::mutex> lock(_guard);
+
+    if(ScanState::Scanning != _scanState)
+        return;
+
+    _scanState =
+        libvlc_MediaPlayerEndReached == event->type ?
+            ScanState::Finished :
+            ScanState::Failed;
+    _scanStateChanged.notify_all();
+}
+
+unsigned VlcSceneScanner::video_format_cb(
+    char* chroma,
+    unsigned* width, unsigned* height,
+    unsigned* pitches, unsigned* lines)
+{
+    //libvlc scales frames right to detector grid,
+    //so Y plane is downsampled luma already
+    memcpy(chroma, "I420", 4);
+    *width = SceneDetector::GridWidth;
+    *height = SceneDetector::GridHeight;
+
+    pitches[0] = SceneDetector::GridWidth;
+    lines[0] = SceneDetector::GridHeight;
+    pitches[1] = pitches[2] = SceneDetector::GridWidth / 2;
+    lines[1] = lines[2] = SceneDetector::GridHeight / 2;
+
+    _frameBuffer.resize(pitches[0] * lines[0] + 2 * pitches[1] * lines[1]);
+
+    _sceneDetector.reset();
+
+    return 3;
+}
+
+void VlcSceneScanner::video_cleanup_cb()
+{
+}
+
+void* VlcSceneScanner::video_lock_cb(void** planes)
+{
+    uint8_t* buffer = _frameBuffer.data();
+    const unsigned ySize = SceneDetector::GridSize;
+    const unsigned uvSize = SceneDetector::GridSize / 4;
+
+    planes[0] = buffer;
+    planes[1] = buffer + ySize;
+    planes[2] = buffer + ySize + uvSize;
+
+    return nullptr;
+}
+
+void VlcSceneScanner::video_unlock_cb(void* /*picture*/, void *const * /*planes*/)
+{
+}
+
+void VlcSceneScanner::video_display_cb(void* /*picture*/)
+{
+    const double score = _sceneDetector.update(_frameBuffer.data(), _threshold);
+
+    std::unique_lock<std::mutex> lock(_guard);
+
+    if(ScanState::Scanning != _scanState)
+        return;
+
+    const uint64_t frame = _decodedFrames++;
+    if(0 == frame || score >= 0) {
+        //time is known only after scan is finished
+        _scenes.push_back(Scene { 0, 0 == frame ? 0 : score });
+        _sceneFrames.push_back(frame);
+    }
+
+    _scanStateChanged.notify_all();
+}
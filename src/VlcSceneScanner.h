@@ -0,0 +1,88 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+
+#include <libvlc_wrapper/vlc_basic_player.h>
+#include <libvlc_wrapper/vlc_vmem.h>
+
+#include "SceneDetector.h"
+
+///////////////////////////////////////////////////////////////////////////////
+//decodes whole media with headless player as fast as possible and collects scene cuts,
+//blocks caller, so should be used only from worker thread
+class VlcSceneScanner :
+    private vlc::basic_vmem_wrapper
+{
+public:
+    struct Scene
+    {
+        int64_t time; //milliseconds, from index of scene first frame and frame rate
+        double score; //difference with previous frame, 0 for first scene
+    };
+
+    //libvlc instance should be created without audio output
+    VlcSceneScanner(libvlc_instance_t*);
+    ~VlcSceneScanner();
+
+    //threshold is from 0 to 1
+    bool scan(const std::string& mrl, double threshold);
+
+    int64_t length() const
+        { return _length; }
+    const std::vector<Scene>& scenes() const
+        { return _scenes; }
+    const std::string& error() const
+        { return _error; }
+
+private:
+    //scan fails if no frames were decoded for that long
+    static const unsigned StallTimeout = 30000;
+
+    //in milliseconds, from video track frame rate or from media length
+    double frameDuration(libvlc_media_t*, uint64_t decodedFrames) const;
+
+    static void player_event_wrapper(const libvlc_event_t*, void*);
+    void player_event(const libvlc_event_t*);
+
+    unsigned video_format_cb(
+        char* chroma,
+        unsigned* width, unsigned* height,
+        unsigned* pitches, unsigned* lines) override;
+    void video_cleanup_cb() override;
+
+    void* video_lock_cb(void** planes) override;
+    void video_unlock_cb(void* picture, void *const * planes) override;
+    void video_display_cb(void* picture) override;
+
+private:
+    enum class ScanState
+    {
+        Idle = 0,
+        Scanning,
+        Finished,
+        Failed,
+    };
+
+    libvlc_instance_t* _libvlc;
+    vlc::basic_player _player;
+
+    double _threshold;
+
+    std::mutex _guard;
+    std::condition_variable _scanStateChanged;
+    ScanState _scanState; //guarded by _guard
+    uint64_t _decodedFrames; //guarded by _guard
+    std::vector<Scene> _scenes; //guarded by _guard while scanning
+    //index of first frame of every scene, guarded by _guard while scanning
+    std::vector<uint64_t> _sceneFrames;
+
+    //should be accessed only from decode thread
+    SceneDetector _sceneDetector;
+    std::vector<uint8_t> _frameBuffer;
+
+    int64_t _length;
+    std::string _error;
+};
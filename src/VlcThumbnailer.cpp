@@ -0,0 +1,298 @@
+#include "VlcThumbnailer.h"
+
+#include <string.h>
+
+#include <cassert>
+#include <cmath>
+#include <chrono>
+#include <algorithm>
+
+namespace {
+
+//vmem gets frames in storage size, so sample aspect ratio of video track
+//is required to not stretch anamorphic video
+bool sampleAspectRatio(libvlc_media_t* media, unsigned* num, unsigned* den)
+{
+    if(!media)
+        return false;
+
+    libvlc_media_track_t** tracks;
+    const unsigned count = libvlc_media_tracks_get(media, &tracks);
+
+    bool found = false;
+    for(unsigned i = 0; i < count && !found; ++i) {
+        const libvlc_media_track_t* track = tracks[i];
+        if(libvlc_track_video == track->i_type &&
+           track->video->i_sar_num && track->video->i_sar_den)
+        {
+            *num = track->video->i_sar_num;
+            *den = track->video->i_sar_den;
+            found = true;
+        }
+    }
+
+    if(count)
+        libvlc_media_tracks_release(tracks, count);
+
+    return found;
+}
+
+}
+
+///////////////////////////////////////////////////////////////////////////////
+VlcThumbnailer::VlcThumbnailer(libvlc_instance_t* libvlc) :
+    _libvlc(libvlc),
+    _requestedWidth(0), _requestedHeight(0),
+    _frameState(FrameState::Idle), _capturingThumbnail(nullptr), _media(nullptr),
+    _width(0), _height(0)
+{
+}
+
+VlcThumbnailer::~VlcThumbnailer()
+{
+    if(_player.is_open()) {
+        libvlc_event_manager_t* eventManager =
+            libvlc_media_player_event_manager(_player.get_mp());
+        libvlc_event_detach(
+            eventManager, libvlc_MediaPlayerEndReached, player_event_wrapper, this);
+        libvlc_event_detach(
+            eventManager, libvlc_MediaPlayerEncounteredError, player_event_wrapper, this);
+
+        vlc::basic_vmem_wrapper::close();
+        _player.close();
+    }
+}
+
+bool VlcThumbnailer::extract(
+    const std::string& mrl,
+    const std::vector<int64_t>& times, int64_t interval,
+    unsigned width, unsigned height)
+{
+    _thumbnails.clear();
+    _error.clear();
+
+    if(!_player.is_open()) {
+        if(!_libvlc || !_player.open(_libvlc)) {
+            _error = "failed to create player";
+            return false;
+        }
+
+        libvlc_event_manager_t* eventManager =
+            libvlc_media_player_event_manager(_player.get_mp());
+        libvlc_event_attach(
+            eventManager, libvlc_MediaPlayerEndReached, player_event_wrapper, this);
+        libvlc_event_attach(
+            eventManager, libvlc_MediaPlayerEncounteredError, player_event_wrapper, this);
+
+        vlc::basic_vmem_wrapper::open(&_player);
+    }
+
+    _requestedWidth = width;
+    _requestedHeight = height;
+
+    _guard.lock();
+    //all thumbnails have size of the first frame
+    _width = 0;
+    _height = 0;
+    _guard.unlock();
+
+    if(interval > 0) {
+        Thumbnail thumbnail;
+        const int64_t length = extractFrame(mrl, 0, &thumbnail);
+        if(length < 0) {
+            _error = "failed to decode first frame";
+            return false;
+        }
+
+        _thumbnails.push_back(std::move(thumbnail));
+
+        for(int64_t time = interval; time < length; time += interval) {
+            if(extractFrame(mrl, time, &thumbnail) >= 0)
+                _thumbnails.push_back(std::move(thumbnail));
+        }
+    } else {
+        for(int64_t time: times) {
+            Thumbnail thumbnail;
+            if(extractFrame(mrl, time, &thumbnail) >= 0)
+                _thumbnails.push_back(std::move(thumbnail));
+        }
+    }
+
+    if(_thumbnails.empty()) {
+        _error = "no frames at requested times";
+        return false;
+    }
+
+    return true;
+}
+
+int64_t VlcThumbnailer::extractFrame(const std::string& mrl, int64_t time, Thumbnail* thumbnail)
+{
+    libvlc_media_t* media =
+        mrl.find("://") != std::string::npos ?
+            libvlc_media_new_location(_libvlc, mrl.c_str()) :
+            libvlc_media_new_path(_libvlc, mrl.c_str());
+    if(!media)
+        return -1;
+
+    //start-time makes input seek before decoding starts,
+    //so only frames from nearest keyframe are decoded
+    const std::string startTime = ":start-time=" + std::to_string(time / 1000.);
+    libvlc_media_add_option(media, startTime.c_str());
+    libvlc_media_add_option(media, ":no-audio");
+    libvlc_media_add_option(media, ":no-spu");
+    libvlc_media_add_option(media, ":no-sub-autodetect-file");
+
+    libvlc_media_player_set_media(_player.get_mp(), media);
+
+    thumbnail->time = time;
+    thumbnail->data.clear();
+
+    _guard.lock();
+    _media = media;
+    _capturingThumbnail = thumbnail;
+    _frameState = FrameState::Waiting;
+    _guard.unlock();
+
+    libvlc_media_player_play(_player.get_mp());
+
+    std::unique_lock<std::mutex> lock(_guard);
+    _frameStateChanged.wait_for(
+        lock,
+        std::chrono::milliseconds(static_cast<int64_t>(FrameTimeout)),
+        [this] () { return FrameState::Waiting != _frameState; });
+
+    const bool captured = FrameState::Captured == _frameState;
+    _frameState = FrameState::Idle;
+    _capturingThumbnail = nullptr;
+    lock.unlock();
+
+    const int64_t length =
+        captured ? std::max<int64_t>(libvlc_media_player_get_length(_player.get_mp()), 0) : -1;
+
+    //should not be called with _guard locked since it waits for decode thread
+    libvlc_media_player_stop(_player.get_mp());
+
+    _guard.lock();
+    _media = nullptr;
+    _guard.unlock();
+
+    libvlc_media_release(media);
+
+    return length;
+}
+
+std::vector<uint8_t> VlcThumbnailer::spriteSheet(unsigned* columnsCount, unsigned* rows) const
+{
+    const unsigned count = static_cast<unsigned>(_thumbnails.size());
+
+    unsigned columns = *columnsCount;
+    if(0 == columns)
+        columns = static_cast<unsigned>(std::ceil(std::sqrt(static_cast<double>(count))));
+    columns = std::max(1u, std::min(columns, count));
+
+    *columnsCount = columns;
+    *rows = (count + columns - 1) / columns;
+
+    const size_t tilePitch = _width * 4;
+    const size_t sheetPitch = tilePitch * columns;
+
+    std::vector<uint8_t> sheet(sheetPitch * _height * *rows, 0);
+    for(unsigned i = 0; i < count; ++i) {
+        const uint8_t* tile = _thumbnails[i].data.data();
+        uint8_t* sheetTile =
+            sheet.data() + (i / columns) * sheetPitch * _height + (i % columns) * tilePitch;
+
+        for(unsigned line = 0; line < _height; ++line)
+            memcpy(sheetTile + line * sheetPitch, tile + line * tilePitch, tilePitch);
+    }
+
+    return sheet;
+}
+
+void VlcThumbnailer::player_event_wrapper(const libvlc_event_t* event, void* thumbnailer)
+{
+    static_cast<VlcThumbnailer*>(thumbnailer)->player_event(event);
+}
+
+void VlcThumbnailer::player_event(const libvlc_event_t* /*event*/)
+{
+    //requested time could be beyond media length, or media could be broken
+    std::unique_lock<std::mutex> lock(_guard);
+
+    if(FrameState::Waiting == _frameState) {
+        _frameState = FrameState::Failed;
+        _frameStateChanged.notify_all();
+    }
+}
+
+unsigned VlcThumbnailer::video_format_cb(
+    char* chroma,
+    unsigned* width, unsigned* height,
+    unsigned* pitches, unsigned* lines)
+{
+    std::unique_lock<std::mutex> lock(_guard);
+
+    if(0 == _width || 0 == _height) {
+        unsigned sarNum = 1, sarDen = 1;
+        sampleAspectRatio(_media, &sarNum, &sarDen);
+
+        //thumbnails have square pixels
+        const double displayWidth = static_cast<double>(*width) * sarNum / sarDen;
+
+        const double xScale =
+            _requestedWidth ? _requestedWidth / displayWidth : 0;
+        const double yScale =
+            _requestedHeight ? static_cast<double>(_requestedHeight) / *height : 0;
+
+        double scale;
+        if(0 == _requestedWidth && 0 == _requestedHeight)
+            scale = 1.;
+        else if(0 == _requestedWidth)
+            scale = yScale;
+        else if(0 == _requestedHeight)
+            scale = xScale;
+        else
+            scale = std::min(xScale, yScale);
+
+        _width = std::max(1u, static_cast<unsigned>(displayWidth * scale + .5));
+        _height = std::max(1u, static_cast<unsigned>(*height * scale + .5));
+    }
+
+    memcpy(chroma, "RV32", 4);
+    *width = _width;
+    *height = _height;
+    pitches[0] = _width * 4;
+    lines[0] = _height;
+
+    _frameBuffer.resize(pitches[0] * lines[0]);
+
+    return 1;
+}
+
+void VlcThumbnailer::video_cleanup_cb()
+{
+}
+
+void* VlcThumbnailer::video_lock_cb(void** planes)
+{
+    planes[0] = _frameBuffer.data();
+
+    return nullptr;
+}
+
+void VlcThumbnailer::video_unlock_cb(void* /*picture*/, void *const * /*planes*/)
+{
+}
+
+void VlcThumbnailer::video_display_cb(void* /*picture*/)
+{
+    std::unique_lock<std::mutex> lock(_guard);
+
+    if(FrameState::Waiting != _frameState)
+        return;
+
+    _capturingThumbnail->data = _frameBuffer;
+    _frameState = FrameState::Captured;
+    _frameStateChanged.notify_all();
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+
+#include <libvlc_wrapper/vlc_basic_player.h>
+#include <libvlc_wrapper/vlc_vmem.h>
+
+///////////////////////////////////////////////////////////////////////////////
+//extracts RV32 frames at given times with headless player,
+//blocks caller, so should be used only from worker thread
+class VlcThumbnailer :
+    private vlc::basic_vmem_wrapper
+{
+public:
+    struct Thumbnail
+    {
+        int64_t time; //milliseconds
+        std::vector<uint8_t> data; //width() * height() * 4 bytes
+    };
+
+    //libvlc instance should be created without audio output
+    VlcThumbnailer(libvlc_instance_t*);
+    ~VlcThumbnailer();
+
+    //width or height could be 0 to keep aspect ratio,
+    //if interval is not 0, times are generated for whole media length and given ones are ignored
+    bool extract(
+        const std::string& mrl,
+        const std::vector<int64_t>& times, int64_t interval,
+        unsigned width, unsigned height);
+
+    unsigned width() const
+        { return _width; }
+    unsigned height() const
+        { return _height; }
+    const std::vector<Thumbnail>& thumbnails() const
+        { return _thumbnails; }
+    const std::string& error() const
+        { return _error; }
+
+    //packs all thumbnails to one RV32 image of columns x rows tiles,
+    //columns could be 0 to make sheet close to square, and is updated to actual value
+    std::vector<uint8_t> spriteSheet(unsigned* columns, unsigned* rows) const;
+
+private:
+    //max time to wait for frame at given time
+    static const unsigned FrameTimeout = 10000;
+
+    //returns media length on success, or -1 if there is no frame at given time
+    int64_t extractFrame(const std::string& mrl, int64_t time, Thumbnail*);
+
+    static void player_event_wrapper(const libvlc_event_t*, void*);
+    void player_event(const libvlc_event_t*);
+
+    unsigned video_format_cb(
+        char* chroma,
+        unsigned* width, unsigned* height,
+        unsigned* pitches, unsigned* lines) override;
+    void video_cleanup_cb() override;
+
+    void* video_lock_cb(void** planes) override;
+    void video_unlock_cb(void* picture, void *const * planes) override;
+    void video_display_cb(void* picture) override;
+
+private:
+    enum class FrameState
+    {
+        Idle = 0,
+        Waiting,
+        Captured,
+        Failed,
+    };
+
+    libvlc_instance_t* _libvlc;
+    vlc::basic_player _player;
+
+    unsigned _requestedWidth;
+    unsigned _requestedHeight;
+
+    std::mutex _guard;
+    std::condition_variable _frameStateChanged;
+    FrameState _frameState; //guarded by _guard
+    Thumbnail* _capturingThumbnail; //guarded by _guard
+    //media being decoded, to get sample aspect ratio of its video track
+    libvlc_media_t* _media; //guarded by _guard
+    unsigned _width; //guarded by _guard
+    unsigned _height; //guarded by _guard
+
+    //should be accessed only from decode thread
+    std::vector<uint8_t> _frameBuffer;
+
+    std::vector<Thumbnail> _thumbnails;
+    std::string _error;
+};
@@ -3,351 +3,2625 @@
 #include <string.h>
 
 #include <cassert>
+#include <algorithm>
+
+#include "YuvMatrix.h"
 
 ///////////////////////////////////////////////////////////////////////////////
 VlcVideoOutput::VideoFrame::VideoFrame() :
-    _width(0), _height(0), _size(0),
-    _tmpFrameBuffer(nullptr), _frameBuffer(nullptr)
+    _width(0), _height(0), _size(0), _alignment(DefaultAlignment),
+    _fullRange(false), _bt709(false), _layouts(nullptr), _planeCount(0),
+    _tmpFrameBuffer(nullptr), _buffersReady(false), _coalescedFrames(0),
+    _publishedBuffer(nullptr), _readerBuffer(nullptr)
+{
+    for(unsigned p = 0; p < MaxPlanes; ++p) {
+        _planeOffsets[p] = 0;
+        _pitches[p] = 0;
+        _lines[p] = 0;
+        _bufferOffsets[p] = 0;
+        _bufferLines[p] = 0;
+    }
+
+    for(Buffer& buffer: _buffers) {
+        buffer.data = nullptr;
+        buffer.frameBuffer = nullptr;
+        buffer.state = BufferState::Free;
+        buffer.lockedState = BufferState::Free;
+        buffer.coalesced = false;
+        buffer.frameInfo = FrameInfo { 0, 0, -1, 0 };
+        buffer.pins = 0;
+        buffer.hasStats = false;
+    }
+}
+
+VlcVideoOutput::VideoFrame::~VideoFrame()
+{
+}
+
+void VlcVideoOutput::VideoFrame::setFrameBuffers(FrameBuffer* const frameBuffers[])
+{
+    std::unique_lock<std::mutex> lock(_guard);
+
+    if(!frameBuffers) {
+        //decoder could be writing to one of buffers right now,
+        //so data is kept and only not yet delivered frames are dropped
+        for(Buffer& buffer: _buffers) {
+            if(BufferState::Writing != buffer.state)
+                buffer.state = BufferState::Free;
+        }
+        _buffersReady = false;
+        //decoder waiting for free buffer will drop frame instead
+        _bufferReleased.notify_all();
+        return;
+    }
+
+    for(unsigned i = 0; i < BuffersCount; ++i) {
+        assert(frameBuffers[i]->capacity() >= size());
+        _buffers[i].data = frameBuffers[i]->data();
+        _buffers[i].frameBuffer = frameBuffers[i];
+        _buffers[i].state = BufferState::Free;
+    }
+
+    _buffersReady = true;
+}
+
+void VlcVideoOutput::VideoFrame::setBufferSync(
+    std::atomic<int32_t>* publishedBuffer,
+    const std::atomic<int32_t>* readerBuffer)
+{
+    std::unique_lock<std::mutex> lock(_guard);
+
+    _publishedBuffer = publishedBuffer;
+    _readerBuffer = readerBuffer;
+}
+
+void* VlcVideoOutput::VideoFrame::lockBuffer(
+    void** picture,
+    const std::atomic<bool>* waitEnabled)
+{
+    *picture = nullptr;
+
+    std::unique_lock<std::mutex> lock(_guard);
+
+    if(!_buffersReady)
+        return _tmpFrameBuffer;
+
+    auto findFreeBuffer = [this] () -> Buffer* {
+        const int32_t readerBuffer = _readerBuffer ? _readerBuffer->load() : -1;
+        for(Buffer& buffer: _buffers) {
+            if(readerBuffer != &buffer - _buffers &&
+               BufferState::Free == buffer.state && 0 == buffer.pins)
+            {
+                return &buffer;
+            }
+        }
+        return nullptr;
+    };
+
+    //no timeout, since dropping frame would break backpressure guarantee,
+    //so anything waiting for decode thread should cancel frame wait first
+    Buffer* freeBuffer = findFreeBuffer();
+    if(!freeBuffer && waitEnabled) {
+        _bufferReleased.wait(
+            lock,
+            [&] () {
+                if(!_buffersReady)
+                    return true;
+                freeBuffer = findFreeBuffer();
+                return freeBuffer || !waitEnabled->load();
+            });
+    }
+
+    if(freeBuffer) {
+        freeBuffer->lockedState = freeBuffer->state;
+        freeBuffer->coalesced = false;
+        freeBuffer->state = BufferState::Writing;
+        *picture = freeBuffer;
+        return freeBuffer->data;
+    }
+
+    //with backpressure not delivered frames should not be lost
+    if(waitEnabled)
+        return _tmpFrameBuffer;
+
+    const int32_t readerBuffer = _readerBuffer ? _readerBuffer->load() : -1;
+
+    Buffer* readyBuffer = nullptr;
+    for(Buffer& buffer: _buffers) {
+        if(readerBuffer != &buffer - _buffers &&
+           BufferState::Ready == buffer.state && 0 == buffer.pins)
+        {
+            readyBuffer = &buffer;
+        }
+    }
+
+    //renderer didn't pick up previous frame yet, so just overwrite it
+    if(readyBuffer) {
+        ++_coalescedFrames;
+        readyBuffer->lockedState = readyBuffer->state;
+        readyBuffer->coalesced = true;
+        readyBuffer->state = BufferState::Writing;
+        *picture = readyBuffer;
+        return readyBuffer->data;
+    }
+
+    //could happen only if libvlc holds few pictures at once,
+    //frame will be dropped
+    return _tmpFrameBuffer;
+}
+
+bool VlcVideoOutput::VideoFrame::displayBuffer(
+    void* picture,
+    const FrameInfo& frameInfo,
+    bool keepReady)
+{
+    Buffer* displayedBuffer = static_cast<Buffer*>(picture);
+    if(!displayedBuffer)
+        return false;
+
+    std::unique_lock<std::mutex> lock(_guard);
+
+    if(BufferState::Writing != displayedBuffer->state)
+        return false;
+
+    //previous frame was not picked up by renderer, so it will be skipped
+    if(!keepReady) {
+        for(Buffer& buffer: _buffers) {
+            if(BufferState::Ready == buffer.state) {
+                buffer.state = BufferState::Free;
+                ++_coalescedFrames;
+            }
+        }
+    }
+
+    displayedBuffer->state = BufferState::Ready;
+    displayedBuffer->frameInfo = frameInfo;
+
+    return true;
+}
+
+bool VlcVideoOutput::VideoFrame::discardBuffer(void* picture)
+{
+    Buffer* discardedBuffer = static_cast<Buffer*>(picture);
+    if(!discardedBuffer)
+        return false;
+
+    std::unique_lock<std::mutex> lock(_guard);
+
+    if(BufferState::Writing != discardedBuffer->state)
+        return false;
+
+    //if not yet delivered frame was overwritten, it's still there since content is the same
+    discardedBuffer->state = discardedBuffer->lockedState;
+
+    const bool ready = BufferState::Ready == discardedBuffer->state;
+
+    //so restored frame is not reported as skipped,
+    //unless counter was already taken meanwhile
+    if(ready && discardedBuffer->coalesced && _coalescedFrames)
+        --_coalescedFrames;
+    discardedBuffer->coalesced = false;
+
+    return ready;
+}
+
+namespace {
+
+//simple multiplicative hash over 8 byte words,
+//with 4 independent lanes to keep multiplier pipelined
+class FrameHasher
+{
+public:
+    FrameHasher() :
+        _lanes { 0x9e3779b97f4a7c15ULL, 0xbf58476d1ce4e5b9ULL, 0x94d049bb133111ebULL, 0xcbf29ce484222325ULL },
+        _size(0) {}
+
+    void update(const uint8_t* data, size_t size)
+    {
+        size_t i = 0;
+        for(; i + sizeof(uint64_t) * 4 <= size; i += sizeof(uint64_t) * 4) {
+            uint64_t words[4];
+            memcpy(words, data + i, sizeof(words));
+            for(unsigned l = 0; l < 4; ++l)
+                mix(&_lanes[l], words[l]);
+        }
+
+        for(; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+            uint64_t word;
+            memcpy(&word, data + i, sizeof(word));
+            mix(&_lanes[0], word);
+        }
+
+        if(i < size) {
+            uint64_t word = 0;
+            memcpy(&word, data + i, size - i);
+            mix(&_lanes[1], word);
+        }
+
+        _size += size;
+    }
+
+    uint64_t digest() const
+    {
+        uint64_t hash = _size;
+        for(uint64_t lane: _lanes)
+            mix(&hash, lane);
+
+        //murmur3 finalizer
+        hash ^= hash >> 33;
+        hash *= 0xff51afd7ed558ccdULL;
+        hash ^= hash >> 33;
+        hash *= 0xc4ceb9fe1a85ec53ULL;
+        hash ^= hash >> 33;
+
+        return hash;
+    }
+
+private:
+    static void mix(uint64_t* lane, uint64_t word)
+    {
+        *lane = (*lane ^ word) * 0x100000001b3ULL;
+        *lane ^= *lane >> 29;
+    }
+
+private:
+    uint64_t _lanes[4];
+    uint64_t _size;
+};
+
+}
+
+uint64_t VlcVideoOutput::VideoFrame::bufferHash(void* picture) const
+{
+    const Buffer* buffer = static_cast<const Buffer*>(picture);
+    const uint8_t* data = static_cast<const uint8_t*>(buffer->data);
+
+    FrameHasher hasher;
+    for(unsigned p = 0; p < _planeCount; ++p) {
+        const PlaneLayout& layout = _layouts[p];
+        const unsigned rowBytes =
+            (_width + layout.widthDivider - 1) / layout.widthDivider * layout.pixelBytes;
+        const unsigned rows = (_height + layout.heightDivider - 1) / layout.heightDivider;
+
+        const uint8_t* plane = data + _planeOffsets[p];
+        for(unsigned r = 0; r < rows; ++r)
+            hasher.update(plane + r * _pitches[p], rowBytes);
+    }
+
+    return hasher.digest();
+}
+
+namespace {
+
+//neighbour bytes are counted in separate tables,
+//so increments of the same counter don't wait for each other
+void countPlane(
+    const uint8_t* plane, unsigned pitch,
+    unsigned rowBytes, unsigned rows,
+    uint32_t histogram[256])
+{
+    uint32_t partial[4][256] = {};
+    for(unsigned r = 0; r < rows; ++r) {
+        const uint8_t* row = plane + r * pitch;
+
+        unsigned i = 0;
+        for(; i + 4 <= rowBytes; i += 4) {
+            ++partial[0][row[i]];
+            ++partial[1][row[i + 1]];
+            ++partial[2][row[i + 2]];
+            ++partial[3][row[i + 3]];
+        }
+        for(; i < rowBytes; ++i)
+            ++partial[0][row[i]];
+    }
+
+    for(unsigned v = 0; v < 256; ++v)
+        histogram[v] += partial[0][v] + partial[1][v] + partial[2][v] + partial[3][v];
+}
+
+double histogramMean(const uint32_t histogram[256])
+{
+    uint64_t count = 0;
+    uint64_t sum = 0;
+    for(unsigned v = 0; v < 256; ++v) {
+        count += histogram[v];
+        sum += static_cast<uint64_t>(histogram[v]) * v;
+    }
+
+    return count ? static_cast<double>(sum) / count : 0;
+}
+
+}
+
+void VlcVideoOutput::VideoFrame::updateBufferStats(void* picture, bool compute)
+{
+    Buffer* buffer = static_cast<Buffer*>(picture);
+
+    //buffer is locked for writing, so renderer doesn't look at it now
+    buffer->hasStats = compute;
+    if(compute)
+        computeStats(static_cast<const uint8_t*>(buffer->data), &buffer->stats);
+}
+
+void VlcVideoOutput::VideoFrame::computeStats(const uint8_t* data, FrameStats* stats) const
+{
+    memset(stats->histograms, 0, sizeof(stats->histograms));
+
+    uint32_t lumaHistogram[256] = {};
+
+    const uint8_t* plane0 = data + _planeOffsets[0];
+
+    switch(pixelFormat()) {
+        case PixelFormat::RV32:
+        case PixelFormat::RV16:
+        case PixelFormat::RGBA: {
+            stats->rgb = true;
+
+            const PixelFormat format = pixelFormat();
+            for(unsigned y = 0; y < _height; ++y) {
+                const uint8_t* row = plane0 + y * _pitches[0];
+                for(unsigned x = 0; x < _width; ++x) {
+                    unsigned r, g, b;
+                    if(PixelFormat::RV32 == format) {
+                        //B G R X in memory
+                        r = row[x * 4 + 2];
+                        g = row[x * 4 + 1];
+                        b = row[x * 4];
+                    } else if(PixelFormat::RGBA == format) {
+                        r = row[x * 4];
+                        g = row[x * 4 + 1];
+                        b = row[x * 4 + 2];
+                    } else {
+                        //little endian 5:6:5
+                        const unsigned rgb565 = row[x * 2] | (row[x * 2 + 1] << 8);
+                        r = (rgb565 >> 11 & 0x1f) * 255 / 31;
+                        g = (rgb565 >> 5 & 0x3f) * 255 / 63;
+                        b = (rgb565 & 0x1f) * 255 / 31;
+                    }
+
+                    ++stats->histograms[0][r];
+                    ++stats->histograms[1][g];
+                    ++stats->histograms[2][b];
+                    //BT.601 luma
+                    ++lumaHistogram[(77 * r + 150 * g + 29 * b) >> 8];
+                }
+            }
+            break;
+        }
+        case PixelFormat::YUY2: {
+            stats->rgb = false;
+
+            for(unsigned y = 0; y < _height; ++y) {
+                const uint8_t* row = plane0 + y * _pitches[0];
+                for(unsigned x = 0; x < _width; x += 2) {
+                    const uint8_t* macropixel = row + x * 2;
+                    ++stats->histograms[0][macropixel[0]];
+                    if(x + 1 < _width)
+                        ++stats->histograms[0][macropixel[2]];
+                    ++stats->histograms[1][macropixel[1]];
+                    ++stats->histograms[2][macropixel[3]];
+                }
+            }
+            break;
+        }
+        case PixelFormat::NV12: {
+            stats->rgb = false;
+
+            countPlane(plane0, _pitches[0], _width, _height, stats->histograms[0]);
+
+            const uint8_t* uvPlane = data + _planeOffsets[1];
+            for(unsigned y = 0; y < (_height + 1) / 2; ++y) {
+                const uint8_t* row = uvPlane + y * _pitches[1];
+                for(unsigned x = 0; x < (_width + 1) / 2; ++x) {
+                    ++stats->histograms[1][row[x * 2]];
+                    ++stats->histograms[2][row[x * 2 + 1]];
+                }
+            }
+            break;
+        }
+        default: {
+            stats->rgb = false;
+
+            for(unsigned p = 0; p < _planeCount && p < FrameStats::Channels; ++p) {
+                const PlaneLayout& layout = _layouts[p];
+                countPlane(
+                    data + _planeOffsets[p], _pitches[p],
+                    (_width + layout.widthDivider - 1) / layout.widthDivider,
+                    (_height + layout.heightDivider - 1) / layout.heightDivider,
+                    stats->histograms[p]);
+            }
+            break;
+        }
+    }
+
+    const uint32_t* luma = stats->rgb ? lumaHistogram : stats->histograms[0];
+
+    stats->lumaMin = 0;
+    while(stats->lumaMin < 255 && 0 == luma[stats->lumaMin])
+        ++stats->lumaMin;
+    stats->lumaMax = 255;
+    while(stats->lumaMax > 0 && 0 == luma[stats->lumaMax])
+        --stats->lumaMax;
+    stats->lumaMean = histogramMean(luma);
+
+    if(stats->rgb) {
+        for(unsigned c = 0; c < 3; ++c)
+            stats->averageRgb[c] = histogramMean(stats->histograms[c]);
+    } else {
+        //conversion is linear, so it could be applied to averages
+        const YuvMatrix& m = yuvMatrix(_bt709, _fullRange);
+        const double y = m.yScale * (stats->lumaMean - m.yOffset);
+        const double u = histogramMean(stats->histograms[1]) - 128;
+        const double v = histogramMean(stats->histograms[2]) - 128;
+
+        stats->averageRgb[0] = std::max(0., std::min(y + m.vr * v, 255.));
+        stats->averageRgb[1] = std::max(0., std::min(y - m.ug * u - m.vg * v, 255.));
+        stats->averageRgb[2] = std::max(0., std::min(y + m.ub * u, 255.));
+    }
+}
+
+void VlcVideoOutput::VideoFrame::lumaGrid(void* picture, uint8_t grid[SceneDetector::GridSize]) const
+{
+    const uint8_t* data =
+        static_cast<const uint8_t*>(picture ? static_cast<Buffer*>(picture)->data : _tmpFrameBuffer);
+    const uint8_t* plane0 = data + _planeOffsets[0];
+    const unsigned pitch0 = _pitches[0];
+
+    switch(pixelFormat()) {
+        case PixelFormat::RV32:
+            SceneDetector::downsample(
+                _width, _height,
+                [=] (unsigned x, unsigned y) -> unsigned {
+                    //B G R X in memory
+                    const uint8_t* bgrx = plane0 + y * pitch0 + x * 4;
+                    return (77 * bgrx[2] + 150 * bgrx[1] + 29 * bgrx[0]) >> 8;
+                },
+                grid);
+            break;
+        case PixelFormat::RGBA:
+            SceneDetector::downsample(
+                _width, _height,
+                [=] (unsigned x, unsigned y) -> unsigned {
+                    const uint8_t* rgba = plane0 + y * pitch0 + x * 4;
+                    return (77 * rgba[0] + 150 * rgba[1] + 29 * rgba[2]) >> 8;
+                },
+                grid);
+            break;
+        case PixelFormat::RV16:
+            SceneDetector::downsample(
+                _width, _height,
+                [=] (unsigned x, unsigned y) -> unsigned {
+                    //little endian 5:6:5, components are scaled to 6 bits
+                    const uint8_t* pixel = plane0 + y * pitch0 + x * 2;
+                    const unsigned rgb565 = pixel[0] | (pixel[1] << 8);
+                    return (77 * ((rgb565 >> 11) << 1) + 150 * (rgb565 >> 5 & 0x3f) + 29 * ((rgb565 & 0x1f) << 1)) >> 6;
+                },
+                grid);
+            break;
+        case PixelFormat::YUY2:
+            SceneDetector::downsampleLuma(plane0, pitch0, 2, _width, _height, grid);
+            break;
+        default:
+            //Y plane goes first in all planar formats
+            SceneDetector::downsampleLuma(plane0, pitch0, 1, _width, _height, grid);
+            break;
+    }
+}
+
+std::vector<std::shared_ptr<const VlcVideoOutput::VariantFrame> >&
+VlcVideoOutput::VideoFrame::bufferVariants(void* picture)
+{
+    //buffer is locked for writing, so renderer doesn't look at it now
+    return static_cast<Buffer*>(picture)->variants;
+}
+
+int VlcVideoOutput::VideoFrame::replaceDisplayedBuffer(const void* data, const FrameInfo& frameInfo)
+{
+    std::unique_lock<std::mutex> lock(_guard);
+
+    //decoder never writes to displayed buffer
+    for(unsigned i = 0; i < BuffersCount; ++i) {
+        Buffer& buffer = _buffers[i];
+        if(BufferState::Displayed != buffer.state || !buffer.data)
+            continue;
+
+        memcpy(buffer.data, data, _size);
+        buffer.frameInfo = frameInfo;
+        buffer.hasStats = false;
+        buffer.variants.clear();
+
+        return i;
+    }
+
+    return -1;
+}
+
+int VlcVideoOutput::VideoFrame::acquireBuffer(FrameInfo* frameInfo)
+{
+    std::unique_lock<std::mutex> lock(_guard);
+
+    //there could be few ready buffers only with backpressure
+    int readyBuffer = -1;
+    for(unsigned i = 0; i < BuffersCount; ++i) {
+        if(BufferState::Ready != _buffers[i].state)
+            continue;
+
+        if(readyBuffer < 0 ||
+           _buffers[i].frameInfo.sequence < _buffers[readyBuffer].frameInfo.sequence)
+        {
+            readyBuffer = static_cast<int>(i);
+        }
+    }
+
+    if(readyBuffer < 0)
+        return -1;
+
+    //consumer has to see new index before previous buffer could be reused
+    if(_publishedBuffer)
+        _publishedBuffer->store(readyBuffer);
+
+    for(Buffer& buffer: _buffers) {
+        if(BufferState::Displayed == buffer.state)
+            buffer.state = BufferState::Free;
+    }
+
+    _buffers[readyBuffer].state = BufferState::Displayed;
+    *frameInfo = _buffers[readyBuffer].frameInfo;
+
+    _bufferReleased.notify_all();
+
+    return readyBuffer;
+}
+
+uint64_t VlcVideoOutput::VideoFrame::takeCoalescedFrames()
+{
+    std::unique_lock<std::mutex> lock(_guard);
+
+    const uint64_t coalescedFrames = _coalescedFrames;
+    _coalescedFrames = 0;
+
+    return coalescedFrames;
+}
+
+bool VlcVideoOutput::VideoFrame::releaseDisplayedBuffer()
+{
+    std::unique_lock<std::mutex> lock(_guard);
+
+    for(Buffer& buffer: _buffers) {
+        if(BufferState::Displayed != buffer.state)
+            continue;
+
+        buffer.state = BufferState::Free;
+        _bufferReleased.notify_all();
+
+        return true;
+    }
+
+    return false;
+}
+
+void* VlcVideoOutput::VideoFrame::pinBuffer(void* picture)
+{
+    Buffer* buffer = static_cast<Buffer*>(picture);
+
+    std::unique_lock<std::mutex> lock(_guard);
+
+    ++buffer->pins;
+    ++buffer->frameBuffer->_pins;
+
+    return buffer->data;
+}
+
+void VlcVideoOutput::VideoFrame::unpinBuffer(void* picture)
+{
+    Buffer* buffer = static_cast<Buffer*>(picture);
+
+    std::unique_lock<std::mutex> lock(_guard);
+
+    assert(buffer->pins > 0);
+    --buffer->frameBuffer->_pins;
+    if(0 == --buffer->pins)
+        _bufferReleased.notify_all();
+}
+
+void VlcVideoOutput::VideoFrame::notifyBufferWaiters()
+{
+    std::unique_lock<std::mutex> lock(_guard);
+
+    _bufferReleased.notify_all();
+}
+
+void VlcVideoOutput::VideoFrame::fillBlack()
+{
+    std::unique_lock<std::mutex> lock(_guard);
+
+    for(Buffer& buffer: _buffers) {
+        if(!buffer.data || BufferState::Writing == buffer.state)
+            continue;
+
+        uint8_t* data = static_cast<uint8_t*>(buffer.data);
+        for(unsigned p = 0; p < _planeCount; ++p) {
+            const PlaneLayout& layout = _layouts[p];
+            uint8_t* plane = data + _bufferOffsets[p];
+            const unsigned planeSize = _pitches[p] * _bufferLines[p];
+            for(unsigned i = 0; i < planeSize; ++i)
+                plane[i] = layout.black[i % layout.pixelBytes];
+        }
+    }
+}
+
+bool VlcVideoOutput::VideoFrame::copyDisplayedBuffer(std::vector<uint8_t>* data)
+{
+    std::unique_lock<std::mutex> lock(_guard);
+
+    //decoder never writes to displayed buffer, but lock keeps it from being released
+    for(const Buffer& buffer: _buffers) {
+        if(BufferState::Displayed != buffer.state || !buffer.data)
+            continue;
+
+        const uint8_t* bufferData = static_cast<const uint8_t*>(buffer.data);
+        data->assign(bufferData, bufferData + _size);
+
+        return true;
+    }
+
+    return false;
+}
+
+namespace {
+
+inline unsigned clampColor(int value)
+{
+    return static_cast<unsigned>(std::max(0, std::min(value, 255)));
+}
+
+//BT.601 limited range, which is what decoders produce in most cases
+inline void yuvToRgb(int y, int u, int v, unsigned rgb[3])
+{
+    const int c = 298 * (y - 16);
+    const int d = u - 128;
+    const int e = v - 128;
+
+    rgb[0] = clampColor((c + 409 * e + 128) >> 8);
+    rgb[1] = clampColor((c - 100 * d - 208 * e + 128) >> 8);
+    rgb[2] = clampColor((c + 516 * d + 128) >> 8);
+}
+
+inline void rgbToYuv(int r, int g, int b, unsigned yuv[3])
+{
+    yuv[0] = clampColor(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+    yuv[1] = clampColor(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+    yuv[2] = clampColor(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+}
+
+//every destination pixel is average of source pixels it covers,
+//emit is called for destination pixels row by row
+template<typename Sample, typename Emit>
+void boxFilter(
+    unsigned srcWidth, unsigned srcHeight,
+    unsigned width, unsigned height,
+    const Sample& sample, const Emit& emit)
+{
+    for(unsigned dy = 0; dy < height; ++dy) {
+        const unsigned y0 = static_cast<unsigned>(static_cast<uint64_t>(dy) * srcHeight / height);
+        const unsigned y1 =
+            std::max(y0 + 1, static_cast<unsigned>(static_cast<uint64_t>(dy + 1) * srcHeight / height));
+
+        for(unsigned dx = 0; dx < width; ++dx) {
+            const unsigned x0 = static_cast<unsigned>(static_cast<uint64_t>(dx) * srcWidth / width);
+            const unsigned x1 =
+                std::max(x0 + 1, static_cast<unsigned>(static_cast<uint64_t>(dx + 1) * srcWidth / width));
+
+            unsigned sum[3] = { 0, 0, 0 };
+            for(unsigned y = y0; y < y1; ++y) {
+                for(unsigned x = x0; x < x1; ++x) {
+                    unsigned pixel[3];
+                    sample(x, y, pixel);
+                    sum[0] += pixel[0];
+                    sum[1] += pixel[1];
+                    sum[2] += pixel[2];
+                }
+            }
+
+            const unsigned count = (x1 - x0) * (y1 - y0);
+            for(unsigned c = 0; c < 3; ++c)
+                sum[c] = (sum[c] + count / 2) / count;
+
+            emit(sum);
+        }
+    }
+}
+
+}
+
+void VlcVideoOutput::VideoFrame::pixelRgb(
+    const uint8_t* data,
+    unsigned x, unsigned y,
+    unsigned rgb[3]) const
+{
+    const uint8_t* row = data + _planeOffsets[0] + y * _pitches[0];
+    switch(pixelFormat()) {
+        case PixelFormat::RV32: {
+            //B G R X in memory
+            const uint8_t* bgrx = row + x * 4;
+            rgb[0] = bgrx[2];
+            rgb[1] = bgrx[1];
+            rgb[2] = bgrx[0];
+            break;
+        }
+        case PixelFormat::RGBA: {
+            const uint8_t* rgba = row + x * 4;
+            rgb[0] = rgba[0];
+            rgb[1] = rgba[1];
+            rgb[2] = rgba[2];
+            break;
+        }
+        case PixelFormat::RV16: {
+            //little endian 5:6:5
+            const unsigned rgb565 = row[x * 2] | (row[x * 2 + 1] << 8);
+            rgb[0] = (rgb565 >> 11 & 0x1f) * 255 / 31;
+            rgb[1] = (rgb565 >> 5 & 0x3f) * 255 / 63;
+            rgb[2] = (rgb565 & 0x1f) * 255 / 31;
+            break;
+        }
+        default: {
+            unsigned yuv[3];
+            pixelYuv(data, x, y, yuv);
+            yuvToRgb(yuv[0], yuv[1], yuv[2], rgb);
+            break;
+        }
+    }
+}
+
+void VlcVideoOutput::VideoFrame::pixelYuv(
+    const uint8_t* data,
+    unsigned x, unsigned y,
+    unsigned yuv[3]) const
+{
+    const uint8_t* row = data + _planeOffsets[0] + y * _pitches[0];
+    switch(pixelFormat()) {
+        case PixelFormat::RV32:
+        case PixelFormat::RV16:
+        case PixelFormat::RGBA: {
+            unsigned rgb[3];
+            pixelRgb(data, x, y, rgb);
+            rgbToYuv(rgb[0], rgb[1], rgb[2], yuv);
+            break;
+        }
+        case PixelFormat::YUY2: {
+            const uint8_t* macropixel = row + x / 2 * 4;
+            yuv[0] = macropixel[x % 2 * 2];
+            yuv[1] = macropixel[1];
+            yuv[2] = macropixel[3];
+            break;
+        }
+        case PixelFormat::NV12: {
+            const uint8_t* uv = data + _planeOffsets[1] + y / 2 * _pitches[1] + x / 2 * 2;
+            yuv[0] = row[x];
+            yuv[1] = uv[0];
+            yuv[2] = uv[1];
+            break;
+        }
+        default: {
+            const unsigned cx = x / _layouts[1].widthDivider;
+            const unsigned cy = y / _layouts[1].heightDivider;
+            yuv[0] = row[x];
+            yuv[1] = data[_planeOffsets[1] + cy * _pitches[1] + cx];
+            yuv[2] = data[_planeOffsets[2] + cy * _pitches[2] + cx];
+            break;
+        }
+    }
+
+    //conversions and variants expect limited range
+    if(_fullRange) {
+        yuv[0] = 16 + (yuv[0] * 219 + 127) / 255;
+        yuv[1] = 128 + ((static_cast<int>(yuv[1]) - 128) * 224) / 255;
+        yuv[2] = 128 + ((static_cast<int>(yuv[2]) - 128) * 224) / 255;
+    }
+}
+
+void VlcVideoOutput::VideoFrame::convertToRgb(
+    const void* frameData,
+    unsigned width, unsigned height,
+    uint8_t* rgb) const
+{
+    const uint8_t* data = static_cast<const uint8_t*>(frameData);
+
+    boxFilter(
+        _width, _height, width, height,
+        [&] (unsigned x, unsigned y, unsigned pixel[3]) { pixelRgb(data, x, y, pixel); },
+        [&] (const unsigned pixel[3]) {
+            *rgb++ = static_cast<uint8_t>(pixel[0]);
+            *rgb++ = static_cast<uint8_t>(pixel[1]);
+            *rgb++ = static_cast<uint8_t>(pixel[2]);
+        });
+}
+
+size_t VlcVideoOutput::VideoFrame::convertedFrameSize(
+    PixelFormat pixelFormat,
+    unsigned width, unsigned height)
+{
+    switch(pixelFormat) {
+        case PixelFormat::RV32:
+            return static_cast<size_t>(width) * height * 4;
+        case PixelFormat::I420:
+            return static_cast<size_t>(width) * height +
+                2 * static_cast<size_t>((width + 1) / 2) * ((height + 1) / 2);
+        default:
+            return 0;
+    }
+}
+
+void VlcVideoOutput::VideoFrame::convertFrame(
+    const void* frameData,
+    PixelFormat pixelFormat,
+    unsigned width, unsigned height,
+    uint8_t* out) const
+{
+    const uint8_t* data = static_cast<const uint8_t*>(frameData);
+
+    switch(pixelFormat) {
+        case PixelFormat::RV32:
+            boxFilter(
+                _width, _height, width, height,
+                [&] (unsigned x, unsigned y, unsigned pixel[3]) { pixelRgb(data, x, y, pixel); },
+                [&] (const unsigned pixel[3]) {
+                    *out++ = static_cast<uint8_t>(pixel[2]);
+                    *out++ = static_cast<uint8_t>(pixel[1]);
+                    *out++ = static_cast<uint8_t>(pixel[0]);
+                    *out++ = 0xff;
+                });
+            break;
+        case PixelFormat::I420: {
+            auto sample =
+                [&] (unsigned x, unsigned y, unsigned pixel[3]) { pixelYuv(data, x, y, pixel); };
+
+            //chroma is averaged over the whole area it covers, not just subsampled
+            uint8_t* y = out;
+            boxFilter(
+                _width, _height, width, height, sample,
+                [&] (const unsigned pixel[3]) { *y++ = static_cast<uint8_t>(pixel[0]); });
+
+            uint8_t* u = y;
+            uint8_t* v = u + static_cast<size_t>((width + 1) / 2) * ((height + 1) / 2);
+            boxFilter(
+                _width, _height, (width + 1) / 2, (height + 1) / 2, sample,
+                [&] (const unsigned pixel[3]) {
+                    *u++ = static_cast<uint8_t>(pixel[1]);
+                    *v++ = static_cast<uint8_t>(pixel[2]);
+                });
+            break;
+        }
+        default:
+            assert(false);
+            break;
+    }
+}
+
+unsigned VlcVideoOutput::VideoFrame::setupPlanes(
+    const char* fourcc,
+    const PlaneLayout layouts[], unsigned planeCount,
+    char* chroma,
+    unsigned* width, unsigned* height,
+    unsigned* pitches, unsigned* lines)
+{
+    assert(planeCount <= MaxPlanes);
+
+    _width = *width;
+    _height = *height;
+
+    memcpy(chroma, fourcc, 4);
+
+    unsigned widthDivider = 1;
+    unsigned heightDivider = 1;
+    for(unsigned p = 0; p < planeCount; ++p) {
+        widthDivider = std::max(widthDivider, layouts[p].widthDivider);
+        heightDivider = std::max(heightDivider, layouts[p].heightDivider);
+    }
+
+    //subsampled formats require dimensions multiple of subsampling factor
+    const unsigned alignedWidth = (*width + widthDivider - 1) / widthDivider * widthDivider;
+    const unsigned alignedHeight = (*height + heightDivider - 1) / heightDivider * heightDivider;
+
+    _layouts = layouts;
+    _planeCount = planeCount;
+    _size = 0;
+    for(unsigned p = 0; p < planeCount; ++p) {
+        const PlaneLayout& layout = layouts[p];
+
+        pitches[p] = alignedWidth / layout.widthDivider * layout.pixelBytes;
+        if(pitches[p] % _alignment) pitches[p] += _alignment - pitches[p] % _alignment;
+        lines[p] = alignedHeight / layout.heightDivider;
+
+        assert(0 == pitches[p] % _alignment);
+
+        //rows are aligned, so plane offsets are aligned too
+        _planeOffsets[p] = _size;
+        _pitches[p] = pitches[p];
+        _lines[p] = lines[p];
+        _bufferOffsets[p] = _size;
+        _bufferLines[p] = lines[p];
+
+        _size += pitches[p] * lines[p];
+    }
+
+    return planeCount;
+}
+
+void VlcVideoOutput::VideoFrame::setVisibleRect(
+    unsigned x, unsigned y,
+    unsigned width, unsigned height)
+{
+    unsigned widthDivider = 1;
+    unsigned heightDivider = 1;
+    for(unsigned p = 0; p < _planeCount; ++p) {
+        widthDivider = std::max(widthDivider, _layouts[p].widthDivider);
+        heightDivider = std::max(heightDivider, _layouts[p].heightDivider);
+    }
+
+    //chroma samples can't be split, so rect is extended to the left and top
+    const unsigned alignedX = x / widthDivider * widthDivider;
+    const unsigned alignedY = y / heightDivider * heightDivider;
+    if(alignedX >= _width || alignedY >= _height)
+        return;
+
+    _width = std::min(width + (x - alignedX), _width - alignedX);
+    _height = std::min(height + (y - alignedY), _height - alignedY);
+
+    for(unsigned p = 0; p < _planeCount; ++p) {
+        const PlaneLayout& layout = _layouts[p];
+
+        _planeOffsets[p] =
+            _bufferOffsets[p] +
+            alignedY / layout.heightDivider * _pitches[p] +
+            alignedX / layout.widthDivider * layout.pixelBytes;
+        _lines[p] = (_height + layout.heightDivider - 1) / layout.heightDivider;
+    }
+}
+
+void* VlcVideoOutput::VideoFrame::video_lock_cb(
+    void** planes,
+    const std::atomic<bool>* waitEnabled)
+{
+    void* picture;
+    uint8_t* buffer = static_cast<uint8_t*>(lockBuffer(&picture, waitEnabled));
+
+    for(unsigned p = 0; p < _planeCount; ++p)
+        planes[p] = buffer + _bufferOffsets[p];
+
+    return picture;
+}
+
+void* VlcVideoOutput::VideoFrame::video_drop_cb(void** planes)
+{
+    uint8_t* buffer = static_cast<uint8_t*>(_tmpFrameBuffer);
+
+    for(unsigned p = 0; p < _planeCount; ++p)
+        planes[p] = buffer + _bufferOffsets[p];
+
+    return nullptr;
+}
+
+void VlcVideoOutput::VideoFrame::video_unlock_cb(void* picture, void *const * planes)
+{
+};
+
+///////////////////////////////////////////////////////////////////////////////
+unsigned VlcVideoOutput::RV32VideoFrame::video_format_cb(
+    char* chroma,
+    unsigned* width, unsigned* height,
+    unsigned* pitches, unsigned* lines)
+{
+    static const PlaneLayout layouts[] = {
+        { vlc::DEF_PIXEL_BYTES, 1, 1, { 0, 0, 0, 0 } },
+    };
+
+    return setupPlanes(
+        vlc::DEF_CHROMA, layouts, sizeof(layouts) / sizeof(layouts[0]),
+        chroma, width, height, pitches, lines);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+unsigned VlcVideoOutput::RV16VideoFrame::video_format_cb(
+    char* chroma,
+    unsigned* width, unsigned* height,
+    unsigned* pitches, unsigned* lines)
+{
+    static const PlaneLayout layouts[] = {
+        { 2, 1, 1, { 0, 0 } },
+    };
+
+    return setupPlanes(
+        "RV16", layouts, sizeof(layouts) / sizeof(layouts[0]),
+        chroma, width, height, pitches, lines);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+unsigned VlcVideoOutput::RGBAVideoFrame::video_format_cb(
+    char* chroma,
+    unsigned* width, unsigned* height,
+    unsigned* pitches, unsigned* lines)
+{
+    static const PlaneLayout layouts[] = {
+        { 4, 1, 1, { 0, 0, 0, 0xff } },
+    };
+
+    //rows are always multiple of 4 bytes, so they are left unpadded
+    //regardless of stride alignment
+    _alignment = DefaultAlignment;
+
+    //libvlc converters fill alpha with 0xff if source has no alpha
+    return setupPlanes(
+        "RGBA", layouts, sizeof(layouts) / sizeof(layouts[0]),
+        chroma, width, height, pitches, lines);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+unsigned VlcVideoOutput::YUY2VideoFrame::video_format_cb(
+    char* chroma,
+    unsigned* width, unsigned* height,
+    unsigned* pitches, unsigned* lines)
+{
+    //Y0 U Y1 V macropixel for every 2 pixels
+    static const PlaneLayout layouts[] = {
+        { 4, 2, 1, { 0x0, 0x80, 0x0, 0x80 } },
+    };
+
+    return setupPlanes(
+        "YUY2", layouts, sizeof(layouts) / sizeof(layouts[0]),
+        chroma, width, height, pitches, lines);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+unsigned VlcVideoOutput::I420VideoFrame::video_format_cb(
+    char* chroma,
+    unsigned* width, unsigned* height,
+    unsigned* pitches, unsigned* lines)
+{
+    static const PlaneLayout layouts[] = {
+        { 1, 1, 1, { 0x0 } },
+        { 1, 2, 2, { 0x80 } },
+        { 1, 2, 2, { 0x80 } },
+    };
+
+    return setupPlanes(
+        "I420", layouts, sizeof(layouts) / sizeof(layouts[0]),
+        chroma, width, height, pitches, lines);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+unsigned VlcVideoOutput::I422VideoFrame::video_format_cb(
+    char* chroma,
+    unsigned* width, unsigned* height,
+    unsigned* pitches, unsigned* lines)
+{
+    static const PlaneLayout layouts[] = {
+        { 1, 1, 1, { 0x0 } },
+        { 1, 2, 1, { 0x80 } },
+        { 1, 2, 1, { 0x80 } },
+    };
+
+    return setupPlanes(
+        "I422", layouts, sizeof(layouts) / sizeof(layouts[0]),
+        chroma, width, height, pitches, lines);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+unsigned VlcVideoOutput::I444VideoFrame::video_format_cb(
+    char* chroma,
+    unsigned* width, unsigned* height,
+    unsigned* pitches, unsigned* lines)
+{
+    static const PlaneLayout layouts[] = {
+        { 1, 1, 1, { 0x0 } },
+        { 1, 1, 1, { 0x80 } },
+        { 1, 1, 1, { 0x80 } },
+    };
+
+    return setupPlanes(
+        "I444", layouts, sizeof(layouts) / sizeof(layouts[0]),
+        chroma, width, height, pitches, lines);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+unsigned VlcVideoOutput::NV12VideoFrame::video_format_cb(
+    char* chroma,
+    unsigned* width, unsigned* height,
+    unsigned* pitches, unsigned* lines)
+{
+    //Y plane followed by interleaved UV plane
+    static const PlaneLayout layouts[] = {
+        { 1, 1, 1, { 0x0 } },
+        { 2, 2, 2, { 0x80, 0x80 } },
+    };
+
+    return setupPlanes(
+        "NV12", layouts, sizeof(layouts) / sizeof(layouts[0]),
+        chroma, width, height, pitches, lines);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+struct VlcVideoOutput::VideoEvent
+{
+    virtual ~VideoEvent() {}
+    virtual void process(VlcVideoOutput*) = 0;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+struct VlcVideoOutput::FrameSetupEvent : public VlcVideoOutput::VideoEvent
+{
+    FrameSetupEvent(const std::shared_ptr<VideoFrame>& videoFrame) :
+        _videoFrame(videoFrame) {}
+    ~FrameSetupEvent();
+
+    void process(VlcVideoOutput*) override;
+
+    std::weak_ptr<VideoFrame> _videoFrame;
+    //native buffers decode thread is writing to already, empty otherwise
+    std::unique_ptr<FrameBuffer> _frameBuffers[VideoFrame::BuffersCount];
+};
+
+VlcVideoOutput::FrameSetupEvent::~FrameSetupEvent()
+{
+    //not processed event, so native consumers could still hold frames from these buffers
+    for(auto& frameBuffer: _frameBuffers) {
+        if(frameBuffer && frameBuffer->pinned())
+            orphanFrameBuffer(std::move(frameBuffer));
+    }
+}
+
+void VlcVideoOutput::FrameSetupEvent::process(VlcVideoOutput* videoOutput)
+{
+    std::shared_ptr<VideoFrame> videoFrame = _videoFrame.lock();
+
+    const bool nativeBuffers = static_cast<bool>(_frameBuffers[0]);
+
+    if(!videoFrame) {
+        //video format was changed again before setup, so buffers are not used by anyone
+        for(auto& frameBuffer: _frameBuffers) {
+            if(frameBuffer)
+                videoOutput->poolFrameBuffer(std::move(frameBuffer));
+        }
+        return;
+    }
+
+    videoOutput->_currentVideoFrame = videoFrame;
+
+    //new output starts with clean load history
+    videoOutput->_overloadedWindows = videoOutput->_headroomWindows = 0;
+
+    FrameBuffer* buffers[VideoFrame::BuffersCount] = {};
+    if(nativeBuffers) {
+        videoOutput->releaseFrameBuffers();
+        for(unsigned i = 0; i < VideoFrame::BuffersCount; ++i) {
+            buffers[i] = _frameBuffers[i].get();
+            videoOutput->_usedFrameBuffers.push_back(std::move(_frameBuffers[i]));
+        }
+    } else if(!videoOutput->takeFrameBuffers(videoFrame->size(), buffers)) {
+        return;
+    }
+
+    videoFrame->setBufferSync(videoOutput->_publishedBuffer, videoOutput->_readerBuffer);
+    if(videoOutput->onFrameSetup(*videoFrame, buffers)) {
+        if(!nativeBuffers)
+            videoFrame->setFrameBuffers(buffers);
+    } else if(nativeBuffers) {
+        videoFrame->setFrameBuffers(nullptr);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+struct VlcVideoOutput::FrameReadyEvent : public VlcVideoOutput::VideoEvent
+{
+    void process(VlcVideoOutput*) override;
+};
+
+void VlcVideoOutput::FrameReadyEvent::process(VlcVideoOutput* videoOutput)
+{
+    videoOutput->processFrameReady();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+struct VlcVideoOutput::FrameCleanupEvent : public VlcVideoOutput::VideoEvent
+{
+    void process(VlcVideoOutput*) override;
+};
+
+void VlcVideoOutput::FrameCleanupEvent::process(VlcVideoOutput* videoOutput)
+{
+    if(videoOutput->_currentVideoFrame) {
+        videoOutput->onFrameCleanup();
+        videoOutput->_currentVideoFrame.reset();
+    }
+
+    videoOutput->releaseFrameBuffers();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+struct VlcVideoOutput::SceneChangeEvent : public VlcVideoOutput::VideoEvent
+{
+    SceneChangeEvent(const SceneChange& sceneChange) :
+        _sceneChange(sceneChange) {}
+
+    void process(VlcVideoOutput*) override;
+
+    const SceneChange _sceneChange;
+};
+
+void VlcVideoOutput::SceneChangeEvent::process(VlcVideoOutput* videoOutput)
+{
+    videoOutput->onSceneChange(_sceneChange);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+namespace {
+
+//steps of adaptive downscaling, every one is about half of pixels of previous one
+const double adaptiveScales[] = { 1., .75, .5, .375, .25 };
+const unsigned adaptiveScalesCount = sizeof(adaptiveScales) / sizeof(adaptiveScales[0]);
+
+//media time is tracked from these player events
+const libvlc_event_type_t mediaTimeEvents[] = {
+    libvlc_MediaPlayerTimeChanged,
+    libvlc_MediaPlayerMediaChanged,
+    libvlc_MediaPlayerStopped,
+};
+
+//full range chromas with the same layout as limited range ones
+const struct {
+    const char* fourcc;
+    const char* fullRangeFourcc;
+} fullRangeChromas[] = {
+    { "I420", "J420" },
+    { "I422", "J422" },
+    { "I444", "J444" },
+};
+
+}
+
+///////////////////////////////////////////////////////////////////////////////
+struct VlcVideoOutput::AdaptiveScaleRequestEvent : public VlcVideoOutput::VideoEvent
+{
+    AdaptiveScaleRequestEvent(double scale) :
+        _scale(scale) {}
+
+    void process(VlcVideoOutput*) override;
+
+    const double _scale;
+};
+
+void VlcVideoOutput::AdaptiveScaleRequestEvent::process(VlcVideoOutput* videoOutput)
+{
+    videoOutput->onAdaptiveScaleRequest(_scale);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+struct VlcVideoOutput::AdaptiveScaleChangeEvent : public VlcVideoOutput::VideoEvent
+{
+    AdaptiveScaleChangeEvent(double scale) :
+        _scale(scale) {}
+
+    void process(VlcVideoOutput*) override;
+
+    const double _scale;
+};
+
+void VlcVideoOutput::AdaptiveScaleChangeEvent::process(VlcVideoOutput* videoOutput)
+{
+    videoOutput->onAdaptiveScaleChange(_scale);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+VlcVideoOutput::VlcVideoOutput() :
+    _pixelFormat(PixelFormat::I420), _player(nullptr),
+    _publishedBuffer(nullptr), _readerBuffer(nullptr),
+    _deliveredSequence(0),
+    _fpsWindowStart(0), _fpsWindowFrames(0), _deliveredFps(0),
+    _firstFrameTimerStart(0), _timeToFirstFrame(-1),
+    _decodedFrames(0), _nextFrameTime(0),
+    _lastFrameHashValid(false), _lastFrameHash(0),
+    _tmpFrameBuffer(nullptr), _tmpFrameBufferCapacity(0),
+    _preallocatedFrameSize(0),
+    _outputSize({ 0, 0, ScaleMode::Fit }),
+    _cropRect({ 0, 0, 0, 0 }),
+    _strideAlignment(DefaultAlignment),
+    _maxFps(0), _minFrameInterval(0),
+    _cadenceFps(0), _cadenceDelivery(false), _pullDelivery(false),
+    _nativeFrameBuffers(false), _mediaTime(-1),
+    _frameBackpressure(false), _frameWaitCancelled(false), _frameWaitEnabled(false),
+    _suppressDuplicateFrames(false), _duplicateFramesSuppressed(0), _droppedFrames(0),
+    _frameStatsInterval(0), _sceneChangeThreshold(0),
+    _adaptiveScaleStep(0), _adaptiveScale(1.), _adaptiveScaling(false), _adaptiveLatency(0),
+    _overloadedWindows(0), _headroomWindows(0),
+    _requiredHeadroomWindows(AdaptiveHeadroomWindows), _adaptiveStepTime(0), _adaptiveSteppedUp(false),
+    _replayBudget(0), _replayBytes(0)
+{
+    uv_loop_t* loop = uv_default_loop();
+
+    uv_async_init(loop, &_async,
+        [] (uv_async_t* handle) {
+            if(handle->data)
+                reinterpret_cast<VlcVideoOutput*>(handle->data)->handleAsync();
+        }
+   );
+    _async.data = this;
+
+    uv_timer_init(loop, &_cadenceTimer);
+    _cadenceTimer.data = this;
+
+    _waitingFrame.test_and_set(); //FIXME! use memory_order
+}
+
+VlcVideoOutput::~VlcVideoOutput()
+{
+    uv_close(reinterpret_cast<uv_handle_t*>(&_async), 0);
+    _async.data = nullptr;
+
+    uv_timer_stop(&_cadenceTimer);
+    uv_close(reinterpret_cast<uv_handle_t*>(&_cadenceTimer), 0);
+    _cadenceTimer.data = nullptr;
+
+    if(_tmpFrameBuffer)
+        free(_tmpFrameBuffer);
+
+    //native consumers could hold frames longer than player lives
+    for(auto& frameBuffer: _usedFrameBuffers) {
+        if(frameBuffer->pinned())
+            orphanFrameBuffer(std::move(frameBuffer));
+    }
+    for(auto& frameBuffer: _frameBuffersPool) {
+        if(frameBuffer->pinned())
+            orphanFrameBuffer(std::move(frameBuffer));
+    }
+}
+
+void VlcVideoOutput::orphanFrameBuffer(std::unique_ptr<FrameBuffer> frameBuffer)
+{
+    //frame buffer could be destroyed only from gui thread,
+    //but there is nobody to do it after last frame release, so memory is left alive
+    frameBuffer.release();
+}
+
+bool VlcVideoOutput::open(vlc::basic_player* player)
+{
+    _player = player;
+
+    if(!vlc::basic_vmem_wrapper::open(player))
+        return false;
+
+    libvlc_event_manager_t* eventManager =
+        libvlc_media_player_event_manager(player->get_mp());
+    for(libvlc_event_type_t event: mediaTimeEvents)
+        libvlc_event_attach(eventManager, event, player_event_wrapper, this);
+
+    return true;
+}
+
+void VlcVideoOutput::close()
+{
+    if(_player && _player->get_mp()) {
+        libvlc_event_manager_t* eventManager =
+            libvlc_media_player_event_manager(_player->get_mp());
+        for(libvlc_event_type_t event: mediaTimeEvents)
+            libvlc_event_detach(eventManager, event, player_event_wrapper, this);
+    }
+
+    vlc::basic_vmem_wrapper::close();
+
+    //active timer keeps event loop alive
+    uv_timer_stop(&_cadenceTimer);
+
+    _player = nullptr;
+}
+
+void VlcVideoOutput::player_event_wrapper(const libvlc_event_t* event, void* videoOutput)
+{
+    static_cast<VlcVideoOutput*>(videoOutput)->player_event(event);
+}
+
+void VlcVideoOutput::player_event(const libvlc_event_t* event)
+{
+    //called from libvlc event thread
+    if(libvlc_MediaPlayerTimeChanged == event->type)
+        _mediaTime = event->u.media_player_time_changed.new_time;
+    else
+        _mediaTime = -1;
+}
+
+//rounds size up to 1/8 of it's power of 2,
+//so buffers are reusable for close resolutions and waste no more than 12.5%
+static size_t frameBufferSizeClass(size_t size)
+{
+    const size_t minSizeClass = 64 * 1024;
+    if(size <= minSizeClass)
+        return minSizeClass;
+
+    size_t powerOf2 = minSizeClass;
+    while(powerOf2 * 2 <= size)
+        powerOf2 *= 2;
+
+    const size_t step = powerOf2 / 8;
+
+    return (size + step - 1) / step * step;
+}
+
+VlcVideoOutput::PixelFormat VlcVideoOutput::nativePixelFormat(const char* chroma)
+{
+    static const struct {
+        const char* fourcc;
+        PixelFormat format;
+    } nativeFormats[] = {
+        { "I420", PixelFormat::I420 },
+        { "IYUV", PixelFormat::I420 },
+        { "J420", PixelFormat::I420 },
+        { "NV12", PixelFormat::NV12 },
+        { "I422", PixelFormat::I422 },
+        { "J422", PixelFormat::I422 },
+        { "I444", PixelFormat::I444 },
+        { "J444", PixelFormat::I444 },
+        { "YUY2", PixelFormat::YUY2 },
+        { "RV16", PixelFormat::RV16 },
+        { "RV32", PixelFormat::RV32 },
+        { "RGBA", PixelFormat::RGBA },
+    };
+
+    for(const auto& nativeFormat: nativeFormats) {
+        if(0 == memcmp(chroma, nativeFormat.fourcc, 4))
+            return nativeFormat.format;
+    }
+
+    //libvlc will convert everything else
+    return PixelFormat::I420;
+}
+
+bool VlcVideoOutput::clipCropRect(
+    CropRect* cropRect,
+    unsigned width, unsigned height)
+{
+    if(0 == cropRect->width || 0 == cropRect->height)
+        return false;
+
+    //crop outside of frame is ignored, like libvlc does
+    if(cropRect->x >= width || cropRect->y >= height)
+        return false;
+
+    cropRect->width = std::min(cropRect->width, width - cropRect->x);
+    cropRect->height = std::min(cropRect->height, height - cropRect->y);
+
+    return true;
+}
+
+void VlcVideoOutput::applyOutputSize(
+    const OutputSize& outputSize,
+    unsigned* width, unsigned* height)
+{
+    if((0 == outputSize.width && 0 == outputSize.height) || 0 == *width || 0 == *height)
+        return;
+
+    if(ScaleMode::Exact == outputSize.mode && outputSize.width && outputSize.height) {
+        *width = outputSize.width;
+        *height = outputSize.height;
+        return;
+    }
+
+    const double xScale = static_cast<double>(outputSize.width) / *width;
+    const double yScale = static_cast<double>(outputSize.height) / *height;
+
+    double scale;
+    if(0 == outputSize.width)
+        scale = yScale;
+    else if(0 == outputSize.height)
+        scale = xScale;
+    else if(ScaleMode::Fill == outputSize.mode)
+        scale = std::max(xScale, yScale);
+    else
+        scale = std::min(xScale, yScale);
+
+    //upscaling is better to leave to renderer
+    if(scale >= 1.)
+        return;
+
+    *width = std::max(1u, static_cast<unsigned>(*width * scale + .5));
+    *height = std::max(1u, static_cast<unsigned>(*height * scale + .5));
+}
+
+std::shared_ptr<VlcVideoOutput::VideoFrame> VlcVideoOutput::createVideoFrame(PixelFormat format)
+{
+    switch(format) {
+        case PixelFormat::RV32:
+            return std::make_shared<RV32VideoFrame>();
+        case PixelFormat::RV16:
+            return std::make_shared<RV16VideoFrame>();
+        case PixelFormat::RGBA:
+            return std::make_shared<RGBAVideoFrame>();
+        case PixelFormat::YUY2:
+            return std::make_shared<YUY2VideoFrame>();
+        case PixelFormat::I422:
+            return std::make_shared<I422VideoFrame>();
+        case PixelFormat::I444:
+            return std::make_shared<I444VideoFrame>();
+        case PixelFormat::NV12:
+            return std::make_shared<NV12VideoFrame>();
+        case PixelFormat::I420:
+        default:
+            return std::make_shared<I420VideoFrame>();
+    }
+}
+
+size_t VlcVideoOutput::frameSize(
+    PixelFormat format, unsigned alignment,
+    unsigned width, unsigned height)
+{
+    //native format is not known in advance, so take the largest one
+    std::shared_ptr<VideoFrame> videoFrame =
+        createVideoFrame(PixelFormat::Native == format ? PixelFormat::RV32 : format);
+    videoFrame->_alignment = alignment;
+
+    char chroma[4];
+    unsigned pitches[VideoFrame::MaxPlanes] = {};
+    unsigned lines[VideoFrame::MaxPlanes] = {};
+    videoFrame->video_format_cb(chroma, &width, &height, pitches, lines);
+
+    return videoFrame->size();
+}
+
+void VlcVideoOutput::preallocateFrameBuffers(unsigned width, unsigned height)
+{
+    const size_t capacity =
+        frameBufferSizeClass(frameSize(_pixelFormat, strideAlignment(), width, height));
+
+    unsigned fittingBuffers = 0;
+    _frameBuffersGuard.lock();
+    for(const auto& frameBuffer: _frameBuffersPool) {
+        if(frameBuffer->capacity() >= capacity && !frameBuffer->pinned())
+            ++fittingBuffers;
+    }
+    _frameBuffersGuard.unlock();
+
+    for(; fittingBuffers < VideoFrame::BuffersCount; ++fittingBuffers) {
+        std::unique_ptr<FrameBuffer> frameBuffer = onFrameBufferAlloc(capacity);
+        if(!frameBuffer)
+            break;
+
+        poolFrameBuffer(std::move(frameBuffer));
+    }
+
+    _guard.lock();
+    _preallocatedFrameSize = std::max(_preallocatedFrameSize, capacity);
+    _guard.unlock();
+}
+
+unsigned VlcVideoOutput::strideAlignment()
+{
+    std::unique_lock<std::mutex> lock(_guard);
+
+    return _strideAlignment;
+}
+
+bool VlcVideoOutput::setStrideAlignment(unsigned alignment)
+{
+    if(alignment < DefaultAlignment || alignment > VideoFrame::MaxAlignment)
+        return false;
+
+    if(alignment & (alignment - 1))
+        return false;
+
+    std::unique_lock<std::mutex> lock(_guard);
+
+    _strideAlignment = alignment;
+
+    return true;
+}
+
+void VlcVideoOutput::setMaxFps(double maxFps)
+{
+    _maxFps = maxFps > 0 ? maxFps : 0;
+    _minFrameInterval = _maxFps > 0 ? static_cast<uint64_t>(1e9 / _maxFps) : 0;
+}
+
+void VlcVideoOutput::setCadenceFps(double cadenceFps)
+{
+    _cadenceFps = cadenceFps > 0 ? cadenceFps : 0;
+
+    uv_timer_stop(&_cadenceTimer);
+
+    if(_cadenceFps > 0) {
+        _cadenceDelivery = true;
+
+        const uint64_t interval = std::max<uint64_t>(1, static_cast<uint64_t>(1000 / _cadenceFps + .5));
+        uv_timer_start(
+            &_cadenceTimer,
+            [] (uv_timer_t* handle) {
+                if(handle->data)
+                    reinterpret_cast<VlcVideoOutput*>(handle->data)->processFrameReady();
+            },
+            interval, interval);
+    } else {
+        _cadenceDelivery = false;
+
+        //frame could arrive after last timer tick
+        processFrameReady();
+    }
+}
+
+void VlcVideoOutput::setPullDelivery(bool pullDelivery)
+{
+    _pullDelivery = pullDelivery;
+
+    //frame could arrive while it was pulled
+    if(!pullDelivery)
+        processFrameReady();
+}
+
+void VlcVideoOutput::setFrameBackpressure(bool backpressure)
+{
+    _frameBackpressure = backpressure;
+    updateFrameWait();
+}
+
+void VlcVideoOutput::cancelFrameWait()
+{
+    _frameWaitCancelled = true;
+    updateFrameWait();
+}
+
+void VlcVideoOutput::resumeFrameWait()
+{
+    _frameWaitCancelled = false;
+    updateFrameWait();
+}
+
+void VlcVideoOutput::updateFrameWait()
+{
+    _frameWaitEnabled = _frameBackpressure && !_frameWaitCancelled;
+
+    if(!_frameWaitEnabled && _currentVideoFrame)
+        _currentVideoFrame->notifyBufferWaiters();
+}
+
+VlcVideoOutput::OutputSize VlcVideoOutput::outputSize()
+{
+    std::unique_lock<std::mutex> lock(_guard);
+
+    return _outputSize;
+}
+
+void VlcVideoOutput::setOutputSize(const OutputSize& outputSize)
+{
+    std::unique_lock<std::mutex> lock(_guard);
+
+    _outputSize = outputSize;
+}
+
+VlcVideoOutput::CropRect VlcVideoOutput::cropRect()
+{
+    std::unique_lock<std::mutex> lock(_guard);
+
+    return _cropRect;
+}
+
+void VlcVideoOutput::setCropRect(const CropRect& cropRect)
+{
+    std::unique_lock<std::mutex> lock(_guard);
+
+    _cropRect = cropRect;
+}
+
+void VlcVideoOutput::clearFrameBuffersPool()
+{
+    std::unique_lock<std::mutex> lock(_frameBuffersGuard);
+
+    _frameBuffersPool.erase(
+        std::remove_if(
+            _frameBuffersPool.begin(), _frameBuffersPool.end(),
+            [] (const std::unique_ptr<FrameBuffer>& frameBuffer) {
+                return !frameBuffer->pinned();
+            }),
+        _frameBuffersPool.end());
+}
+
+void VlcVideoOutput::setBufferSync(
+    std::atomic<int32_t>* publishedBuffer,
+    const std::atomic<int32_t>* readerBuffer)
+{
+    _publishedBuffer = publishedBuffer;
+    _readerBuffer = readerBuffer;
+
+    if(_currentVideoFrame)
+        _currentVideoFrame->setBufferSync(publishedBuffer, readerBuffer);
+}
+
+std::shared_ptr<const VlcVideoOutput::VideoFrame> VlcVideoOutput::copyDisplayedFrame(std::vector<uint8_t>* data)
+{
+    if(!_currentVideoFrame || !_currentVideoFrame->copyDisplayedBuffer(data))
+        return nullptr;
+
+    return _currentVideoFrame;
+}
+
+std::unique_ptr<VlcVideoOutput::FrameBuffer> VlcVideoOutput::takePooledFrameBuffer(size_t size)
+{
+    std::unique_lock<std::mutex> lock(_frameBuffersGuard);
+
+    auto bestFit = _frameBuffersPool.end();
+    for(auto it = _frameBuffersPool.begin(); it != _frameBuffersPool.end(); ++it) {
+        if((*it)->capacity() < size || (*it)->pinned())
+            continue;
+
+        if(bestFit == _frameBuffersPool.end() ||
+           (*it)->capacity() < (*bestFit)->capacity())
+        {
+            bestFit = it;
+        }
+    }
+
+    if(bestFit == _frameBuffersPool.end())
+        return nullptr;
+
+    std::unique_ptr<FrameBuffer> frameBuffer = std::move(*bestFit);
+    _frameBuffersPool.erase(bestFit);
+
+    return frameBuffer;
+}
+
+void VlcVideoOutput::poolFrameBuffer(std::unique_ptr<FrameBuffer> frameBuffer)
+{
+    std::unique_lock<std::mutex> lock(_frameBuffersGuard);
+
+    _frameBuffersPool.push_back(std::move(frameBuffer));
+}
+
+void VlcVideoOutput::takeNativeFrameBuffers(
+    size_t size, size_t capacity,
+    std::unique_ptr<FrameBuffer> frameBuffers[])
+{
+    for(unsigned i = 0; i < VideoFrame::BuffersCount; ++i) {
+        frameBuffers[i] = takePooledFrameBuffer(size);
+        if(!frameBuffers[i])
+            frameBuffers[i] = onFrameBufferAlloc(capacity);
+
+        if(!frameBuffers[i]) {
+            //gui thread will try again on frame setup,
+            //pool is not trimmed here since buffers should be destroyed by gui thread
+            for(unsigned j = 0; j < i; ++j)
+                poolFrameBuffer(std::move(frameBuffers[j]));
+            return;
+        }
+    }
+}
+
+bool VlcVideoOutput::takeFrameBuffers(size_t size, FrameBuffer* frameBuffers[])
+{
+    releaseFrameBuffers();
+
+    for(unsigned i = 0; i < VideoFrame::BuffersCount; ++i) {
+        std::unique_ptr<FrameBuffer> frameBuffer = takePooledFrameBuffer(size);
+        if(!frameBuffer)
+            frameBuffer = onFrameBufferAlloc(frameBufferSizeClass(size));
+
+        if(!frameBuffer) {
+            releaseFrameBuffers();
+            return false;
+        }
+
+        frameBuffers[i] = frameBuffer.get();
+        _usedFrameBuffers.push_back(std::move(frameBuffer));
+    }
+
+    return true;
+}
+
+void VlcVideoOutput::releaseFrameBuffers()
+{
+    std::unique_lock<std::mutex> lock(_frameBuffersGuard);
+
+    for(auto& frameBuffer: _usedFrameBuffers)
+        _frameBuffersPool.push_back(std::move(frameBuffer));
+    _usedFrameBuffers.clear();
+
+    //keep enough buffers for two different resolutions, and prefer larger ones,
+    //pinned buffers stay in pool until released, even if it's over limit
+    const size_t maxPoolSize = 2 * VideoFrame::BuffersCount;
+    while(_frameBuffersPool.size() > maxPoolSize) {
+        auto smallest = _frameBuffersPool.end();
+        for(auto it = _frameBuffersPool.begin(); it != _frameBuffersPool.end(); ++it) {
+            if(!(*it)->pinned() &&
+               (smallest == _frameBuffersPool.end() || (*it)->capacity() < (*smallest)->capacity()))
+            {
+                smallest = it;
+            }
+        }
+        if(smallest == _frameBuffersPool.end())
+            break;
+        _frameBuffersPool.erase(smallest);
+    }
+}
+
+unsigned VlcVideoOutput::video_format_cb(
+    char* chroma,
+    unsigned* width, unsigned* height,
+    unsigned* pitches, unsigned* lines)
+{
+    PixelFormat pixelFormat = _pixelFormat;
+    const bool nativeFormat = PixelFormat::Native == pixelFormat;
+    if(nativeFormat)
+        pixelFormat = nativePixelFormat(chroma);
+
+    char sourceChroma[4];
+    memcpy(sourceChroma, chroma, sizeof(sourceChroma));
+    //scaling by libvlc keeps matrix of source
+    const bool hdSource = *height > 576;
+
+    _guard.lock();
+    const size_t preallocatedFrameSize = _preallocatedFrameSize;
+    const OutputSize outputSize = _outputSize;
+    const CropRect cropRect = _cropRect;
+    const unsigned strideAlignment = _strideAlignment;
+    const unsigned adaptiveScaleStep = _adaptiveScaleStep;
+    _guard.unlock();
+
+    const double scale = adaptiveScales[adaptiveScaleStep];
+
+    _guard.lock();
+    const bool scaleChanged = scale != _adaptiveScale;
+    _adaptiveScale = scale;
+    _guard.unlock();
+
+    CropRect visibleRect = cropRect;
+    const bool cropped = clipCropRect(&visibleRect, *width, *height);
+
+    unsigned visibleWidth = cropped ? visibleRect.width : *width;
+    unsigned visibleHeight = cropped ? visibleRect.height : *height;
+    applyOutputSize(outputSize, &visibleWidth, &visibleHeight);
+    if(scale < 1.) {
+        visibleWidth = std::max(1u, static_cast<unsigned>(visibleWidth * scale + .5));
+        visibleHeight = std::max(1u, static_cast<unsigned>(visibleHeight * scale + .5));
+    }
+
+    if(cropped) {
+        //whole frame is scaled like crop rect, but never upscaled,
+        //otherwise small crop rect would make decoder produce huge frames
+        const double xScale = std::min(1., static_cast<double>(visibleWidth) / visibleRect.width);
+        const double yScale = std::min(1., static_cast<double>(visibleHeight) / visibleRect.height);
+
+        visibleRect.x = static_cast<unsigned>(visibleRect.x * xScale);
+        visibleRect.y = static_cast<unsigned>(visibleRect.y * yScale);
+        visibleRect.width = std::max(1u, static_cast<unsigned>(visibleRect.width * xScale + .5));
+        visibleRect.height = std::max(1u, static_cast<unsigned>(visibleRect.height * yScale + .5));
+        *width = std::max(1u, static_cast<unsigned>(*width * xScale + .5));
+        *height = std::max(1u, static_cast<unsigned>(*height * yScale + .5));
+    } else {
+        *width = visibleWidth;
+        *height = visibleHeight;
+    }
+
+    _videoFrame = createVideoFrame(pixelFormat);
+    _videoFrame->_alignment = strideAlignment;
+    _videoFrame->_bt709 = hdSource;
+    _lastFrameHashValid = false;
+    _sceneDetector.reset();
+    std::unique_ptr<FrameSetupEvent> frameSetupEvent(new FrameSetupEvent(_videoFrame));
+
+    const unsigned planeCount =
+        _videoFrame->video_format_cb(
+            chroma,
+            width, height,
+            pitches, lines);
+
+    //native full range frame is delivered as is and marked as such,
+    //instead of being converted to limited range by libvlc
+    if(nativeFormat) {
+        for(const auto& fullRangeChroma: fullRangeChromas) {
+            if(0 == memcmp(chroma, fullRangeChroma.fourcc, 4) &&
+               0 == memcmp(sourceChroma, fullRangeChroma.fullRangeFourcc, 4))
+            {
+                memcpy(chroma, sourceChroma, sizeof(sourceChroma));
+                _videoFrame->_fullRange = true;
+            }
+        }
+    }
+
+    if(cropped) {
+        _videoFrame->setVisibleRect(
+            visibleRect.x, visibleRect.y,
+            visibleRect.width, visibleRect.height);
+    }
+
+    if(_nativeFrameBuffers && _videoFrame->size()) {
+        takeNativeFrameBuffers(
+            _videoFrame->size(),
+            std::max(frameBufferSizeClass(_videoFrame->size()), preallocatedFrameSize),
+            frameSetupEvent->_frameBuffers);
+
+        if(frameSetupEvent->_frameBuffers[0]) {
+            FrameBuffer* buffers[VideoFrame::BuffersCount];
+            for(unsigned i = 0; i < VideoFrame::BuffersCount; ++i)
+                buffers[i] = frameSetupEvent->_frameBuffers[i].get();
+            _videoFrame->setFrameBuffers(buffers);
+        }
+    }
+
+    if(_tmpFrameBufferCapacity < _videoFrame->size()) {
+        if(_tmpFrameBuffer)
+            free(_tmpFrameBuffer);
+
+        _tmpFrameBufferCapacity =
+            std::max(frameBufferSizeClass(_videoFrame->size()), preallocatedFrameSize);
+        _tmpFrameBuffer = malloc(_tmpFrameBufferCapacity);
+    }
+    _videoFrame->_tmpFrameBuffer = _tmpFrameBuffer;
+
+    _guard.lock();
+    _videoEvents.push_back(std::move(frameSetupEvent));
+    if(scaleChanged)
+        _videoEvents.emplace_back(new AdaptiveScaleChangeEvent(scale));
+    _guard.unlock();
+    uv_async_send(&_async);
+
+    return planeCount;
+}
+
+void VlcVideoOutput::video_cleanup_cb()
+{
+    _guard.lock();
+    _videoEvents.emplace_back(new FrameCleanupEvent);
+    _guard.unlock();
+    uv_async_send(&_async);
+}
+
+bool VlcVideoOutput::paceFrame()
 {
+    const uint64_t minFrameInterval = _minFrameInterval;
+    if(0 == minFrameInterval || _frameBackpressure)
+        return true;
+
+    const uint64_t now = uv_hrtime();
+
+    //some tolerance, so jitter of source frames doesn't shift cadence
+    if(now + minFrameInterval / 8 < _nextFrameTime)
+        return false;
+
+    //keep cadence, unless frames stalled for more than interval
+    if(_nextFrameTime + minFrameInterval <= now)
+        _nextFrameTime = now;
+    _nextFrameTime += minFrameInterval;
+
+    return true;
 }
 
-VlcVideoOutput::VideoFrame::~VideoFrame()
+void* VlcVideoOutput::video_lock_cb(void** planes)
 {
-    if(_tmpFrameBuffer)
-        free(_tmpFrameBuffer);
+    if(!paceFrame())
+        return _videoFrame->video_drop_cb(planes);
+
+    void* picture =
+        _videoFrame->video_lock_cb(
+            planes,
+            _frameWaitEnabled ? &_frameWaitEnabled : nullptr);
+
+    //frame decoded to temporary buffer will never be delivered
+    if(!picture)
+        ++_droppedFrames;
+
+    return picture;
 }
 
-void* VlcVideoOutput::VideoFrame::frameBuffer()
+void VlcVideoOutput::video_unlock_cb(void* picture, void *const * planes)
 {
-    if(_tmpFrameBuffer) {
-        std::unique_lock<std::mutex> lock(_guard);
-        if(_frameBuffer) {
-            free(_tmpFrameBuffer);
-            _tmpFrameBuffer = nullptr;
-        } else
-            return _tmpFrameBuffer;
+    _videoFrame->video_unlock_cb(picture, planes);
+}
+
+void VlcVideoOutput::video_display_cb(void* picture)
+{
+    if(picture && _suppressDuplicateFrames) {
+        const uint64_t frameHash = _videoFrame->bufferHash(picture);
+        if(_lastFrameHashValid && frameHash == _lastFrameHash) {
+            ++_duplicateFramesSuppressed;
+            //renderer could miss notification while buffer was locked
+            if(_videoFrame->discardBuffer(picture))
+                notifyFrameReady();
+            return;
+        }
+
+        _lastFrameHash = frameHash;
+        _lastFrameHashValid = true;
+    } else
+        _lastFrameHashValid = false;
+
+    FrameInfo frameInfo;
+    frameInfo.sequence = ++_decodedFrames;
+    frameInfo.wallclock = uv_hrtime();
+    frameInfo.mediaTime = _mediaTime;
+    frameInfo.skippedFrames = 0; //filled on delivery
+
+    detectSceneChange(picture, frameInfo);
+
+    if(picture) {
+        const unsigned statsInterval = _frameStatsInterval;
+        _videoFrame->updateBufferStats(
+            picture,
+            statsInterval && 0 == frameInfo.sequence % statsInterval);
+
+        convertFrameVariants(picture);
+
+        notifyFrameConsumers(picture, frameInfo);
     }
 
-    return static_cast<char*>(_frameBuffer);
+    if(_videoFrame->displayBuffer(picture, frameInfo, _frameBackpressure))
+        notifyFrameReady();
 }
 
-bool VlcVideoOutput::VideoFrame::frameReady() const
+void VlcVideoOutput::detectSceneChange(void* picture, const FrameInfo& frameInfo)
 {
-    return !_tmpFrameBuffer;
+    const double threshold = _sceneChangeThreshold;
+    if(threshold <= 0)
+        return;
+
+    //frames decoded to temporary buffer are analyzed too,
+    //so cuts are not missed when renderer is late
+    uint8_t grid[SceneDetector::GridSize];
+    _videoFrame->lumaGrid(picture, grid);
+
+    const double score = _sceneDetector.update(grid, threshold);
+    if(score < 0)
+        return;
+
+    const SceneChange sceneChange = { frameInfo.sequence, frameInfo.mediaTime, score };
+
+    _guard.lock();
+    _videoEvents.emplace_back(new SceneChangeEvent(sceneChange));
+    _guard.unlock();
+    uv_async_send(&_async);
 }
 
-void VlcVideoOutput::VideoFrame::setFrameBuffer(void* frameBuffer)
+void VlcVideoOutput::setFrameVariants(const std::vector<FrameVariant>& frameVariants)
 {
-    std::unique_lock<std::mutex> lock(_guard);
-    _frameBuffer = frameBuffer;
+    std::unique_lock<std::mutex> lock(_frameVariantsGuard);
+
+    _frameVariants.clear();
+    for(const FrameVariant& variant: frameVariants) {
+        if(std::find(_frameVariants.begin(), _frameVariants.end(), variant) == _frameVariants.end())
+            _frameVariants.push_back(variant);
+    }
 }
 
-void VlcVideoOutput::VideoFrame::video_unlock_cb(void* picture, void *const * planes)
+void VlcVideoOutput::convertFrameVariants(void* picture)
 {
-};
+    //previous frame variants of this buffer could be reused right away
+    std::vector<std::shared_ptr<const VariantFrame> >& variantFrames =
+        _videoFrame->bufferVariants(picture);
+    variantFrames.clear();
+
+    _frameVariantsGuard.lock();
+    const std::vector<FrameVariant> frameVariants = _frameVariants;
+    _frameVariantsGuard.unlock();
+
+    const VideoFrame& videoFrame = *_videoFrame;
+    const void* data = static_cast<const VideoFrame::Buffer*>(picture)->data;
+
+    for(const FrameVariant& variant: frameVariants) {
+        unsigned width = videoFrame.width();
+        unsigned height = videoFrame.height();
+        applyOutputSize({ variant.width, variant.height, ScaleMode::Fit }, &width, &height);
+
+        const size_t size = VideoFrame::convertedFrameSize(variant.pixelFormat, width, height);
+        if(0 == size)
+            continue;
+
+        //frames still referenced by other buffers or renderer can't be reused
+        std::shared_ptr<VariantFrame> variantFrame;
+        for(const auto& pooledFrame: _variantFramesPool) {
+            if(1 == pooledFrame.use_count()) {
+                variantFrame = pooledFrame;
+                break;
+            }
+        }
+        if(!variantFrame) {
+            variantFrame = std::make_shared<VariantFrame>();
+            _variantFramesPool.push_back(variantFrame);
+        }
+
+        variantFrame->variant = variant;
+        variantFrame->width = width;
+        variantFrame->height = height;
+        variantFrame->data.resize(size);
+        videoFrame.convertFrame(data, variant.pixelFormat, width, height, variantFrame->data.data());
+
+        variantFrames.push_back(std::move(variantFrame));
+    }
 
-void VlcVideoOutput::VideoFrame::video_cleanup_cb()
+    //drop unused frames left after variants were removed
+    const size_t maxPoolSize = VideoFrame::BuffersCount * frameVariants.size();
+    for(auto it = _variantFramesPool.begin();
+        it != _variantFramesPool.end() && _variantFramesPool.size() > maxPoolSize;)
+    {
+        if(1 == it->use_count())
+            it = _variantFramesPool.erase(it);
+        else
+            ++it;
+    }
+}
+
+size_t VlcVideoOutput::replayBudget()
 {
+    std::unique_lock<std::mutex> lock(_replayGuard);
+
+    return _replayBudget;
 }
 
-///////////////////////////////////////////////////////////////////////////////
-unsigned VlcVideoOutput::RV32VideoFrame::video_format_cb(
-    char* chroma,
-    unsigned* width, unsigned* height,
-    unsigned* pitches, unsigned* lines)
+void VlcVideoOutput::setReplayBudget(size_t budget)
 {
-    _width = *width;
-    _height = *height;
+    std::unique_lock<std::mutex> lock(_replayGuard);
+
+    _replayBudget = budget;
 
-    memcpy(chroma, vlc::DEF_CHROMA, sizeof(vlc::DEF_CHROMA) - 1);
-    *pitches = *width * vlc::DEF_PIXEL_BYTES;
-    *lines = *height;
+    while(!_replayFrames.empty() && _replayBytes > _replayBudget) {
+        _replayBytes -= _replayFrames.front().data.size();
+        _replayFrames.pop_front();
+    }
 
-    _size = *pitches * *lines;
+    if(_replayFrames.empty())
+        _replayVideoFrame.reset();
+}
 
-    _tmpFrameBuffer = malloc(_size);
+unsigned VlcVideoOutput::replayFramesCount()
+{
+    std::unique_lock<std::mutex> lock(_replayGuard);
 
-    return 1;
+    return static_cast<unsigned>(_replayFrames.size());
 }
 
-void* VlcVideoOutput::RV32VideoFrame::video_lock_cb(void** planes)
+bool VlcVideoOutput::replayFrameInfo(unsigned index, FrameInfo* frameInfo)
 {
-    *planes = frameBuffer();
+    std::unique_lock<std::mutex> lock(_replayGuard);
 
-    return nullptr;
+    if(index >= _replayFrames.size())
+        return false;
+
+    *frameInfo = _replayFrames[index].frameInfo;
+
+    return true;
 }
 
-void VlcVideoOutput::RV32VideoFrame::fillBlack()
+int VlcVideoOutput::replayFrameIndex(int64_t mediaTime)
 {
-    if(_frameBuffer) {
-        memset(_frameBuffer, 0, size());
+    std::unique_lock<std::mutex> lock(_replayGuard);
+
+    //media time is not monotonic after seek, so newest match wins
+    for(size_t i = _replayFrames.size(); i > 0; --i) {
+        if(_replayFrames[i - 1].frameInfo.mediaTime <= mediaTime)
+            return static_cast<int>(i - 1);
     }
+
+    return -1;
 }
 
-///////////////////////////////////////////////////////////////////////////////
-VlcVideoOutput::I420VideoFrame::I420VideoFrame() :
-    _uPlaneOffset(0), _vPlaneOffset(0)
+bool VlcVideoOutput::showReplayFrame(unsigned index)
 {
+    if(!_currentVideoFrame)
+        return false;
+
+    FrameInfo frameInfo;
+    int bufferIndex;
+    {
+        std::unique_lock<std::mutex> lock(_replayGuard);
+
+        //retained frames could be left from previous video format
+        if(index >= _replayFrames.size() || _replayVideoFrame != _currentVideoFrame)
+            return false;
+
+        const ReplayFrame& replayFrame = _replayFrames[index];
+        frameInfo = replayFrame.frameInfo;
+        frameInfo.skippedFrames = 0;
+
+        bufferIndex = _currentVideoFrame->replaceDisplayedBuffer(replayFrame.data.data(), frameInfo);
+    }
+
+    if(bufferIndex < 0)
+        return false;
+
+    onFrameReady(static_cast<unsigned>(bufferIndex), frameInfo);
+
+    return true;
 }
 
-unsigned VlcVideoOutput::I420VideoFrame::video_format_cb(
-    char* chroma,
-    unsigned* width, unsigned* height,
-    unsigned* pitches, unsigned* lines)
+void VlcVideoOutput::retainReplayFrame(unsigned bufferIndex, const FrameInfo& frameInfo)
 {
-    _width = *width;
-    _height = *height;
+    const size_t size = _currentVideoFrame->size();
+
+    //slot is reserved under lock, and filled outside of it
+    ReplayFrame replayFrame;
+    {
+        std::unique_lock<std::mutex> lock(_replayGuard);
 
-    const char CHROMA[] = "I420";
+        if(size > _replayBudget)
+            return;
 
-    memcpy(chroma, CHROMA, sizeof(CHROMA) - 1);
+        if(_replayVideoFrame != _currentVideoFrame) {
+            _replayFrames.clear();
+            _replayBytes = 0;
+            _replayVideoFrame = _currentVideoFrame;
+        }
+
+        //memory of the oldest dropped frame is reused
+        while(_replayBytes + size > _replayBudget) {
+            ReplayFrame& oldestFrame = _replayFrames.front();
+            _replayBytes -= oldestFrame.data.size();
+            if(replayFrame.data.empty())
+                replayFrame.data.swap(oldestFrame.data);
+            _replayFrames.pop_front();
+        }
 
-    const unsigned evenWidth = *width + (*width & 1);
-    const unsigned evenHeight = *height + (*height & 1);
+        _replayBytes += size;
+    }
 
-    pitches[0] = evenWidth; if(pitches[0] % 4) pitches[0] += 4 - pitches[0] % 4;
-    pitches[1] = evenWidth / 2; if(pitches[1] % 4) pitches[1] += 4 - pitches[1] % 4;
-    pitches[2] = pitches[1];
+    //decoder never writes to delivered buffer
+    replayFrame.frameInfo = frameInfo;
+    replayFrame.data.resize(size);
+    memcpy(replayFrame.data.data(), _currentVideoFrame->_buffers[bufferIndex].data, size);
 
-    assert(0 == pitches[0] % 4 && 0 == pitches[1] % 4 && 0 == pitches[2] % 4);
+    std::unique_lock<std::mutex> lock(_replayGuard);
 
-    lines[0] = evenHeight;
-    lines[1] = evenHeight / 2;
-    lines[2] = lines[1];
+    //budget could be lowered meanwhile
+    if(_replayVideoFrame != _currentVideoFrame || _replayBytes > _replayBudget) {
+        _replayBytes -= std::min(_replayBytes, size);
+        return;
+    }
 
-    _uPlaneOffset = pitches[0] * lines[0];
-    _vPlaneOffset = _uPlaneOffset + pitches[1] * lines[1];
+    _replayFrames.push_back(std::move(replayFrame));
+}
 
-    _size =
-        pitches[0] * lines[0] +
-        pitches[1] * lines[1] +
-        pitches[2] * lines[2];
+void VlcVideoOutput::notifyFrameReady()
+{
+    _waitingFrame.clear(); //FIXME! use memory_order
 
-    _tmpFrameBuffer = malloc(_size);
+    //frame will be picked up by cadence timer or pulled by renderer
+    if(_cadenceDelivery || _pullDelivery)
+        return;
 
-    return 3;
+    _guard.lock();
+    _videoEvents.emplace_back(new FrameReadyEvent);
+    _guard.unlock();
+    uv_async_send(&_async);
 }
 
-void* VlcVideoOutput::I420VideoFrame::video_lock_cb(void** planes)
+const VlcVideoOutput::FrameStats* VlcVideoOutput::frameStats(unsigned bufferIndex) const
 {
-    uint8_t* buffer = static_cast<uint8_t*>(frameBuffer());
+    if(!_currentVideoFrame || bufferIndex >= VideoFrame::BuffersCount)
+        return nullptr;
 
-    planes[0] = buffer;
-    planes[1] = buffer + _uPlaneOffset;
-    planes[2] = buffer + _vPlaneOffset;
+    //delivered buffer is not touched by decoder
+    const VideoFrame::Buffer& buffer = _currentVideoFrame->_buffers[bufferIndex];
 
-    return nullptr;
+    return buffer.hasStats ? &buffer.stats : nullptr;
 }
 
-void VlcVideoOutput::I420VideoFrame::video_unlock_cb(
-        void* picture, void *const * planes)
+const std::vector<std::shared_ptr<const VlcVideoOutput::VariantFrame> >*
+VlcVideoOutput::frameVariants(unsigned bufferIndex) const
 {
-    VideoFrame::video_unlock_cb(picture, planes);
+    if(!_currentVideoFrame || bufferIndex >= VideoFrame::BuffersCount)
+        return nullptr;
+
+    //delivered buffer is not touched by decoder
+    return &_currentVideoFrame->_buffers[bufferIndex].variants;
 }
 
-void VlcVideoOutput::I420VideoFrame::fillBlack()
+void VlcVideoOutput::handleAsync()
 {
-    if(_frameBuffer) {
-        char* buffer = static_cast<char*>(_frameBuffer);
-        memset(buffer, 0x0, _uPlaneOffset);
-        memset(buffer + _uPlaneOffset, 0x80, _vPlaneOffset - _uPlaneOffset);
-        memset(buffer + _vPlaneOffset, 0x80, size() - _vPlaneOffset);
+    while(!_videoEvents.empty()) {
+        std::deque<std::unique_ptr<VideoEvent> > tmpEvents;
+        _guard.lock();
+        _videoEvents.swap(tmpEvents);
+        _guard.unlock();
+        for(const auto& i: tmpEvents) {
+            i->process(this);
+        }
     }
 }
 
-///////////////////////////////////////////////////////////////////////////////
-struct VlcVideoOutput::VideoEvent
+void VlcVideoOutput::processFrameReady()
 {
-    virtual void process(VlcVideoOutput*) = 0;
-};
+    if(_waitingFrame.test_and_set()) //FIXME! use memory_order
+        return;
 
-///////////////////////////////////////////////////////////////////////////////
-struct VlcVideoOutput::RV32FrameSetupEvent : public VlcVideoOutput::VideoEvent
-{
-    RV32FrameSetupEvent(const std::shared_ptr<RV32VideoFrame>& videoFrame) :
-        _videoFrame(videoFrame) {}
+    if(!_currentVideoFrame || _pullDelivery)
+        return;
 
-    void process(VlcVideoOutput*) override;
+    //with backpressure few frames could wait for delivery
+    for(unsigned i = 0; i < VideoFrame::BuffersCount && _currentVideoFrame; ++i) {
+        FrameInfo frameInfo;
+        const int bufferIndex = _currentVideoFrame->acquireBuffer(&frameInfo);
+        if(bufferIndex < 0)
+            return;
 
-    std::weak_ptr<RV32VideoFrame> _videoFrame;
-};
+        countDeliveredFrame(&frameInfo);
+        retainReplayFrame(static_cast<unsigned>(bufferIndex), frameInfo);
+
+        onFrameReady(static_cast<unsigned>(bufferIndex), frameInfo);
+
+        //time spent by consumer counts too
+        _adaptiveLatency += uv_hrtime() - frameInfo.wallclock;
+    }
+}
 
-void VlcVideoOutput::RV32FrameSetupEvent::process(VlcVideoOutput* videoOutput)
+int VlcVideoOutput::acquireLatestFrame(FrameInfo* frameInfo)
 {
-    std::shared_ptr<RV32VideoFrame> videoFrame = _videoFrame.lock();
+    if(!_currentVideoFrame)
+        return -1;
+
+    //with backpressure there could be few complete frames,
+    //and all of them should be delivered in order
+    int bufferIndex = -1;
+    for(unsigned i = 0; i < VideoFrame::BuffersCount; ++i) {
+        const int nextBufferIndex = _currentVideoFrame->acquireBuffer(frameInfo);
+        if(nextBufferIndex < 0)
+            break;
 
-    if(!videoFrame)
-        return;
+        bufferIndex = nextBufferIndex;
+        if(_frameBackpressure)
+            break;
+    }
 
-    videoOutput->_currentVideoFrame = videoFrame;
+    if(bufferIndex >= 0) {
+        countDeliveredFrame(frameInfo);
+        retainReplayFrame(static_cast<unsigned>(bufferIndex), *frameInfo);
+        _adaptiveLatency += uv_hrtime() - frameInfo->wallclock;
+    }
 
-    void* buffer = videoOutput->onFrameSetup(*videoFrame);
-    if(buffer)
-        videoFrame->setFrameBuffer(buffer);
+    return bufferIndex;
 }
 
-///////////////////////////////////////////////////////////////////////////////
-struct VlcVideoOutput::I420FrameSetupEvent : public VlcVideoOutput::VideoEvent
+bool VlcVideoOutput::releaseLatestFrame()
 {
-    I420FrameSetupEvent(const std::shared_ptr<I420VideoFrame>& videoFrame) :
-        _videoFrame(videoFrame) {}
-
-    void process(VlcVideoOutput*) override;
+    if(!_currentVideoFrame)
+        return false;
 
-    std::weak_ptr<I420VideoFrame> _videoFrame;
-};
+    return _currentVideoFrame->releaseDisplayedBuffer();
+}
 
-void VlcVideoOutput::I420FrameSetupEvent::process(VlcVideoOutput* videoOutput)
+void VlcVideoOutput::countDeliveredFrame(FrameInfo* frameInfo)
 {
-    std::shared_ptr<I420VideoFrame> videoFrame = _videoFrame.lock();
-
-    if(!videoFrame)
-        return;
+    frameInfo->skippedFrames = frameInfo->sequence - _deliveredSequence - 1;
+    _deliveredSequence = frameInfo->sequence;
 
-    videoOutput->_currentVideoFrame = videoFrame;
+    const uint64_t now = uv_hrtime();
+    if(_firstFrameTimerStart) {
+        _timeToFirstFrame = (now - _firstFrameTimerStart) / 1e6;
+        _firstFrameTimerStart = 0;
+    }
 
-    void* buffer = videoOutput->onFrameSetup(*videoFrame);
-    if(buffer)
-        videoFrame->setFrameBuffer(buffer);
+    if(0 == _fpsWindowStart) {
+        _fpsWindowStart = now;
+    } else if(now - _fpsWindowStart >= 1000000000) {
+        _deliveredFps = _fpsWindowFrames * 1e9 / (now - _fpsWindowStart);
+        updateAdaptiveScale(_fpsWindowFrames);
+        _fpsWindowStart = now;
+        _fpsWindowFrames = 0;
+    }
+    ++_fpsWindowFrames;
 }
 
-///////////////////////////////////////////////////////////////////////////////
-struct VlcVideoOutput::FrameReadyEvent : public VlcVideoOutput::VideoEvent
+void VlcVideoOutput::startFirstFrameTimer()
 {
-    void process(VlcVideoOutput*) override;
-};
+    _firstFrameTimerStart = uv_hrtime();
+    _timeToFirstFrame = -1;
+}
 
-void VlcVideoOutput::FrameReadyEvent::process(VlcVideoOutput* videoOutput)
+void VlcVideoOutput::setAdaptiveScaling(bool adaptiveScaling)
 {
-    if(videoOutput->_waitingFrame.test_and_set()) //FIXME! use memory_order
-        return;
+    _adaptiveScaling = adaptiveScaling;
+    _overloadedWindows = _headroomWindows = 0;
+    _requiredHeadroomWindows = AdaptiveHeadroomWindows;
+    _adaptiveSteppedUp = false;
 
-    videoOutput->onFrameReady();
+    if(!adaptiveScaling) {
+        std::unique_lock<std::mutex> lock(_guard);
+        setAdaptiveScaleStep(0);
+    }
 }
 
-///////////////////////////////////////////////////////////////////////////////
-struct VlcVideoOutput::FrameCleanupEvent : public VlcVideoOutput::VideoEvent
+double VlcVideoOutput::adaptiveScale()
 {
-    void process(VlcVideoOutput*) override;
-};
+    std::unique_lock<std::mutex> lock(_guard);
+    return _adaptiveScale;
+}
 
-void VlcVideoOutput::FrameCleanupEvent::process(VlcVideoOutput* videoOutput)
+void VlcVideoOutput::updateAdaptiveScale(unsigned deliveredFrames)
 {
-    if(videoOutput->_currentVideoFrame) {
-        videoOutput->onFrameCleanup();
-        videoOutput->_currentVideoFrame.reset();
+    const uint64_t coalescedFrames =
+        _currentVideoFrame ? _currentVideoFrame->takeCoalescedFrames() : 0;
+    const uint64_t latency = deliveredFrames ? _adaptiveLatency / deliveredFrames : 0;
+    _adaptiveLatency = 0;
+
+    if(!_adaptiveScaling || _cadenceDelivery || _frameBackpressure || 0 == deliveredFrames)
+        return;
+
+    const uint64_t maxLatency = static_cast<uint64_t>(AdaptiveMaxLatency) * 1000000;
+    const bool overloaded =
+        coalescedFrames * AdaptiveCoalescedRatio > deliveredFrames || latency > maxLatency;
+    const bool headroom =
+        0 == coalescedFrames && latency < maxLatency / 4;
+
+    _overloadedWindows = overloaded ? _overloadedWindows + 1 : 0;
+    _headroomWindows = headroom ? _headroomWindows + 1 : 0;
+
+    const uint64_t now = uv_hrtime();
+    if(_adaptiveStepTime &&
+       now - _adaptiveStepTime < static_cast<uint64_t>(AdaptiveMinStepInterval) * 1000000000)
+    {
+        return;
     }
-}
 
-///////////////////////////////////////////////////////////////////////////////
-VlcVideoOutput::VlcVideoOutput() :
-    _pixelFormat(PixelFormat::I420)
-{
-    uv_loop_t* loop = uv_default_loop();
+    std::unique_lock<std::mutex> lock(_guard);
 
-    uv_async_init(loop, &_async,
-        [] (uv_async_t* handle) {
-            if(handle->data)
-                reinterpret_cast<VlcVideoOutput*>(handle->data)->handleAsync();
+    const unsigned step = _adaptiveScaleStep;
+    if(_overloadedWindows >= AdaptiveOverloadedWindows && step + 1 < adaptiveScalesCount) {
+        //headroom was misjudged, so be more careful next time
+        if(_adaptiveSteppedUp) {
+            _requiredHeadroomWindows *= 2;
+            if(_requiredHeadroomWindows > AdaptiveMaxHeadroomWindows)
+                _requiredHeadroomWindows = AdaptiveMaxHeadroomWindows;
         }
-   );
-    _async.data = this;
-
-    _waitingFrame.test_and_set(); //FIXME! use memory_order
+        _adaptiveSteppedUp = false;
+
+        //every step restarts video output, so go right to the step
+        //with pixel count consumer seems to cope with
+        double load = static_cast<double>(deliveredFrames + coalescedFrames) / deliveredFrames;
+        if(latency > maxLatency)
+            load = std::max(load, static_cast<double>(latency) / maxLatency);
+
+        const double currentScale = adaptiveScales[step];
+        unsigned nextStep = step + 1;
+        while(nextStep + 1 < adaptiveScalesCount &&
+              adaptiveScales[nextStep] * adaptiveScales[nextStep] * load > currentScale * currentScale)
+        {
+            ++nextStep;
+        }
+        setAdaptiveScaleStep(nextStep);
+    } else if(_headroomWindows >= _requiredHeadroomWindows && step > 0) {
+        _adaptiveSteppedUp = true;
+        setAdaptiveScaleStep(step - 1);
+    }
 }
 
-VlcVideoOutput::~VlcVideoOutput()
+void VlcVideoOutput::setAdaptiveScaleStep(unsigned step)
 {
-    uv_close(reinterpret_cast<uv_handle_t*>(&_async), 0);
-    _async.data = nullptr;
+    if(step == _adaptiveScaleStep)
+        return;
+
+    _adaptiveScaleStep = step;
+    _overloadedWindows = _headroomWindows = 0;
+    _adaptiveStepTime = uv_hrtime();
+
+    //video output could be recreated from handler, so don't call it from here
+    _videoEvents.emplace_back(new AdaptiveScaleRequestEvent(adaptiveScales[step]));
+    uv_async_send(&_async);
 }
 
-unsigned VlcVideoOutput::video_format_cb(
-    char* chroma,
-    unsigned* width, unsigned* height,
-    unsigned* pitches, unsigned* lines)
+///////////////////////////////////////////////////////////////////////////////
+struct wcjs_frame
 {
-    std::unique_ptr<VideoEvent> frameSetupEvent;
-    switch(_pixelFormat) {
-        case PixelFormat::RV32: {
-            std::shared_ptr<RV32VideoFrame> videoFrame(new RV32VideoFrame());
-            frameSetupEvent.reset(new RV32FrameSetupEvent(videoFrame));
-            _videoFrame = videoFrame;
-            break;
-        }
-        case PixelFormat::I420:
-        default: {
-            std::shared_ptr<I420VideoFrame> videoFrame(new I420VideoFrame());
-            frameSetupEvent.reset(new I420FrameSetupEvent(videoFrame));
-            _videoFrame = videoFrame;
-            break;
+    wcjs_frame(
+        const std::shared_ptr<VlcVideoOutput::VideoFrame>& videoFrame,
+        void* picture) :
+        refs(1), videoFrame(videoFrame), picture(picture) {}
+
+    void release()
+    {
+        if(0 == --refs) {
+            videoFrame->unpinBuffer(picture);
+            delete this;
         }
     }
 
-    const unsigned planeCount =
-        _videoFrame->video_format_cb(
-            chroma,
-            width, height,
-            pitches, lines);
+    wcjs_frame_view view;
+    std::atomic<unsigned> refs;
+    const std::shared_ptr<VlcVideoOutput::VideoFrame> videoFrame;
+    void *const picture;
+};
 
-    _guard.lock();
-    _videoEvents.push_back(std::move(frameSetupEvent));
-    _guard.unlock();
-    uv_async_send(&_async);
+bool VlcVideoOutput::addFrameConsumer(wcjs_frame_consumer_cb callback, void* opaque)
+{
+    if(!callback)
+        return false;
 
-    return planeCount;
+    std::unique_lock<std::mutex> lock(_frameConsumersGuard);
+
+    const auto consumer = std::make_pair(callback, opaque);
+    if(std::find(_frameConsumers.begin(), _frameConsumers.end(), consumer) != _frameConsumers.end())
+        return false;
+
+    _frameConsumers.push_back(consumer);
+
+    return true;
 }
 
-void VlcVideoOutput::video_cleanup_cb()
+bool VlcVideoOutput::removeFrameConsumer(wcjs_frame_consumer_cb callback, void* opaque)
 {
-    _videoFrame->video_cleanup_cb();
+    std::unique_lock<std::mutex> lock(_frameConsumersGuard);
 
-    _guard.lock();
-    _videoEvents.emplace_back(new FrameCleanupEvent);
-    _guard.unlock();
-    uv_async_send(&_async);
+    auto it = std::find(_frameConsumers.begin(), _frameConsumers.end(), std::make_pair(callback, opaque));
+    if(it == _frameConsumers.end())
+        return false;
+
+    _frameConsumers.erase(it);
+
+    return true;
 }
 
-void* VlcVideoOutput::video_lock_cb(void** planes)
+void VlcVideoOutput::notifyFrameConsumers(void* picture, const FrameInfo& frameInfo)
 {
-    return _videoFrame->video_lock_cb(planes);
+    //consumers could be removed only while they are not called
+    std::unique_lock<std::mutex> lock(_frameConsumersGuard);
+
+    if(_frameConsumers.empty())
+        return;
+
+    static const char* chromas[] = {
+        "RV32", "I420", "NV12", "I422", "I444", "YUY2", "RV16", "RGBA" };
+
+    const VideoFrame& videoFrame = *_videoFrame;
+
+    wcjs_frame* frame = new wcjs_frame(_videoFrame, picture);
+    const uint8_t* data = static_cast<const uint8_t*>(_videoFrame->pinBuffer(picture));
+
+    wcjs_frame_view& view = frame->view;
+    memcpy(view.chroma, chromas[static_cast<unsigned>(videoFrame.pixelFormat())], sizeof(view.chroma));
+    //J420, J422 or J444
+    if(videoFrame.fullRange())
+        view.chroma[0] = 'J';
+    view.width = videoFrame.width();
+    view.height = videoFrame.height();
+    view.plane_count = videoFrame.planeCount();
+    for(unsigned p = 0; p < WCJS_MAX_PLANES; ++p) {
+        const bool hasPlane = p < videoFrame.planeCount();
+        view.planes[p] = hasPlane ? data + videoFrame.planeOffset(p) : nullptr;
+        view.pitches[p] = hasPlane ? videoFrame.pitch(p) : 0;
+        view.lines[p] = hasPlane ? videoFrame.lines(p) : 0;
+    }
+    view.sequence = frameInfo.sequence;
+    view.wallclock = frameInfo.wallclock;
+    view.pts = frameInfo.mediaTime;
+    view.bt709 = videoFrame.bt709() ? 1 : 0;
+
+    for(const auto& consumer: _frameConsumers)
+        consumer.first(consumer.second, frame);
+
+    frame->release();
 }
 
-void VlcVideoOutput::video_unlock_cb(void* picture, void *const * planes)
+///////////////////////////////////////////////////////////////////////////////
+extern "C" {
+
+const wcjs_frame_view* wcjs_frame_get_view(const wcjs_frame* frame)
 {
-    _videoFrame->video_unlock_cb(picture, planes);
+    return &frame->view;
 }
 
-void VlcVideoOutput::video_display_cb(void* /*picture*/)
+void wcjs_frame_retain(wcjs_frame* frame)
 {
-    if(_videoFrame->frameReady())
-        notifyFrameReady();
+    ++frame->refs;
 }
 
-void VlcVideoOutput::notifyFrameReady()
+void wcjs_frame_release(wcjs_frame* frame)
 {
-    _waitingFrame.clear(); //FIXME! use memory_order
-
-    _guard.lock();
-    _videoEvents.emplace_back(new FrameReadyEvent);
-    _guard.unlock();
-    uv_async_send(&_async);
+    frame->release();
 }
 
-void VlcVideoOutput::handleAsync()
+int wcjs_add_frame_consumer(void* handle, wcjs_frame_consumer_cb callback, void* opaque)
 {
-    while(!_videoEvents.empty()) {
-        std::deque<std::unique_ptr<VideoEvent> > tmpEvents;
-        _guard.lock();
-        _videoEvents.swap(tmpEvents);
-        _guard.unlock();
-        for(const auto& i: tmpEvents) {
-            i->process(this);
-        }
-    }
+    if(!handle)
+        return -1;
+
+    return static_cast<VlcVideoOutput*>(handle)->addFrameConsumer(callback, opaque) ? 0 : -1;
 }
 
-bool VlcVideoOutput::isFrameReady()
+int wcjs_remove_frame_consumer(void* handle, wcjs_frame_consumer_cb callback, void* opaque)
 {
-    return !_waitingFrame.test_and_set(); //FIXME! use memory_order
+    if(!handle)
+        return -1;
+
+    return static_cast<VlcVideoOutput*>(handle)->removeFrameConsumer(callback, opaque) ? 0 : -1;
+}
+
 }
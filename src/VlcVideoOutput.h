@@ -1,28 +1,50 @@
 #pragma once
 
 #include <deque>
+#include <vector>
 #include <memory>
 #include <mutex>
+#include <condition_variable>
+#include <atomic>
 
 #include <uv.h>
 
 #include <libvlc_wrapper/vlc_vmem.h>
 
+#include "FrameConsumer.h"
+#include "SceneDetector.h"
+
 ///////////////////////////////////////////////////////////////////////////////
 class VlcVideoOutput :
     private vlc::basic_vmem_wrapper
 {
+public:
+    //native consumers get every frame written to frame buffers right from decode thread,
+    //could be called from any thread
+    bool addFrameConsumer(wcjs_frame_consumer_cb, void* opaque);
+    bool removeFrameConsumer(wcjs_frame_consumer_cb, void* opaque);
+
 protected:
     VlcVideoOutput();
     ~VlcVideoOutput();
 
-    using vlc::basic_vmem_wrapper::open;
-    using vlc::basic_vmem_wrapper::close;
+    bool open(vlc::basic_player*);
+    void close();
 
     enum class PixelFormat
     {
         RV32 = 0,
         I420,
+        NV12,
+        I422,
+        I444,
+        YUY2,
+        RV16,
+        //R G B A in memory with opaque alpha, rows are never padded,
+        //so frame could be used for ImageData as is
+        RGBA,
+        //use decoder output chroma if it's supported, to avoid conversion
+        Native,
     };
 
     PixelFormat pixelFormat() const
@@ -30,29 +52,297 @@ protected:
     void setPixelFormat(PixelFormat format)
         { _pixelFormat = format; }
 
+    enum class ScaleMode
+    {
+        Fit = 0, //keep aspect ratio and fit into requested size
+        Fill,    //keep aspect ratio and cover requested size
+        Exact,   //use requested size as is
+    };
+
+    struct OutputSize
+    {
+        //0 means source size
+        unsigned width;
+        unsigned height;
+        ScaleMode mode;
+    };
+
+    //alignment of plane offsets and rows in frame buffers,
+    //power of two from DefaultAlignment up to VideoFrame::MaxAlignment,
+    //new alignment is used on next video format setup,
+    //RGBA frames are never padded, and crop makes plane offsets unaligned
+    static const unsigned DefaultAlignment = 4;
+    unsigned strideAlignment();
+    bool setStrideAlignment(unsigned);
+
+    //frames with the same pixels as previous one are not delivered,
+    //it's useful for static content like slides or paused video
+    bool suppressDuplicateFrames() const
+        { return _suppressDuplicateFrames; }
+    void setSuppressDuplicateFrames(bool suppress)
+        { _suppressDuplicateFrames = suppress; }
+    uint64_t duplicateFramesSuppressed() const
+        { return _duplicateFramesSuppressed; }
+
+    //with backpressure decoder waits for free buffer instead of overwriting
+    //not yet delivered frame, so every decoded frame is delivered in order
+    bool frameBackpressure() const
+        { return _frameBackpressure; }
+    void setFrameBackpressure(bool);
+    //wakes up decoder waiting for free buffer, and lets it drop frames until resumeFrameWait(),
+    //should be called before anything waiting for decode thread (like player stop),
+    //since with backpressure decoder waits for renderer without timeout
+    void cancelFrameWait();
+    void resumeFrameWait();
+    //decoded frames which were never delivered since renderer had no buffer for them
+    //(frame wait was cancelled, or frame buffers were not set up yet)
+    uint64_t droppedFrames() const
+        { return _droppedFrames; }
+
+    //frames coming faster than maxFps are dropped by decode thread before they are written,
+    //0 means no limit, ignored with backpressure
+    double maxFps() const
+        { return _maxFps; }
+    void setMaxFps(double);
+
+    //if not 0, latest frame is delivered by timer with given rate
+    //instead of notification on every decoded frame
+    double cadenceFps() const
+        { return _cadenceFps; }
+    void setCadenceFps(double);
+
+    //with pull delivery decode thread doesn't wake up gui thread on every frame
+    //and onFrameReady is never called, frames are taken with acquireLatestFrame() instead
+    bool pullDelivery() const
+        { return _pullDelivery; }
+    void setPullDelivery(bool);
+
+    //in adaptive mode output is downscaled in steps while frames coalesce
+    //or wait too long for gui thread, and upscaled back when there is headroom,
+    //every step is requested with onAdaptiveScaleRequest,
+    //and reported with onAdaptiveScaleChange once it's applied.
+    //Ignored with cadence delivery and backpressure, since they delay or coalesce frames on purpose
+    bool adaptiveScaling() const
+        { return _adaptiveScaling; }
+    void setAdaptiveScaling(bool);
+    //factor applied to output size on latest video format setup,
+    //from 1 down to smallest adaptive step
+    double adaptiveScale();
+
+    //frames delivered per second, updated every second
+    double deliveredFps() const
+        { return _deliveredFps; }
+
+    //should be called from gui thread when playback is started
+    void startFirstFrameTimer();
+    //milliseconds from latest startFirstFrameTimer() to first frame delivered after it,
+    //negative if no frame was delivered yet
+    double timeToFirstFrame() const
+        { return _timeToFirstFrame; }
+
+    //frames which differ from previous one more than threshold (from 0 to 1)
+    //are reported with onSceneChange, 0 disables detection
+    double sceneChangeThreshold() const
+        { return _sceneChangeThreshold; }
+    void setSceneChangeThreshold(double threshold)
+        { _sceneChangeThreshold = threshold; }
+
+    //statistics are computed by decode thread for every n-th frame,
+    //0 disables them
+    unsigned frameStatsInterval() const
+        { return _frameStatsInterval; }
+    void setFrameStatsInterval(unsigned interval)
+        { _frameStatsInterval = interval; }
+
+    //libvlc scales frames to this size before delivery,
+    //new size is used on next video format setup
+    OutputSize outputSize();
+    void setOutputSize(const OutputSize&);
+
+    struct CropRect
+    {
+        //in source pixels, 0 width or height means no crop
+        unsigned x;
+        unsigned y;
+        unsigned width;
+        unsigned height;
+    };
+
+    //vmem ignores libvlc crop geometry, so whole frame is decoded
+    //and delivered frames describe only crop rect clipped by source frame
+    //(plane offsets point to rect origin and rows keep pitch of whole frame),
+    //new rect is used on next video format setup, before output size is applied
+    CropRect cropRect();
+    void setCropRect(const CropRect&);
+
+    struct FrameInfo
+    {
+        //incremented on every decoded frame, starting from 1
+        uint64_t sequence;
+        //uv_hrtime() when frame was decoded, in nanoseconds
+        uint64_t wallclock;
+        //approximate media time of frame, in milliseconds, or -1 if unknown:
+        //latest time reported by libvlc input when frame was decoded,
+        //it's updated periodically and could differ from frame pts
+        int64_t mediaTime;
+        //decoded frames overwritten or dropped since previous delivered frame
+        uint64_t skippedFrames;
+    };
+
+    struct FrameStats
+    {
+        static const unsigned Channels = 3;
+
+        //Y, U, V for YUV formats, or R, G, B for RGB ones
+        bool rgb;
+        uint32_t histograms[Channels][256];
+
+        unsigned lumaMin;
+        unsigned lumaMax;
+        double lumaMean;
+        double averageRgb[3];
+    };
+
+    struct SceneChange
+    {
+        //FrameInfo::sequence of first frame of new scene
+        uint64_t sequence;
+        //in milliseconds, approximate as FrameInfo::mediaTime
+        int64_t mediaTime;
+        //difference with previous frame, from 0 to 1
+        double score;
+    };
+
+    //additional copy of every frame, converted by decode thread
+    //to other size and pixel format
+    struct FrameVariant
+    {
+        //0 means frame size, frames are only downscaled, keeping aspect ratio
+        unsigned width;
+        unsigned height;
+        //RV32 or I420
+        PixelFormat pixelFormat;
+
+        bool operator==(const FrameVariant& other) const
+        {
+            return width == other.width && height == other.height &&
+                pixelFormat == other.pixelFormat;
+        }
+    };
+
+    struct VariantFrame
+    {
+        //variant frame was converted for
+        FrameVariant variant;
+        unsigned width;
+        unsigned height;
+        //planes one after another, without padding
+        std::vector<uint8_t> data;
+    };
+
+    class FrameBuffer;
     class VideoFrame;
     class RV32VideoFrame;
+    class RV16VideoFrame;
+    class RGBAVideoFrame;
+    class YUY2VideoFrame;
     class I420VideoFrame;
-
-    //should return pointer to buffer for video frame
-    virtual void* onFrameSetup(const RV32VideoFrame&) = 0;
-    virtual void* onFrameSetup(const I420VideoFrame&) = 0;
-    virtual void onFrameReady() = 0;
+    class I422VideoFrame;
+    class I444VideoFrame;
+    class NV12VideoFrame;
+
+    //should return buffer with at least capacity bytes,
+    //it will be reused for next video frames while they fit to it,
+    //with native frame buffers it's called from decode thread
+    virtual std::unique_ptr<FrameBuffer> onFrameBufferAlloc(size_t capacity) = 0;
+    //frameBuffers contains VideoFrame::BuffersCount buffers large enough for video frame,
+    //should return false if video frame can't be used
+    virtual bool onFrameSetup(const VideoFrame&, FrameBuffer* const frameBuffers[]) = 0;
+    //bufferIndex is index of buffer with latest complete frame
+    virtual void onFrameReady(unsigned bufferIndex, const FrameInfo&) = 0;
+    //statistics of frame in buffer, or nullptr if they were not computed for it,
+    //should be called only from onFrameReady
+    const FrameStats* frameStats(unsigned bufferIndex) const;
+    //variants of frame in buffer, converted with variants set at that moment,
+    //should be called only from onFrameReady
+    const std::vector<std::shared_ptr<const VariantFrame> >* frameVariants(unsigned bufferIndex) const;
     virtual void onFrameCleanup() = 0;
-
-    //will reset current flag state
-    bool isFrameReady();
+    virtual void onSceneChange(const SceneChange&) = 0;
+    //new scale is used on next video format setup,
+    //so video output should be recreated for it to take effect
+    virtual void onAdaptiveScaleRequest(double scale) = 0;
+    //called right after onFrameSetup for format set up with new scale
+    virtual void onAdaptiveScaleChange(double scale) = 0;
+
+    //could be called from any thread, used starting from next decoded frame,
+    //variants with the same parameters are converted only once
+    void setFrameVariants(const std::vector<FrameVariant>&);
+
+    //will reset current flag state and call onFrameReady if there are new frames
+    void processFrameReady();
+
+    //should be called only from gui thread,
+    //returns index of buffer with latest complete frame, or -1 if there is no new frame,
+    //buffer is not touched by decoder until next acquire or release
+    int acquireLatestFrame(FrameInfo*);
+    //lets decoder reuse buffer of latest acquired frame
+    bool releaseLatestFrame();
+
+    //allocates buffers enough for frames up to width x height in current pixel format,
+    //so following format changes will not allocate anything
+    void preallocateFrameBuffers(unsigned width, unsigned height);
+    //drops buffers which are not used by current video frame
+    void clearFrameBuffersPool();
+
+    //with native frame buffers decode thread takes buffers for new video format by itself,
+    //so first frames are written right away instead of temporary buffer
+    //and are delivered as soon as gui thread handles frame setup,
+    //onFrameBufferAlloc should not touch js then
+    bool nativeFrameBuffers() const
+        { return _nativeFrameBuffers; }
+    void setNativeFrameBuffers(bool native)
+        { _nativeFrameBuffers = native; }
+
+    //lets consumers outside of gui thread read frames without locks:
+    //index of every acquired buffer is stored to publishedBuffer before previous one is released,
+    //and decoder will not write to buffer with index from readerBuffer (-1 if none)
+    void setBufferSync(
+        std::atomic<int32_t>* publishedBuffer,
+        const std::atomic<int32_t>* readerBuffer);
+
+    //delivered frames are retained in memory up to budget bytes,
+    //oldest ones are dropped first, 0 disables retaining
+    size_t replayBudget();
+    void setReplayBudget(size_t);
+    unsigned replayFramesCount();
+    //index 0 is the oldest retained frame, returns false if index is out of range
+    bool replayFrameInfo(unsigned index, FrameInfo*);
+    //index of latest retained frame with media time not after given one, or -1
+    int replayFrameIndex(int64_t mediaTime);
+    //copies retained frame to currently delivered buffer and calls onFrameReady for it,
+    //should be called only from gui thread
+    bool showReplayFrame(unsigned index);
+
+    //copies latest delivered frame to data, should be called only from gui thread,
+    //returns nullptr if there is no delivered frame,
+    //returned frame describes data layout and could be used from any thread
+    std::shared_ptr<const VideoFrame> copyDisplayedFrame(std::vector<uint8_t>* data);
 
 private:
     struct VideoEvent;
-    struct RV32FrameSetupEvent;
-    struct I420FrameSetupEvent;
+    struct FrameSetupEvent;
     struct FrameReadyEvent;
     struct FrameCleanupEvent;
+    struct SceneChangeEvent;
+    struct AdaptiveScaleRequestEvent;
+    struct AdaptiveScaleChangeEvent;
 
     void handleAsync();
 
 private:
+    static void player_event_wrapper(const libvlc_event_t*, void*);
+    void player_event(const libvlc_event_t*);
+
     unsigned video_format_cb(
         char* chroma,
         unsigned* width, unsigned* height,
@@ -64,17 +354,182 @@ private:
     void video_display_cb(void* picture) override;
 
     void notifyFrameReady();
+    void notifyFrameConsumers(void* picture, const FrameInfo&);
+    void detectSceneChange(void* picture, const FrameInfo&);
+    void convertFrameVariants(void* picture);
+    //should be called only from gui thread for just delivered buffer
+    void retainReplayFrame(unsigned bufferIndex, const FrameInfo&);
+
+    //should be called only from gui thread
+    void updateFrameWait();
+    //updates skippedFrames of frame being delivered and delivered fps
+    void countDeliveredFrame(FrameInfo*);
+    //called once per delivered fps window with frames delivered in it
+    void updateAdaptiveScale(unsigned deliveredFrames);
+    //should be called with _guard locked
+    void setAdaptiveScaleStep(unsigned step);
+
+    //returns false if frame should be dropped to not exceed maxFps
+    bool paceFrame();
+
+    static PixelFormat nativePixelFormat(const char* chroma);
+    //returns false if there is nothing to crop
+    static bool clipCropRect(CropRect*, unsigned width, unsigned height);
+    static void applyOutputSize(const OutputSize&, unsigned* width, unsigned* height);
+    static std::shared_ptr<VideoFrame> createVideoFrame(PixelFormat);
+    static size_t frameSize(
+        PixelFormat, unsigned alignment,
+        unsigned width, unsigned height);
+
+    //could be called from any thread,
+    //returns smallest pooled buffer large enough for size, or nullptr
+    std::unique_ptr<FrameBuffer> takePooledFrameBuffer(size_t size);
+    void poolFrameBuffer(std::unique_ptr<FrameBuffer>);
+    //leaves pinned buffer alive when it's owner goes away
+    static void orphanFrameBuffer(std::unique_ptr<FrameBuffer>);
+    //should be called only from decode thread,
+    //fills frameBuffers only if all of them were taken
+    void takeNativeFrameBuffers(
+        size_t size, size_t capacity,
+        std::unique_ptr<FrameBuffer> frameBuffers[]);
+
+    //should be called only from gui thread
+    bool takeFrameBuffers(size_t size, FrameBuffer* frameBuffers[]);
+    void releaseFrameBuffers();
 
 private:
+    //window is overloaded if more than 1 / AdaptiveCoalescedRatio of delivered frames
+    //coalesced, or if frames wait for gui thread longer than AdaptiveMaxLatency on average,
+    //and has headroom if there is no coalescing and latency is 4 times lower
+    static const unsigned AdaptiveCoalescedRatio = 4;
+    static const unsigned AdaptiveMaxLatency = 50; //milliseconds
+    //consecutive one second windows required to step down or up
+    static const unsigned AdaptiveOverloadedWindows = 2;
+    static const unsigned AdaptiveHeadroomWindows = 5;
+    //every step recreates video output, which is expensive,
+    //so steps are at least AdaptiveMinStepInterval seconds apart,
+    //and if step up is followed by step down, headroom windows required
+    //for next step up are doubled, up to AdaptiveMaxHeadroomWindows
+    static const unsigned AdaptiveMinStepInterval = 10;
+    static const unsigned AdaptiveMaxHeadroomWindows = 80;
+
     PixelFormat _pixelFormat; //FIXME! maybe we need std::atomic here
+    vlc::basic_player* _player;
     std::shared_ptr<VideoFrame> _videoFrame; //should be accessed only from decode thread
     std::shared_ptr<VideoFrame> _currentVideoFrame; //should be accessed only from gui thread
 
+    std::mutex _frameBuffersGuard;
+    std::deque<std::unique_ptr<FrameBuffer> > _frameBuffersPool; //guarded by _frameBuffersGuard
+    //should be accessed only from gui thread
+    std::deque<std::unique_ptr<FrameBuffer> > _usedFrameBuffers;
+    std::atomic<int32_t>* _publishedBuffer;
+    const std::atomic<int32_t>* _readerBuffer;
+
+    //should be accessed only from gui thread
+    uint64_t _deliveredSequence;
+    uint64_t _fpsWindowStart;
+    unsigned _fpsWindowFrames;
+    double _deliveredFps;
+    uint64_t _firstFrameTimerStart; //0 if first frame was delivered already
+    double _timeToFirstFrame; //in milliseconds
+
+    //should be accessed only from decode thread
+    uint64_t _decodedFrames;
+    uint64_t _nextFrameTime;
+    bool _lastFrameHashValid;
+    uint64_t _lastFrameHash;
+    SceneDetector _sceneDetector;
+    void* _tmpFrameBuffer;
+    size_t _tmpFrameBufferCapacity;
+    size_t _preallocatedFrameSize; //guarded by _guard
+    OutputSize _outputSize; //guarded by _guard
+    CropRect _cropRect; //guarded by _guard
+    unsigned _strideAlignment; //guarded by _guard
+    double _maxFps; //should be accessed only from gui thread
+    std::atomic<uint64_t> _minFrameInterval; //in nanoseconds
+    double _cadenceFps; //should be accessed only from gui thread
+    std::atomic<bool> _cadenceDelivery;
+    std::atomic<bool> _pullDelivery;
+    std::atomic<bool> _nativeFrameBuffers;
+    //latest libvlc_MediaPlayerTimeChanged time, or -1,
+    //so vmem callbacks never call libvlc which could block against stop
+    std::atomic<int64_t> _mediaTime;
+    std::atomic<bool> _frameBackpressure;
+    bool _frameWaitCancelled; //should be accessed only from gui thread
+    std::atomic<bool> _frameWaitEnabled;
+    std::atomic<bool> _suppressDuplicateFrames;
+    std::atomic<uint64_t> _duplicateFramesSuppressed;
+    std::atomic<uint64_t> _droppedFrames;
+    std::atomic<unsigned> _frameStatsInterval;
+    std::atomic<double> _sceneChangeThreshold;
+
+    unsigned _adaptiveScaleStep; //guarded by _guard
+    double _adaptiveScale; //applied on latest video format setup, guarded by _guard
+    //should be accessed only from gui thread
+    bool _adaptiveScaling;
+    uint64_t _adaptiveLatency; //sum over current window, in nanoseconds
+    unsigned _overloadedWindows;
+    unsigned _headroomWindows;
+    unsigned _requiredHeadroomWindows;
+    uint64_t _adaptiveStepTime; //uv_hrtime() of latest step, 0 if there was none
+    bool _adaptiveSteppedUp; //latest step was up
+
+    std::mutex _frameVariantsGuard;
+    std::vector<FrameVariant> _frameVariants; //guarded by _frameVariantsGuard
+    //converted frames not referenced by anything but pool are reused,
+    //should be accessed only from decode thread
+    std::vector<std::shared_ptr<VariantFrame> > _variantFramesPool;
+
+    struct ReplayFrame
+    {
+        FrameInfo frameInfo;
+        std::vector<uint8_t> data;
+    };
+
+    std::mutex _replayGuard;
+    size_t _replayBudget; //guarded by _replayGuard
+    size_t _replayBytes; //guarded by _replayGuard
+    //all retained frames have layout of this frame, guarded by _replayGuard
+    std::shared_ptr<const VideoFrame> _replayVideoFrame;
+    std::deque<ReplayFrame> _replayFrames; //guarded by _replayGuard
+
+    std::mutex _frameConsumersGuard;
+    std::vector<std::pair<wcjs_frame_consumer_cb, void*> > _frameConsumers; //guarded by _frameConsumersGuard
+
     uv_async_t _async;
+    uv_timer_t _cadenceTimer;
     std::mutex _guard;
     std::deque<std::unique_ptr<VideoEvent> > _videoEvents;
 
     std::atomic_flag _waitingFrame;
+
+    friend struct ::wcjs_frame;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+class VlcVideoOutput::FrameBuffer
+{
+public:
+    FrameBuffer(void* data, size_t capacity) :
+        _data(data), _capacity(capacity), _pins(0) {}
+    virtual ~FrameBuffer() {}
+
+    void* data() const
+        { return _data; }
+    size_t capacity() const
+        { return _capacity; }
+
+    //buffer holding frames retained by native frame consumers
+    //is neither reused nor destroyed by pool until they are released
+    bool pinned() const
+        { return _pins > 0; }
+
+private:
+    void* _data;
+    size_t _capacity;
+    std::atomic<unsigned> _pins;
+
+    friend VideoFrame;
 };
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -85,6 +540,16 @@ protected:
     virtual ~VideoFrame();
 
 public:
+    //decoder writes to one buffer, latest complete frame waits in another one,
+    //and renderer owns the rest, so nobody has to wait for each other
+    static const unsigned BuffersCount = 3;
+    //PICTURE_PLANE_MAX from libvlc
+    static const unsigned MaxPlanes = 5;
+    //frame buffers data should be aligned to it
+    static const unsigned MaxAlignment = 64;
+
+    virtual PixelFormat pixelFormat() const = 0;
+
     unsigned width() const
         { return _width; }
     unsigned height() const
@@ -92,22 +557,153 @@ public:
     unsigned size() const
         { return _size; }
 
-    void setFrameBuffer(void* frameBuffer);
+    unsigned planeCount() const
+        { return _planeCount; }
+    unsigned planeOffset(unsigned plane) const
+        { return _planeOffsets[plane]; }
+    unsigned pitch(unsigned plane) const
+        { return _pitches[plane]; }
+    unsigned lines(unsigned plane) const
+        { return _lines[plane]; }
+    unsigned alignment() const
+        { return _alignment; }
+    //YUV values use full 0..255 range (J420, J422 or J444 from decoder),
+    //instead of usual limited one, could be true only with native pixel format
+    bool fullRange() const
+        { return _fullRange; }
+    //YUV values use BT.709 matrix instead of BT.601 one,
+    //vmem doesn't report source colorimetry, so it's guessed from source size
+    bool bt709() const
+        { return _bt709; }
+
+    //nullptr makes decoder write to temporary buffer again,
+    //but previous buffers should stay alive until video frame cleanup
+    void setFrameBuffers(FrameBuffer* const frameBuffers[]);
+    void setBufferSync(
+        std::atomic<int32_t>* publishedBuffer,
+        const std::atomic<int32_t>* readerBuffer);
+
+    void fillBlack();
+
+    //should be called only from gui thread,
+    //returns false if no buffer is displayed now
+    bool copyDisplayedBuffer(std::vector<uint8_t>*);
+    //converts data in layout of this frame to packed RGB of width x height,
+    //downscaling is done with box filter
+    void convertToRgb(const void* data, unsigned width, unsigned height, uint8_t* rgb) const;
+    //converts data in layout of this frame to width x height frame of RV32 or I420
+    //pixel format without padding, downscaling is done with box filter
+    void convertFrame(
+        const void* data, PixelFormat,
+        unsigned width, unsigned height,
+        uint8_t* out) const;
+    static size_t convertedFrameSize(PixelFormat, unsigned width, unsigned height);
+
+    //pinned buffer is not reused by decoder until it's unpinned,
+    //and it's frame buffer is kept out of pool, pinBuffer returns buffer data
+    void* pinBuffer(void* picture);
+    void unpinBuffer(void* picture);
 
 protected:
-    void* frameBuffer();
-    bool frameReady() const;
+    struct PlaneLayout
+    {
+        //bytes per pixel (or per macropixel for packed subsampled formats)
+        unsigned pixelBytes;
+        //chroma subsampling
+        unsigned widthDivider;
+        unsigned heightDivider;
+        //pixelBytes long pattern of black pixel
+        uint8_t black[4];
+    };
+
+    //fills frame geometry for given chroma and planes layout, returns planes count
+    unsigned setupPlanes(
+        const char* fourcc,
+        const PlaneLayout layouts[], unsigned planeCount,
+        char* chroma,
+        unsigned* width, unsigned* height,
+        unsigned* pitches, unsigned* lines);
+    //restricts visible geometry to rect of decoded frame (which stays intact in buffers),
+    //so plane offsets, width, height and lines describe only it,
+    //rect origin is aligned down to chroma subsampling
+    void setVisibleRect(unsigned x, unsigned y, unsigned width, unsigned height);
+
+    enum class BufferState
+    {
+        Free = 0,
+        Writing,
+        Ready,
+        Displayed,
+    };
+
+    struct Buffer
+    {
+        void* data;
+        //nullptr until frame buffers are set
+        FrameBuffer* frameBuffer;
+        BufferState state;
+        //state before buffer was locked for writing
+        BufferState lockedState;
+        //lock overwrote not yet delivered frame and counted it as coalesced
+        bool coalesced;
+        FrameInfo frameInfo;
+        //native frame consumers holding this buffer
+        unsigned pins;
+        bool hasStats;
+        FrameStats stats;
+        std::vector<std::shared_ptr<const VariantFrame> > variants;
+    };
+
+    //should be called only from decode thread,
+    //if waitEnabled is not null and there is no free buffer,
+    //waits until renderer releases one, waitEnabled is reset or frame buffers are reset,
+    //returns temporary buffer and null picture if frame will be dropped
+    void* lockBuffer(void** picture, const std::atomic<bool>* waitEnabled);
+    //returns false if frame was decoded to temporary buffer,
+    //if keepReady is false previous not yet delivered frames are dropped
+    bool displayBuffer(void* picture, const FrameInfo&, bool keepReady);
+    //returns buffer to state it had before lock,
+    //returns true if it holds not yet delivered frame
+    bool discardBuffer(void* picture);
+    //hash of visible pixels, padding is ignored
+    uint64_t bufferHash(void* picture) const;
+    //should be called only from decode thread for locked buffer,
+    //computes statistics if compute is true, or marks buffer as having none
+    void updateBufferStats(void* picture, bool compute);
+    void computeStats(const uint8_t* data, FrameStats*) const;
+    //downsampled luma of locked buffer or of temporary one if picture is null
+    void lumaGrid(void* picture, uint8_t grid[SceneDetector::GridSize]) const;
+    //should be called only from decode thread for locked buffer
+    std::vector<std::shared_ptr<const VariantFrame> >& bufferVariants(void* picture);
+
+    void pixelRgb(const uint8_t* data, unsigned x, unsigned y, unsigned rgb[3]) const;
+    //always in limited range
+    void pixelYuv(const uint8_t* data, unsigned x, unsigned y, unsigned yuv[3]) const;
+
+    //should be called only from gui thread,
+    //replaces contents of delivered buffer, returns its index or -1 if there is no such buffer
+    int replaceDisplayedBuffer(const void* data, const FrameInfo&);
+
+    //should be called only from gui thread,
+    //returns index of buffer with oldest complete frame or -1 if there is no new frame
+    int acquireBuffer(FrameInfo*);
+    //returns complete frames overwritten before delivery since previous call
+    uint64_t takeCoalescedFrames();
+    //should be called only from gui thread,
+    //lets decoder write to delivered buffer, returns false if there is no such buffer
+    bool releaseDisplayedBuffer();
+    //wakes up decode thread waiting in lockBuffer
+    void notifyBufferWaiters();
 
     virtual unsigned video_format_cb(
         char* chroma,
         unsigned* width, unsigned* height,
         unsigned* pitches, unsigned* lines) = 0;
 
-    virtual void* video_lock_cb(void** planes) = 0;
-    virtual void video_unlock_cb(void* picture, void *const * planes);
-    void video_cleanup_cb();
-
-    virtual void fillBlack() = 0;
+    void* video_lock_cb(void** planes, const std::atomic<bool>* waitEnabled);
+    //lets decoder write frame which will be dropped
+    void* video_drop_cb(void** planes);
+    void video_unlock_cb(void* picture, void *const * planes);
 
     friend VlcVideoOutput;
 
@@ -115,48 +711,137 @@ protected:
     unsigned _width;
     unsigned _height;
     unsigned _size;
+    unsigned _alignment;
+    bool _fullRange;
+    bool _bt709;
+
+    const PlaneLayout* _layouts;
+    unsigned _planeCount;
+    unsigned _planeOffsets[MaxPlanes];
+    unsigned _pitches[MaxPlanes];
+    unsigned _lines[MaxPlanes];
+    //geometry of whole decoded frame, differs from visible one only with crop
+    unsigned _bufferOffsets[MaxPlanes];
+    unsigned _bufferLines[MaxPlanes];
 
     void* _tmpFrameBuffer;
     std::mutex _guard;
-    void* _frameBuffer;
+    std::condition_variable _bufferReleased;
+    Buffer _buffers[BuffersCount];
+    bool _buffersReady;
+    uint64_t _coalescedFrames;
+    std::atomic<int32_t>* _publishedBuffer;
+    const std::atomic<int32_t>* _readerBuffer;
 };
 
 ///////////////////////////////////////////////////////////////////////////////
 class VlcVideoOutput::RV32VideoFrame : public VideoFrame
 {
 public:
-    void fillBlack() override;
+    PixelFormat pixelFormat() const override
+        { return PixelFormat::RV32; }
 
 private:
     unsigned video_format_cb(
         char* chroma,
         unsigned* width, unsigned* height,
-        unsigned* pitches, unsigned* line) override;
-    void* video_lock_cb(void** planes) override;
+        unsigned* pitches, unsigned* lines) override;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+class VlcVideoOutput::RV16VideoFrame : public VideoFrame
+{
+public:
+    PixelFormat pixelFormat() const override
+        { return PixelFormat::RV16; }
+
+private:
+    unsigned video_format_cb(
+        char* chroma,
+        unsigned* width, unsigned* height,
+        unsigned* pitches, unsigned* lines) override;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+class VlcVideoOutput::RGBAVideoFrame : public VideoFrame
+{
+public:
+    PixelFormat pixelFormat() const override
+        { return PixelFormat::RGBA; }
+
+private:
+    unsigned video_format_cb(
+        char* chroma,
+        unsigned* width, unsigned* height,
+        unsigned* pitches, unsigned* lines) override;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+class VlcVideoOutput::YUY2VideoFrame : public VideoFrame
+{
+public:
+    PixelFormat pixelFormat() const override
+        { return PixelFormat::YUY2; }
+
+private:
+    unsigned video_format_cb(
+        char* chroma,
+        unsigned* width, unsigned* height,
+        unsigned* pitches, unsigned* lines) override;
 };
 
 ///////////////////////////////////////////////////////////////////////////////
 class VlcVideoOutput::I420VideoFrame : public VideoFrame
 {
 public:
-    I420VideoFrame();
+    PixelFormat pixelFormat() const override
+        { return PixelFormat::I420; }
 
-    unsigned uPlaneOffset() const
-        { return _uPlaneOffset; }
-    unsigned vPlaneOffset() const
-        { return _vPlaneOffset; }
+private:
+    unsigned video_format_cb(
+        char* chroma,
+        unsigned* width, unsigned* height,
+        unsigned* pitches, unsigned* lines) override;
+};
 
-    void fillBlack() override;
+///////////////////////////////////////////////////////////////////////////////
+class VlcVideoOutput::I422VideoFrame : public VideoFrame
+{
+public:
+    PixelFormat pixelFormat() const override
+        { return PixelFormat::I422; }
 
 private:
     unsigned video_format_cb(
         char* chroma,
         unsigned* width, unsigned* height,
         unsigned* pitches, unsigned* lines) override;
-    void* video_lock_cb(void** planes) override;
-    void video_unlock_cb(void* picture, void *const * planes) override;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+class VlcVideoOutput::I444VideoFrame : public VideoFrame
+{
+public:
+    PixelFormat pixelFormat() const override
+        { return PixelFormat::I444; }
+
+private:
+    unsigned video_format_cb(
+        char* chroma,
+        unsigned* width, unsigned* height,
+        unsigned* pitches, unsigned* lines) override;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+class VlcVideoOutput::NV12VideoFrame : public VideoFrame
+{
+public:
+    PixelFormat pixelFormat() const override
+        { return PixelFormat::NV12; }
 
 private:
-    unsigned _uPlaneOffset;
-    unsigned _vPlaneOffset;
+    unsigned video_format_cb(
+        char* chroma,
+        unsigned* width, unsigned* height,
+        unsigned* pitches, unsigned* lines) override;
 };
@@ -1,6 +1,8 @@
 #include <node.h>
 
 #include "JsVlcPlayer.h"
+#include "JsVlcSceneScanner.h"
+#include "JsVlcThumbnailer.h"
 #include "NodeTools.h"
 
 extern "C" NODE_MODULE_EXPORT void
@@ -10,4 +12,6 @@ NODE_MODULE_INITIALIZER(
     v8::Local<v8::Context> context)
 {
     JsVlcPlayer::initJsApi(exports, module, context);
+    JsVlcThumbnailer::initJsApi(exports, context);
+    JsVlcSceneScanner::initJsApi(exports, context);
 }
@@ -0,0 +1,31 @@
+#pragma once
+
+///////////////////////////////////////////////////////////////////////////////
+//8 bit YUV to RGB conversion factors:
+//Y' = yScale * (Y - yOffset), U' = U - 128, V' = V - 128,
+//R = Y' + vr * V', G = Y' - ug * U' - vg * V', B = Y' + ub * U'
+struct YuvMatrix
+{
+    float yScale;
+    float yOffset;
+    float vr;
+    float ug;
+    float vg;
+    float ub;
+};
+
+inline const YuvMatrix& yuvMatrix(bool bt709, bool fullRange)
+{
+    static const YuvMatrix matrices[2][2] = {
+        {
+            { 1.164f, 16.f, 1.596f, 0.392f, 0.813f, 2.017f }, //BT.601 limited range
+            { 1.f, 0.f, 1.402f, 0.344f, 0.714f, 1.772f },     //BT.601 full range
+        },
+        {
+            { 1.164f, 16.f, 1.793f, 0.213f, 0.533f, 2.112f }, //BT.709 limited range
+            { 1.f, 0.f, 1.575f, 0.187f, 0.468f, 1.856f },     //BT.709 full range
+        },
+    };
+
+    return matrices[bt709 ? 1 : 0][fullRange ? 1 : 0];
+}